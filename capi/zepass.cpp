@@ -0,0 +1,237 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Export the C interface from the shared library
+#define ZEPASS_BUILDING_LIBRARY
+#include <capi/zepass.h>
+
+#include <zepass/decoder.hh>
+#include <zepass/log.hh>
+#include <zepass/pass.hh>
+#include <zepass/record.hh>
+#include <zepass/watchlist.hh>
+
+#include <algorithm>
+#include <complex>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <cstddef>
+#include <cstring>
+
+namespace z = zepass;
+
+static_assert(sizeof(zepass_sample_t) == sizeof(z::sample_t), "zepass_sample_t must match zepass::sample_t");
+static_assert(sizeof(zepass_read_t) == sizeof(z::read_record), "zepass_read_t must match zepass::read_record");
+static_assert(offsetof(zepass_read_t, flags) == offsetof(z::read_record, flags),
+        "zepass_read_t must match zepass::read_record");
+static_assert(ZEPASS_READ_CORRECTED == z::read_flag_corrected, "Read flags must match");
+static_assert(ZEPASS_READ_WATCHLIST_SHIFT == z::read_flag_watchlist_shift &&
+        ZEPASS_READ_WATCHLIST_MASK == z::read_flag_watchlist_mask, "Read flags must match");
+
+///
+/// \brief The decoder behind the C handle, and where its reads go.
+///
+struct zepass_decoder {
+    std::unique_ptr<z::decoder> dec; //< The decoder
+    zepass_read_handler_t handler = nullptr; //< Called with each read, or null
+    void* handler_ctx = nullptr; //< Passed back to the read handler
+};
+
+namespace {
+
+/// Description of the last failure on each thread
+thread_local std::string last_error;
+
+/// Run a function, turning any exception into a return value of -1 and the error
+/// for zepass_last_error(). Nothing may be thrown across the C interface.
+template <typename F>
+int guarded(F const& fn)
+{
+    try {
+        fn();
+        return 0;
+    } catch (std::exception const& e) {
+        last_error = e.what();
+    } catch (...) {
+        last_error = "Unknown error";
+    }
+
+    return -1;
+}
+
+} // end anonymous namespace
+
+void zepass_config_init(zepass_config_t* const cfg)
+{
+    *cfg = zepass_config_t();
+
+    cfg->size = sizeof(zepass_config_t);
+    cfg->center_freq = 915750000;
+    cfg->sample_rate = 3000000;
+    cfg->interval_len = 580;
+    cfg->fft_len = 0;
+    cfg->max_passes = 64;
+    cfg->max_age = 30 * 1000000;
+    cfg->drift_tolerance = 1500.0;
+    cfg->threshold = 500.0;
+    cfg->cfar_pfa = 0.0;
+    cfg->cfar_window = 32;
+    cfg->candidate_intervals = 0;
+    cfg->candidate_threshold = 0.33;
+    cfg->peak_combining = 0;
+    cfg->decode_snr = 1.0;
+    cfg->chase_bits = 0;
+    cfg->chase_flips = 3;
+    cfg->align_shift = 2.0;
+    cfg->energy_gate = 0.0;
+    cfg->energy_gate_refresh = 40;
+    cfg->decode_budget = 0.0;
+}
+
+zepass_decoder_t* zepass_decoder_create(zepass_config_t const* const caller_cfg)
+{
+    std::unique_ptr<zepass_decoder_t> handle;
+
+    int const ret = guarded([&]() {
+        if (nullptr == caller_cfg || caller_cfg->size < offsetof(zepass_config_t, energy_gate_refresh) +
+                sizeof(caller_cfg->energy_gate_refresh))
+        {
+            throw std::invalid_argument("Configuration is missing, or from an older version of this library");
+        }
+
+        // Take only as much of the configuration as the caller knows about
+        zepass_config_t cfg;
+        zepass_config_init(&cfg);
+        std::memcpy(&cfg, caller_cfg, std::min(caller_cfg->size, sizeof(cfg)));
+
+        handle = std::make_unique<zepass_decoder_t>();
+        handle->dec = std::make_unique<z::decoder>(z::freq_t(cfg.center_freq), z::freq_t(cfg.sample_rate),
+                cfg.interval_len, cfg.max_age, 1, nullptr, cfg.max_passes, cfg.fft_len);
+
+        z::decoder& d = *handle->dec;
+        d.set_drift_tolerance(cfg.drift_tolerance);
+        d.set_detection_threshold(cfg.threshold);
+        d.set_cfar(cfg.cfar_pfa, cfg.cfar_window);
+        d.set_candidate_validation(cfg.candidate_intervals, cfg.candidate_threshold);
+        d.set_combining(0 != cfg.peak_combining ? z::combining::peak_normalized : z::combining::maximal_ratio,
+                cfg.decode_snr);
+        d.set_error_correction(cfg.chase_bits, cfg.chase_flips);
+        d.set_alignment(cfg.align_shift);
+        d.set_energy_gate(cfg.energy_gate, cfg.energy_gate_refresh);
+        d.set_budget(cfg.decode_budget);
+
+        zepass_decoder_t* const self = handle.get();
+        d.add_read_handler([self](z::pass const& p) {
+            if (nullptr == self->handler) {
+                return;
+            }
+
+            z::read_record rec;
+            p.fill_record(rec);
+
+            zepass_read_t read;
+            std::memcpy(&read, &rec, sizeof(read));
+            self->handler(self->handler_ctx, &read);
+        });
+    });
+
+    return 0 == ret ? handle.release() : nullptr;
+}
+
+void zepass_decoder_destroy(zepass_decoder_t* const dec)
+{
+    delete dec;
+}
+
+size_t zepass_decoder_interval_samples(zepass_decoder_t const* const dec)
+{
+    return dec->dec->get_required_input_samples();
+}
+
+zepass_sample_t* zepass_decoder_buffer(zepass_decoder_t* const dec)
+{
+    return reinterpret_cast<zepass_sample_t*>(dec->dec->get_sample_buffer());
+}
+
+int zepass_decoder_process(zepass_decoder_t* const dec, uint64_t const at)
+{
+    return guarded([&]() { dec->dec->process_data(at); });
+}
+
+int zepass_decoder_submit(zepass_decoder_t* const dec, zepass_sample_t const* const samples, size_t const nr_samples,
+                          uint64_t const at)
+{
+    return guarded([&]() {
+        if (nr_samples != dec->dec->get_required_input_samples()) {
+            throw std::invalid_argument("Intervals must be exactly zepass_decoder_interval_samples() long");
+        }
+
+        std::copy(samples, samples + nr_samples, zepass_decoder_buffer(dec));
+        dec->dec->process_data(at);
+    });
+}
+
+int zepass_decoder_submit_cf32(zepass_decoder_t* const dec, float const* const iq, size_t const nr_samples,
+                               uint64_t const at)
+{
+    return guarded([&]() {
+        if (nr_samples != dec->dec->get_required_input_samples()) {
+            throw std::invalid_argument("Intervals must be exactly zepass_decoder_interval_samples() long");
+        }
+
+        z::sample_t* const buf = dec->dec->get_sample_buffer();
+        for (size_t i = 0; i < nr_samples; i++) {
+            buf[i] = z::sample_t(iq[2 * i], iq[2 * i + 1]);
+        }
+
+        dec->dec->process_data(at);
+    });
+}
+
+int zepass_decoder_set_watchlist(zepass_decoder_t* const dec, char const* const filename)
+{
+    return guarded([&]() {
+        dec->dec->set_watchlist(nullptr == filename ? z::watchlist::ptr_t() :
+                std::make_shared<z::watchlist const>(filename));
+    });
+}
+
+void zepass_decoder_set_read_handler(zepass_decoder_t* const dec, zepass_read_handler_t const handler,
+                                     void* const ctx)
+{
+    dec->handler = handler;
+    dec->handler_ctx = ctx;
+}
+
+void zepass_set_log_handler(zepass_log_handler_t const handler, void* const ctx)
+{
+    if (nullptr == handler) {
+        z::set_log_handler(z::log_handler_t());
+        return;
+    }
+
+    z::set_log_handler([handler, ctx](char const* line) { handler(ctx, line); });
+}
+
+char const* zepass_last_error(void)
+{
+    return last_error.c_str();
+}
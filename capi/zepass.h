@@ -0,0 +1,174 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+#pragma once
+
+/*
+ * C interface to the ZEPASSD decoder, for running it inside another program.
+ *
+ * A decoder is fed one capture interval at a time, each the response to one
+ * activation pulse, and calls back with every tag it decodes. Either write each
+ * interval into the decoder's own buffer and process it, or submit a buffer of
+ * your own. All calls on one decoder must come from one thread at a time; the
+ * read handler is called on that thread. Separate decoders are independent.
+ *
+ * The library never writes to stdout or stderr. Install a log handler to see
+ * what the decoder is doing.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(ZEPASS_BUILDING_LIBRARY)
+#define ZEPASS_API __attribute__((visibility("default")))
+#else
+#define ZEPASS_API
+#endif
+
+/* Version of this interface. Incremented when anything is added. */
+#define ZEPASS_API_VERSION 2
+
+/* A complex sample, laid out like std::complex<double> and double _Complex */
+typedef struct zepass_sample {
+    double re;
+    double im;
+} zepass_sample_t;
+
+/* A decoded read. The layout matches the records in the output file and the shared memory ring. */
+typedef struct zepass_read {
+    uint64_t last_seen_at; /* Time of the last interval the tag was seen in, as passed in, in microseconds */
+    uint64_t decoded_at; /* Time of the interval the tag was decoded in, as passed in, in microseconds */
+    double center_freq_delta; /* Offset of the transponder from the center frequency, in Hz */
+    uint32_t serial_num; /* Tag serial number */
+    uint32_t nr_samples; /* Number of intervals integrated to decode the tag */
+    uint16_t agency_id; /* Issuing agency */
+    uint8_t header; /* Tag header field */
+    uint8_t tag_type; /* Tag type field */
+    uint8_t app_id; /* Application ID field */
+    uint8_t group_id; /* Group ID field */
+    uint16_t flags; /* ZEPASS_READ_* bits */
+} zepass_read_t;
+
+/* zepass_read_t::flags: some bits of the frame were recovered by error correction */
+#define ZEPASS_READ_CORRECTED 0x1
+
+/*
+ * zepass_read_t::flags: bits 8 to 15 are the watchlists the tag is on, bit 8
+ * for list 0. See zepass_decoder_set_watchlist().
+ */
+#define ZEPASS_READ_WATCHLIST_SHIFT 8
+#define ZEPASS_READ_WATCHLIST_MASK 0xff00
+
+/*
+ * Decoder settings. Fill in the defaults with zepass_config_init(), then change
+ * what you need. The defaults match zepassd's, except for decode_budget: zepassd
+ * allows half the pulse spacing, which the library doesn't know, so there is no
+ * limit. New fields are only ever added at the end, and size says how many of
+ * them the caller knows about.
+ */
+typedef struct zepass_config {
+    size_t size; /* sizeof(zepass_config_t), set by zepass_config_init() */
+    uint64_t center_freq; /* Center frequency, in Hz */
+    uint32_t sample_rate; /* Samples per second, a multiple of 500000, at least 2000000 */
+    uint32_t interval_len; /* Length of each capture interval, in microseconds */
+    uint32_t fft_len; /* FFT length, a power of 2 covering the interval, or 0 to choose */
+    uint32_t max_passes; /* Most passes tracked at once */
+    uint64_t max_age; /* How long a pass may go unseen, in microseconds */
+    double drift_tolerance; /* Furthest a pass may drift between intervals, in Hz */
+    double threshold; /* Fixed peak detection threshold (FFT magnitude), if CFAR is off */
+    double cfar_pfa; /* CFAR false alarm rate per bin, or 0 to use the fixed threshold */
+    uint32_t cfar_window; /* Number of FFTs the CFAR noise floor is averaged over */
+    uint32_t candidate_intervals; /* Intervals to vet a new peak for, or 0 to not vet. Off by default:
+                                     vetting turns away some weak tags */
+    double candidate_threshold; /* Minimum envelope modulation index to promote a candidate */
+    int peak_combining; /* Nonzero to normalize each interval to its FFT peak, rather than maximal ratio combining */
+    double decode_snr; /* SNR, in dB, at which to start decoding a pass before 16 intervals */
+    uint32_t chase_bits; /* Least reliable bits error correction may flip (at most 24), or 0 to disable.
+                            Off by default: the CRC-16 is all that checks a corrected frame, so
+                            turning it on risks reading a wrong tag ID */
+    uint32_t chase_flips; /* Most bits error correction flips at once */
+    double align_shift; /* Furthest to move an interval to line it up with its pass, in microseconds, or 0 */
+    double energy_gate; /* Skip idle intervals within this many dB of the idle floor, or 0 to disable */
+    uint32_t energy_gate_refresh; /* Process an idle interval anyway after skipping this many */
+    double decode_budget; /* Time allowed to process each interval, in microseconds, or 0 for no limit.
+                             Added in version 2 */
+} zepass_config_t;
+
+typedef struct zepass_decoder zepass_decoder_t;
+
+/* Called with each tag as soon as it is decoded */
+typedef void (*zepass_read_handler_t)(void* ctx, zepass_read_t const* read);
+
+/* Called with each line the decoder logs, without its newline */
+typedef void (*zepass_log_handler_t)(void* ctx, char const* line);
+
+/* Fill in the default settings */
+ZEPASS_API void zepass_config_init(zepass_config_t* cfg);
+
+/* Create a decoder. Returns NULL on failure; see zepass_last_error(). */
+ZEPASS_API zepass_decoder_t* zepass_decoder_create(zepass_config_t const* cfg);
+
+/* Destroy a decoder. Passes that haven't been decoded are thrown away. */
+ZEPASS_API void zepass_decoder_destroy(zepass_decoder_t* dec);
+
+/* Return the number of samples in each interval */
+ZEPASS_API size_t zepass_decoder_interval_samples(zepass_decoder_t const* dec);
+
+/* Return the buffer the next interval is written into, zepass_decoder_interval_samples() long */
+ZEPASS_API zepass_sample_t* zepass_decoder_buffer(zepass_decoder_t* dec);
+
+/*
+ * Process the interval in the decoder's buffer, captured at the given time, in
+ * microseconds. Times only need to increase; they are passed back in reads.
+ * Returns 0, or -1 on failure; see zepass_last_error().
+ */
+ZEPASS_API int zepass_decoder_process(zepass_decoder_t* dec, uint64_t at);
+
+/* Process an interval from a buffer of nr_samples samples, which must be zepass_decoder_interval_samples() */
+ZEPASS_API int zepass_decoder_submit(zepass_decoder_t* dec, zepass_sample_t const* samples, size_t nr_samples,
+                                     uint64_t at);
+
+/* As zepass_decoder_submit(), from interleaved single precision I and Q, as most radios deliver them */
+ZEPASS_API int zepass_decoder_submit_cf32(zepass_decoder_t* dec, float const* iq, size_t nr_samples, uint64_t at);
+
+/*
+ * Check decoded tags against a watchlist index built by zepass-watchlist, and
+ * flag the lists each is on in its read. Pass NULL to stop checking. Returns 0,
+ * or -1 if the index can't be loaded; see zepass_last_error(). Added in version 2.
+ */
+ZEPASS_API int zepass_decoder_set_watchlist(zepass_decoder_t* dec, char const* filename);
+
+/* Set the function called with each decoded tag, or NULL for none */
+ZEPASS_API void zepass_decoder_set_read_handler(zepass_decoder_t* dec, zepass_read_handler_t handler, void* ctx);
+
+/*
+ * Set the function called with each line any decoder logs, or NULL to log
+ * nothing (the default). It may be called from every thread running a decoder.
+ */
+ZEPASS_API void zepass_set_log_handler(zepass_log_handler_t handler, void* ctx);
+
+/* Return a description of the last failure on the calling thread */
+ZEPASS_API char const* zepass_last_error(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
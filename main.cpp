@@ -17,41 +17,166 @@
 // along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
 //
 
+#include <zepass/arena.hh>
 #include <zepass/decoder.hh>
+#include <zepass/log.hh>
+#include <zepass/pass.hh>
 #include <zepass/priv.hh>
+#include <zepass/profiler.hh>
+#include <zepass/record.hh>
+#include <zepass/serializer.hh>
+#include <zepass/watchlist.hh>
 
 #include <usrp/usrp.hh>
 
+#include <replay/batch.hh>
+#include <replay/replay.hh>
+
+#include <scan/scan.hh>
+
+#include <shm/publisher.hh>
+
+#include <rt/rt.hh>
+
 #include <boost/program_options.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <complex>
 #include <chrono>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
 #include <thread>
+#include <vector>
 
+#include <cerrno>
 #include <csignal>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace po = boost::program_options;
 namespace z = zepass;
 
 static volatile bool running = true;
+static volatile bool reload_requested = false;
 
 void handle_sigint(int)
 {
     running = false;
 }
 
+void handle_sighup(int)
+{
+    reload_requested = true;
+}
+
+/// Parse the name of a combining mode.
+static
+z::combining parse_combining(std::string const& mode)
+{
+    if (mode == "mrc") {
+        return z::combining::maximal_ratio;
+    } else if (mode == "peak") {
+        return z::combining::peak_normalized;
+    }
+
+    throw std::invalid_argument("unknown combining mode " + mode);
+}
+
+/// Write the data to a file beside the given path, flush it to disk, then move it over
+/// the path, so that neither a crash nor a power failure part way through leaves a
+/// damaged file behind.
+/// \return 0 on success, or the errno of what failed
+static
+int replace_file(std::string const& path, std::string const& data)
+{
+    std::string const tmp_path = path + ".tmp";
+    int const fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (0 > fd) {
+        return errno;
+    }
+
+    for (size_t done = 0; done < data.size();) {
+        ssize_t const ret = ::write(fd, data.data() + done, data.size() - done);
+        if (0 > ret && EINTR != errno) {
+            int const err = errno;
+            ::close(fd);
+            return err;
+        }
+        done += 0 < ret ? size_t(ret) : 0;
+    }
+
+    if (0 != ::fsync(fd)) {
+        int const err = errno;
+        ::close(fd);
+        return err;
+    }
+
+    if (0 != ::close(fd) || 0 != std::rename(tmp_path.c_str(), path.c_str())) {
+        return errno;
+    }
+
+    // Make the rename itself durable
+    std::string::size_type const slash = path.rfind('/');
+    std::string const dir = std::string::npos == slash ? "." : 0 == slash ? "/" : path.substr(0, slash);
+    int const dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (0 <= dir_fd) {
+        ::fsync(dir_fd);
+        ::close(dir_fd);
+    }
+
+    return 0;
+}
+
+/// Take a setting from a freshly loaded configuration, if it is given there and
+/// differs from the value in use.
+/// \return true if current was changed
+template <typename T>
+static
+bool take_setting(po::variables_map const& fresh, char const* const name, T& current)
+{
+    if (!fresh.count(name) || fresh[name].defaulted()) {
+        return false;
+    }
+
+    T const value = fresh[name].as<T>();
+    if (value == current) {
+        return false;
+    }
+
+    current = value;
+    return true;
+}
+
+/// Warn if a configuration reload changes a setting that only takes effect on restart.
+template <typename T>
+static
+void check_restart_setting(po::variables_map const& fresh, po::variables_map const& startup, char const* const name)
+{
+    if (!fresh.count(name) || fresh[name].defaulted()) {
+        return;
+    }
+
+    if (!startup.count(name) || fresh[name].as<T>() != startup[name].as<T>()) {
+        std::cerr << "Changing " << name << " requires a restart, ignoring it." << std::endl;
+    }
+}
+
 int main(int const argc, char const* const argv[])
 {
     po::options_description desc("Options"),
                             hidden("Hidden");
 
-    size_t sample_rate = 3000000ull;
     size_t interval_len = 580;
 
     std::cerr << "ZEPASSD: The E-Z Pass Reader Daemon" << std::endl;
@@ -60,18 +185,63 @@ int main(int const argc, char const* const argv[])
 
     desc.add_options()
         ("help,h", "Get some help (this screen)")
+        ("config", po::value<std::string>(), "Read settings from this file; it is re-read on SIGHUP")
         ("device,d", po::value<std::string>()->default_value(""), "USRP device ID to use")
         ("center,c", po::value<std::uint64_t>()->default_value(915750000), "Center frequency")
+        ("scan-center", po::value<std::vector<std::uint64_t>>(), "Also scan this center frequency, retuning between pulses; repeat for more")
+        ("scan-dwell", po::value<size_t>()->default_value(4), "Fewest intervals to spend on each scanned center frequency per visit")
+        ("scan-max-dwell", po::value<size_t>()->default_value(40), "Most intervals to spend on a busy scanned center frequency per visit")
+        ("sample-rate,s", po::value<size_t>()->default_value(3000000), "Sample rate, in samples per second, a multiple of 500000")
+        ("fft-len", po::value<size_t>()->default_value(0), "FFT length, a power of 2 covering the interval, 0 to choose automatically")
         ("tx-gain,T", po::value<double>()->default_value(75.0), "Transmit gain")
         ("tx-port,t", po::value<std::string>()->default_value("A:A"), "Transmit port on USRP")
         ("tx-ant,A", po::value<std::string>()->default_value("TX/RX"), "Transmit antenna on specified USRP TX port")
         ("rx-gain,R", po::value<double>()->default_value(75.0), "Receive gain")
         ("rx-port,r", po::value<std::string>()->default_value("A:A"), "Receive port on USRP")
         ("rx-ant,a", po::value<std::string>()->default_value("RX2"), "Receive antenna on the specified USRP RX port")
+        ("rx-channels", po::value<size_t>()->default_value(1), "Number of phase-coherent receive channels to combine, one for each subdevice in the RX port (e.g. \"A:A A:B\")")
         ("pulse-len,P", po::value<std::uint64_t>()->default_value(20), "Length of activation pulse, in microseconds")
         ("gps-pps", "Use the GPS PPS source and synchronize local time")
         ("pulse-spacing,p", po::value<std::uint64_t>()->default_value(25), "Pulse interval, in milliseconds")
         ("max-age,m", po::value<std::uint64_t>()->default_value(30), "Maximum stale pass age, in seconds")
+        ("drift-tolerance", po::value<double>()->default_value(1500.0), "Maximum drift of a pass between intervals, in Hz")
+        ("threshold", po::value<double>()->default_value(500.0), "Fixed peak detection threshold (FFT magnitude)")
+        ("cfar-pfa", po::value<double>()->default_value(0.0), "CFAR false alarm rate per bin, 0 to use the fixed threshold")
+        ("cfar-window", po::value<size_t>()->default_value(32), "Number of FFTs to average the CFAR noise floor over")
+        ("candidate-intervals", po::value<size_t>()->default_value(0), "Intervals to vet a new peak for before decoding it, 0 to disable. Can miss weak tags; see the README")
+        ("candidate-threshold", po::value<double>()->default_value(0.33, "0.33"), "Minimum envelope modulation index to promote a candidate peak")
+        ("combining", po::value<std::string>()->default_value("mrc"), "How intervals are combined: mrc (maximal ratio) or peak (normalized to the FFT peak)")
+        ("decode-snr", po::value<double>()->default_value(1.0), "Estimated SNR, in dB, at which to start decoding a pass before 16 intervals")
+        ("chase-bits", po::value<size_t>()->default_value(0), "Least reliable bits to try flipping when a frame fails its CRC (at most 24), 0 to disable. Risks accepting a wrong tag ID; see the README")
+        ("chase-flips", po::value<size_t>()->default_value(3), "Most bits to flip at once when a frame fails its CRC")
+        ("align-shift", po::value<double>()->default_value(2.0), "Furthest to move an interval to line it up with its pass, in microseconds, 0 to disable")
+        ("energy-gate", po::value<double>()->default_value(0.0), "Skip idle intervals whose power is within this many dB of the idle noise floor, 0 to disable")
+        ("energy-gate-refresh", po::value<size_t>()->default_value(40), "Process an idle interval anyway after skipping this many in a row")
+        ("decode-budget", po::value<double>()->default_value(50.0), "Share of the pulse spacing, in percent, an interval may take to process before work is shed, 0 for no limit")
+        ("replay", po::value<std::string>(), "Decode a recording of raw fc32 intervals instead of using a radio")
+        ("replay-start", po::value<double>()->default_value(0.0, "0"), "Time the first replayed or batch interval was captured at, in seconds since the epoch; 0 to count read times from the start of the recording")
+        ("fft-batch", po::value<size_t>()->default_value(8), "Number of intervals to transform at once when replaying")
+        ("batch", po::value<std::vector<std::string>>(), "Decode this fc32 recording offline, on every core, instead of using a radio; repeat for more recordings, in time order")
+        ("batch-workers", po::value<size_t>()->default_value(0), "Number of threads decoding batch segments, 0 for one per CPU")
+        ("batch-segment", po::value<std::uint64_t>()->default_value(300), "Length of each batch segment, in seconds of capture")
+        ("batch-overlap", po::value<std::uint64_t>()->default_value(10), "Capture decoded before each batch segment to settle detection, in seconds")
+        ("rt-cpu", po::value<int>()->default_value(-1), "Pin the capture and decode thread to this CPU")
+        ("rt-priority", po::value<int>()->default_value(0), "Run the capture and decode thread at this SCHED_FIFO priority")
+        ("rt-io-cpus", po::value<std::string>()->default_value(""), "Run the checkpoint, watchlist and batch threads on these CPUs (such as 2,4-7), under SCHED_OTHER. By default, every CPU but --rt-cpu")
+        ("mlock", "Lock all memory into RAM at startup")
+        ("hugepage-arena", po::value<size_t>()->default_value(0), "Size, in MiB, of a huge page arena for the sample, FFT and pass buffers")
+        ("max-passes", po::value<size_t>()->default_value(64), "Maximum number of passes tracked at once")
+        ("checkpoint", po::value<std::string>(), "Save the passes being tracked to this file periodically and at shutdown, and pick them up from it at startup")
+        ("checkpoint-every", po::value<std::uint64_t>()->default_value(10), "How often to save the checkpoint, in seconds, 0 for only at shutdown")
+        ("output-format", po::value<std::string>()->default_value("json"), "Output file format: json (one object per line) or binary (length-prefixed records)")
+        ("shm-ring", po::value<std::string>(), "Also publish reads to a shared memory ring with this name")
+        ("shm-slots", po::value<size_t>()->default_value(1024), "Number of reads the shared memory ring holds (power of 2)")
+        ("watchlist", po::value<std::string>(), "Flag decoded tags found in this watchlist index (see zepass-watchlist); it is reloaded on SIGHUP")
+        ("spectrum-file", po::value<std::string>(), "Append a survey of the spectrum to this CSV file periodically")
+        ("spectrum-bins", po::value<size_t>()->default_value(256), "Number of bins in the spectrum survey (power of 2)")
+        ("spectrum-every", po::value<std::uint64_t>()->default_value(60), "Spectrum survey period, in seconds")
+        ("profile", po::value<std::string>(), "Count cycles, instructions, cache and branch misses in each decoder stage, and write them to this CSV file at shutdown")
+        ("profile-every", po::value<size_t>()->default_value(1000), "Number of intervals totalled in each line of the profile")
         ;
 
     hidden.add_options()
@@ -88,6 +258,16 @@ int main(int const argc, char const* const argv[])
             .options(all_desc)
             .positional(popt)
             .run(), args);
+
+    // Settings given on the command line take precedence over the config file, both
+    // at startup and on reload
+    po::variables_map const cmdline = args;
+    std::string config_file;
+    if (args.count("config")) {
+        config_file = args["config"].as<std::string>();
+        po::store(po::parse_config_file<char>(config_file.c_str(), desc), args);
+    }
+
     po::notify(args);
 
     if (args.count("help")) {
@@ -102,8 +282,14 @@ int main(int const argc, char const* const argv[])
     }
 
     std::string output_file = args["output-file"].as<std::string>();
+    std::string output_format = args["output-format"].as<std::string>();
 
     z::freq_t center_freq = args["center"].as<std::uint64_t>();
+    size_t sample_rate = args["sample-rate"].as<size_t>();
+    size_t fft_len = args["fft-len"].as<size_t>();
+    std::vector<z::freq_t> centers(1, center_freq);
+    size_t scan_dwell = args["scan-dwell"].as<size_t>();
+    size_t scan_max_dwell = args["scan-max-dwell"].as<size_t>();
 
     // Get USRP parameters
     std::string device = args["device"].as<std::string>();
@@ -111,50 +297,867 @@ int main(int const argc, char const* const argv[])
     std::string rx_port = args["rx-port"].as<std::string>();
     std::string tx_ant = args["tx-ant"].as<std::string>();
     std::string rx_ant = args["rx-ant"].as<std::string>();
+    size_t rx_channels = args["rx-channels"].as<size_t>();
     double tx_gain = args["tx-gain"].as<double>();
     double rx_gain = args["rx-gain"].as<double>();
     size_t activation_len = args["pulse-len"].as<size_t>();
     size_t spacing = args["pulse-spacing"].as<size_t>() * 1000;
     bool gps_pps = !!args.count("gps-pps");
     size_t max_age = args["max-age"].as<size_t>() * 1000 * 1000;
+    double drift_tolerance = args["drift-tolerance"].as<double>();
+    double threshold = args["threshold"].as<double>();
+    double cfar_pfa = args["cfar-pfa"].as<double>();
+    size_t cfar_window = args["cfar-window"].as<size_t>();
+    size_t candidate_intervals = args["candidate-intervals"].as<size_t>();
+    double candidate_threshold = args["candidate-threshold"].as<double>();
+    std::string combining_mode = args["combining"].as<std::string>();
+    double decode_snr = args["decode-snr"].as<double>();
+    size_t chase_bits = args["chase-bits"].as<size_t>();
+    size_t chase_flips = args["chase-flips"].as<size_t>();
+    double align_shift = args["align-shift"].as<double>();
+    double energy_gate = args["energy-gate"].as<double>();
+    size_t energy_gate_refresh = args["energy-gate-refresh"].as<size_t>();
+    double decode_budget = args["decode-budget"].as<double>();
+    bool replaying = !!args.count("replay");
+    bool batching = !!args.count("batch");
+    double replay_start = args["replay-start"].as<double>();
+    size_t fft_batch = replaying || batching ? args["fft-batch"].as<size_t>() : 1;
+    size_t batch_workers = args["batch-workers"].as<size_t>();
+    std::uint64_t batch_segment = args["batch-segment"].as<std::uint64_t>();
+    std::uint64_t batch_overlap = args["batch-overlap"].as<std::uint64_t>();
+    int rt_cpu = args["rt-cpu"].as<int>();
+    int rt_priority = args["rt-priority"].as<int>();
+    std::string const rt_io_cpus = args["rt-io-cpus"].as<std::string>();
+    bool mlock = !!args.count("mlock");
+    size_t arena_size = args["hugepage-arena"].as<size_t>() * 1024 * 1024;
+    size_t max_passes = args["max-passes"].as<size_t>();
+    size_t shm_slots = args["shm-slots"].as<size_t>();
+    size_t spectrum_bins = args["spectrum-bins"].as<size_t>();
+    std::uint64_t spectrum_every = args["spectrum-every"].as<std::uint64_t>();
+    std::string watchlist_file = args.count("watchlist") ? args["watchlist"].as<std::string>() : "";
+    std::string checkpoint_file = args.count("checkpoint") ? args["checkpoint"].as<std::string>() : "";
+    std::uint64_t checkpoint_every = args["checkpoint-every"].as<std::uint64_t>() * 1000000;
+    std::string profile_file = args.count("profile") ? args["profile"].as<std::string>() : "";
+    size_t profile_every = args["profile-every"].as<size_t>();
+    size_t rt_failures = 0;
+
+    if (combining_mode != "mrc" && combining_mode != "peak") {
+        std::cerr << "Unknown combining mode " << combining_mode << ", aborting." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (output_format != "json" && output_format != "binary") {
+        std::cerr << "Unknown output format " << output_format << ", aborting." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (0.0 > align_shift) {
+        std::cerr << "Alignment shift " << align_shift << " can't be negative, aborting." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (args.count("scan-center")) {
+        for (auto freq : args["scan-center"].as<std::vector<std::uint64_t>>()) {
+            if (centers.end() != std::find(centers.begin(), centers.end(), z::freq_t(freq))) {
+                std::cerr << "Center frequency " << freq << " is scanned more than once, aborting." << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+            centers.push_back(freq);
+        }
+    }
+
+    bool const scanning = centers.size() > 1;
+
+    if (scanning && (replaying || batching)) {
+        std::cerr << "Scanning needs a radio, it can't be combined with --replay or --batch, aborting." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (0 == rx_channels) {
+        std::cerr << "Need at least one receive channel, aborting." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (1 < rx_channels && (replaying || batching)) {
+        std::cerr << "Combining receive channels needs a radio, it can't be combined with --replay or --batch, " <<
+            "aborting." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (!checkpoint_file.empty() && (replaying || batching)) {
+        std::cerr << "The pass checkpoint needs a radio, it can't be combined with --replay or --batch, aborting." <<
+            std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (!profile_file.empty() && batching) {
+        std::cerr << "The profiler counts a single thread, it can't be combined with --batch, aborting." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (!profile_file.empty() && 0 == profile_every) {
+        std::cerr << "Each line of the profile must total at least one interval, aborting." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (0 == scan_dwell || scan_max_dwell < scan_dwell) {
+        std::cerr << "Scan dwell must be at least one interval, and no more than the maximum dwell, aborting." <<
+            std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (0.0 > decode_budget || 100.0 < decode_budget) {
+        std::cerr << "Decode budget " << decode_budget << " must be between 0 and 100 percent, aborting." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (replaying && batching) {
+        std::cerr << "Pick one of --replay or --batch, aborting." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (0.0 > replay_start) {
+        std::cerr << "Replay start " << replay_start << " can't be before the epoch, aborting." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
 
-    auto out_file = std::make_shared<std::ofstream>(output_file, std::ofstream::app);
+    if (batching && args.count("spectrum-file")) {
+        std::cerr << "The spectrum survey can't be taken from a batch decode, aborting." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (batching && (0 == batch_segment || 0 == spacing || batch_segment * 1000000 < spacing)) {
+        std::cerr << "Batch segments must hold at least one interval, aborting." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (sample_rate < 2000000 || 0 != sample_rate % 500000) {
+        std::cerr << "Sample rate " << sample_rate << " must be a multiple of 500000, and at least 2000000, aborting." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (0 != fft_len && (fft_len < size_t(double(sample_rate) * z::priv::us_to_sec(interval_len)) || 0 != (fft_len & (fft_len - 1)))) {
+        std::cerr << "FFT length " << fft_len << " must be a power of 2 at least as long as an interval, aborting." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (mlock && !rt::lock_memory()) {
+        rt_failures++;
+    }
+
+    bool const binary_output = output_format == "binary";
+    auto out_file = std::make_shared<std::ofstream>(output_file,
+            binary_output ? std::ofstream::app | std::ofstream::binary : std::ofstream::app);
 
     if (!out_file->is_open()) {
         std::cerr << "Failed to open output file " << output_file << ", aborting." << std::endl;
         std::exit(EXIT_FAILURE);
     }
 
-    std::cout << "Writing to output file [" << output_file << "]" << std::endl;
+    // The decoder doesn't log anywhere unless it's told to
+    z::set_log_handler([](char const* line) { std::cout << line << std::endl; });
+
+    std::cout << "Writing " << output_format << " to output file [" << output_file << "]" << std::endl;
     std::cout << "Activation pulse length: " << activation_len << " microseconds. Spacing: " << spacing << " microseconds"
         << std::endl;
     std::cout << "Maximum pass age: " << max_age << " microseconds." << std::endl;
-    std::cout << "Center frequency: " << std::fixed << double(center_freq)/1e6 << "MHz" << std::endl;
+    std::cout << "Drift tolerance: " << std::fixed << drift_tolerance << "Hz" << std::endl;
+    if (0.0 < cfar_pfa) {
+        std::cout << "Peak detection: CFAR, Pfa=" << std::scientific << cfar_pfa << std::fixed <<
+            " over " << cfar_window << " intervals" << std::endl;
+    } else {
+        std::cout << "Peak detection: fixed threshold " << std::fixed << threshold << std::endl;
+    }
+    if (0 != candidate_intervals) {
+        std::cout << "Vetting new peaks over " << candidate_intervals << " intervals, modulation index threshold " <<
+            std::fixed << candidate_threshold << std::endl;
+    }
+    std::cout << "Combining: " << combining_mode << ", decoding from " << std::fixed << decode_snr <<
+        "dB SNR" << std::endl;
+    if (0 != chase_bits) {
+        std::cout << "Error correction: up to " << chase_flips << " of the " << chase_bits <<
+            " least reliable bits" << std::endl;
+    }
+    if (0.0 != align_shift) {
+        std::cout << "Aligning intervals to their pass, moving them up to " << std::fixed << align_shift <<
+            "us" << std::endl;
+    }
+    if (0.0 != energy_gate) {
+        std::cout << "Skipping idle intervals within " << std::fixed << energy_gate << "dB of the noise floor, " <<
+            "processing one in every " << energy_gate_refresh + 1 << " anyway" << std::endl;
+    }
+    for (auto freq : centers) {
+        std::cout << "Center frequency: " << std::fixed << double(freq)/1e6 << "MHz, covering " <<
+            double(freq - sample_rate/2)/1e6 << " to " << double(freq + sample_rate/2)/1e6 <<
+            "MHz" << std::endl;
+    }
+    if (scanning) {
+        std::cout << "Scanning " << centers.size() << " center frequencies, " << scan_dwell << " to " <<
+            scan_max_dwell << " intervals at a time" << std::endl;
+    }
     std::cout << "RX Port: " << rx_port << " antenna: " << rx_ant << " gain: " << std::fixed << rx_gain << "dB" << std::endl;
+    if (1 < rx_channels) {
+        std::cout << "Combining " << rx_channels << " receive channels into each pass" << std::endl;
+    }
     std::cout << "TX Port: " << tx_port << " antenna: " << tx_ant << " gain: " << std::fixed << tx_gain << "dB" << std::endl;
 
-    std::unique_ptr<z::decoder> decoder = std::make_unique<z::decoder>(center_freq,
-            sample_rate, interval_len, max_age, out_file);
-    std::unique_ptr<usrp::usrp_controller> radio = std::make_unique<usrp::usrp_controller>(device,
-            center_freq, tx_port, rx_port, tx_ant, rx_ant, sample_rate, sample_rate,
-            tx_gain, rx_gain, interval_len, activation_len, gps_pps);
-    z::sample_t* in_buf = decoder->get_sample_buffer();
+    z::arena::ptr_t arena;
+    if (0 != arena_size) {
+        arena = std::make_shared<z::arena>(arena_size, true);
+        std::cout << "Arena of " << arena->get_size()/(1024 * 1024) << "MiB is " <<
+            (arena->is_huge() ? "backed by huge pages" : "NOT backed by huge pages") << std::endl;
+        if (!arena->is_huge()) {
+            rt_failures++;
+        }
+    }
 
-    std::cout << "Letting the radio settle..." << std::endl;
+    // Every center frequency has a decoder of its own, so its passes carry on from one
+    // visit of the scan to the next
+    std::vector<std::unique_ptr<z::decoder>> decoders;
+    for (auto freq : centers) {
+        decoders.push_back(std::make_unique<z::decoder>(freq,
+                sample_rate, interval_len, max_age, fft_batch, arena, max_passes, fft_len, rx_channels));
+    }
+    z::decoder* const decoder = decoders.front().get();
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    std::signal(SIGINT, &handle_sigint);
+    if (nullptr != arena) {
+        std::cout << "Using " << arena->get_used()/1024 << "KiB of the arena" << std::endl;
+    }
+
+    // The counters follow this thread, which decodes everything when replaying or using a radio
+    z::profiler::ptr_t profiler;
+    std::ofstream profile_out;
+    if (!profile_file.empty()) {
+        profile_out.open(profile_file, std::ofstream::trunc);
+        if (!profile_out.is_open()) {
+            std::cerr << "Failed to open profile file " << profile_file << ", aborting." << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
 
-    std::cout << "Starting the trigger loop." << std::endl;
+        try {
+            profiler = std::make_shared<z::profiler>(profile_every);
+        } catch (std::exception const& e) {
+            std::cerr << "Failed to start the profiler: " << e.what() << " (see kernel.perf_event_paranoid), " <<
+                "aborting." << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+
+        std::cout << "Profiling the decoder every " << profile_every << " intervals to [" << profile_file << "]" <<
+            std::endl;
+        if (!profiler->has_hardware_counters()) {
+            std::cerr << "No hardware performance counters, the profile only has CPU time." << std::endl;
+        }
+
+        for (auto& d : decoders) {
+            d->set_profiler(profiler);
+        }
+    }
+
+    shm::ring_publisher::ptr_t ring;
+    if (args.count("shm-ring")) {
+        std::string ring_name = args["shm-ring"].as<std::string>();
+        ring = std::make_shared<shm::ring_publisher>(ring_name, shm_slots);
+        std::cout << "Publishing reads to shared memory ring [" << ring_name << "] of " << shm_slots <<
+            " slots" << std::endl;
+    }
+
+    // Every read goes to the output file, and to the ring if there is one
+    auto serializer = std::make_shared<z::record_serializer>();
+    auto publish = [out_file, serializer, binary_output, ring](z::read_record const& rec) {
+        char buf[z::record_serializer::max_json_len + 1];
+        size_t len;
+
+        if (binary_output) {
+            len = serializer->write_binary(rec, buf, sizeof(buf));
+        } else {
+            len = serializer->write_json(rec, buf, sizeof(buf));
+            buf[len++] = '\n';
+        }
+
+        out_file->write(buf, len);
+        out_file->flush();
+
+        if (nullptr != ring) {
+            ring->publish(rec);
+        }
+    };
+
+    for (auto& d : decoders) {
+        d->add_read_handler([publish](z::pass const& p) {
+                z::read_record rec;
+                p.fill_record(rec);
+                publish(rec);
+            });
+    }
+
+    if (args.count("spectrum-file")) {
+        std::string spectrum_file = args["spectrum-file"].as<std::string>();
+        auto spectrum_out = std::make_shared<std::ofstream>(spectrum_file, std::ofstream::app);
+
+        if (!spectrum_out->is_open()) {
+            std::cerr << "Failed to open spectrum file " << spectrum_file << ", aborting." << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+
+        if (0 == spectrum_every || spectrum_bins < 2 || spectrum_bins > decoder->get_fft_len() ||
+                0 != (spectrum_bins & (spectrum_bins - 1)))
+        {
+            std::cerr << "Spectrum survey needs a period, and a power of 2 bins no more than the FFT length (" <<
+                decoder->get_fft_len() << "), aborting." << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+
+        std::cout << "Writing a " << spectrum_bins << " bin spectrum survey every " << spectrum_every <<
+            " seconds to [" << spectrum_file << "]" << std::endl;
+
+        for (auto& d : decoders) {
+            d->set_spectrum_report(spectrum_bins, spectrum_every * 1000000ull,
+                [spectrum_out](z::spectrum_monitor const& s) {
+                    (*spectrum_out) << s << std::flush;
+                });
+        }
+    }
+
+    z::watchlist::ptr_t watchlist;
+    if (!watchlist_file.empty()) {
+        try {
+            watchlist = std::make_shared<z::watchlist const>(watchlist_file);
+            std::cout << "Checking reads against " << watchlist->get_nr_keys() << " tags on " <<
+                watchlist->get_nr_lists() << " watchlist(s) from [" << watchlist_file << "]" << std::endl;
+        } catch (std::exception const& e) {
+            std::cerr << "Failed to load watchlist " << watchlist_file << ": " << e.what() << ", aborting." << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    // Apply the detection and decoding settings to a decoder. Batch decoding makes
+    // one of these for every segment.
+    auto configure_decoder = [&](z::decoder& d) {
+        d.set_drift_tolerance(drift_tolerance);
+        d.set_detection_threshold(threshold);
+        d.set_cfar(cfar_pfa, cfar_window);
+        d.set_candidate_validation(candidate_intervals, candidate_threshold);
+        d.set_combining(parse_combining(combining_mode), decode_snr);
+        d.set_error_correction(chase_bits, chase_flips);
+        d.set_alignment(align_shift);
+        d.set_energy_gate(energy_gate, energy_gate_refresh);
+        d.set_watchlist(watchlist);
+    };
+
+    for (auto& d : decoders) {
+        configure_decoder(*d);
+    }
+
+    // The budget is a share of the pulse spacing, so it only means anything with a
+    // radio; replays and batches decode everything, however long it takes
+    auto apply_budget = [&](double const budget) {
+        for (auto& d : decoders) {
+            d->set_budget(double(spacing) * budget/100.0);
+        }
+
+        if (0.0 != budget) {
+            std::cout << "Shedding work once an interval has taken " << std::fixed << double(spacing) * budget/100.0 <<
+                "us" << std::endl;
+        }
+    };
+
+    scan::scan_schedule schedule(scan_dwell, scan_max_dwell);
+    for (size_t i = 0; i < centers.size(); i++) {
+        schedule.add_channel(centers[i], decoders[i].get());
+    }
+
+    std::signal(SIGINT, &handle_sigint);
 
     z::wallclock_t wallclock = 0;
-    do {
-        wallclock = radio->arm_and_fire(in_buf, spacing);
-        decoder->process_data(wallclock);
-    } while (running);
 
-    std::cout << "Shutting down at wallclock " << double(wallclock)/1e6 << std::endl;
+    // Re-read the config file, and apply whatever can be changed in place, between
+    // intervals, without replanning the FFTs or reinitializing the radio.
+    auto reload_config = [&](usrp::usrp_controller* const radio) {
+        po::variables_map fresh;
+
+        try {
+            po::store(po::parse_config_file<char>(config_file.c_str(), desc), fresh);
+            po::notify(fresh);
+        } catch (std::exception const& e) {
+            std::cerr << "Failed to reload [" << config_file << "], keeping the current settings: " <<
+                e.what() << std::endl;
+            return;
+        }
+
+        for (auto const& given : cmdline) {
+            if (!given.second.defaulted()) {
+                fresh.erase(given.first);
+            }
+        }
+
+        std::cout << "Reloading settings from [" << config_file << "]" << std::endl;
+
+        for (auto name: { "device", "tx-port", "tx-ant", "rx-port", "rx-ant", "shm-ring", "spectrum-file", "output-format",
+                "checkpoint", "profile", "rt-io-cpus" }) {
+            check_restart_setting<std::string>(fresh, args, name);
+        }
+
+        for (auto name: { "sample-rate", "fft-len", "fft-batch", "hugepage-arena", "max-passes", "shm-slots", "spectrum-bins",
+                "profile-every", "rx-channels" }) {
+            check_restart_setting<size_t>(fresh, args, name);
+        }
+
+        check_restart_setting<std::uint64_t>(fresh, args, "center");
+        check_restart_setting<std::vector<std::uint64_t>>(fresh, args, "scan-center");
+        check_restart_setting<std::uint64_t>(fresh, args, "spectrum-every");
+
+        try {
+            if (nullptr != radio) {
+                double gain = tx_gain;
+                if (take_setting(fresh, "tx-gain", gain)) {
+                    radio->set_tx_gain(gain);
+                    tx_gain = gain;
+                }
+
+                gain = rx_gain;
+                if (take_setting(fresh, "rx-gain", gain)) {
+                    radio->set_rx_gain(gain);
+                    rx_gain = gain;
+                }
+
+                size_t pulse_len = activation_len;
+                if (take_setting(fresh, "pulse-len", pulse_len)) {
+                    radio->set_activation_len(pulse_len);
+                    activation_len = pulse_len;
+                }
+            }
+
+            size_t spacing_ms = spacing/1000;
+            bool const respaced = take_setting(fresh, "pulse-spacing", spacing_ms);
+            if (respaced) {
+                spacing = spacing_ms * 1000;
+                std::cout << "Pulse spacing is now " << spacing << " microseconds" << std::endl;
+            }
+
+            double budget = decode_budget;
+            if (take_setting(fresh, "decode-budget", budget) | respaced) {
+                if (nullptr != radio) {
+                    apply_budget(budget);
+                }
+                decode_budget = budget;
+            }
+
+            size_t dwell = scan_dwell;
+            size_t max_dwell = scan_max_dwell;
+            if (take_setting(fresh, "scan-dwell", dwell) | take_setting(fresh, "scan-max-dwell", max_dwell)) {
+                schedule.set_dwell(dwell, max_dwell);
+                scan_dwell = dwell;
+                scan_max_dwell = max_dwell;
+            }
+
+            std::uint64_t checkpoint_secs = checkpoint_every/1000000;
+            if (take_setting(fresh, "checkpoint-every", checkpoint_secs)) {
+                checkpoint_every = checkpoint_secs * 1000000;
+            }
+
+            size_t max_age_sec = max_age/(1000 * 1000);
+            if (take_setting(fresh, "max-age", max_age_sec)) {
+                max_age = max_age_sec * 1000 * 1000;
+                for (auto& d : decoders) {
+                    d->set_max_age(max_age);
+                }
+                std::cout << "Maximum pass age is now " << max_age << " microseconds" << std::endl;
+            }
+
+            double tolerance = drift_tolerance;
+            if (take_setting(fresh, "drift-tolerance", tolerance)) {
+                for (auto& d : decoders) {
+                    d->set_drift_tolerance(tolerance);
+                }
+                drift_tolerance = tolerance;
+            }
+
+            double thresh = threshold;
+            if (take_setting(fresh, "threshold", thresh)) {
+                for (auto& d : decoders) {
+                    d->set_detection_threshold(thresh);
+                }
+                threshold = thresh;
+                std::cout << "Fixed detection threshold is now " << std::fixed << threshold << std::endl;
+            }
+
+            double pfa = cfar_pfa;
+            size_t window = cfar_window;
+            // Not short-circuited, so both settings are always taken
+            if (take_setting(fresh, "cfar-pfa", pfa) | take_setting(fresh, "cfar-window", window)) {
+                for (auto& d : decoders) {
+                    d->set_cfar(pfa, window);
+                }
+                cfar_pfa = pfa;
+                cfar_window = window;
+            }
+
+            size_t cand_intervals = candidate_intervals;
+            double cand_threshold = candidate_threshold;
+            if (take_setting(fresh, "candidate-intervals", cand_intervals) |
+                    take_setting(fresh, "candidate-threshold", cand_threshold))
+            {
+                for (auto& d : decoders) {
+                    d->set_candidate_validation(cand_intervals, cand_threshold);
+                }
+                candidate_intervals = cand_intervals;
+                candidate_threshold = cand_threshold;
+            }
+
+            std::string mode = combining_mode;
+            double snr = decode_snr;
+            if (take_setting(fresh, "combining", mode) | take_setting(fresh, "decode-snr", snr)) {
+                for (auto& d : decoders) {
+                    d->set_combining(parse_combining(mode), snr);
+                }
+                combining_mode = mode;
+                decode_snr = snr;
+                std::cout << "Combining: " << combining_mode << ", decoding from " << std::fixed <<
+                    decode_snr << "dB SNR" << std::endl;
+            }
+
+            size_t bits = chase_bits;
+            size_t flips = chase_flips;
+            if (take_setting(fresh, "chase-bits", bits) | take_setting(fresh, "chase-flips", flips)) {
+                for (auto& d : decoders) {
+                    d->set_error_correction(bits, flips);
+                }
+                chase_bits = bits;
+                chase_flips = flips;
+            }
+
+            double shift = align_shift;
+            if (take_setting(fresh, "align-shift", shift)) {
+                for (auto& d : decoders) {
+                    d->set_alignment(shift);
+                }
+                align_shift = shift;
+            }
+
+            double gate = energy_gate;
+            size_t gate_refresh = energy_gate_refresh;
+            if (take_setting(fresh, "energy-gate", gate) | take_setting(fresh, "energy-gate-refresh", gate_refresh)) {
+                for (auto& d : decoders) {
+                    d->set_energy_gate(gate, gate_refresh);
+                }
+                energy_gate = gate;
+                energy_gate_refresh = gate_refresh;
+            }
+
+            take_setting(fresh, "watchlist", watchlist_file);
+
+            int cpu = rt_cpu;
+            if (take_setting(fresh, "rt-cpu", cpu) && 0 <= cpu && rt::pin_thread(cpu)) {
+                rt_cpu = cpu;
+                rt::set_io_cpus(rt_io_cpus, rt_cpu);
+            }
+
+            int priority = rt_priority;
+            if (take_setting(fresh, "rt-priority", priority) && rt::set_fifo_priority(priority)) {
+                rt_priority = priority;
+            }
+        } catch (std::exception const& e) {
+            std::cerr << "Failed to apply a setting from [" << config_file << "]: " << e.what() << std::endl;
+        }
+    };
+
+    // Load the watchlist on the side, and swap it in once it's ready, so a big one
+    // doesn't hold up capture. Only one load runs at a time. Reloads are started from
+    // the capture loop, so the loader is kept off its CPU and priority.
+    rt::io_thread watchlist_loader;
+    std::atomic<bool> watchlist_loading(false);
+    auto reload_watchlist = [&]() {
+        if (watchlist_file.empty()) {
+            return;
+        }
+
+        if (watchlist_loading) {
+            std::cerr << "Still loading the last watchlist, ignoring the reload." << std::endl;
+            return;
+        }
+
+        if (watchlist_loader.joinable()) {
+            watchlist_loader.join();
+        }
+
+        watchlist_loading = true;
+        watchlist_loader = rt::io_thread([&watchlist_loading, &decoders, file = watchlist_file]() {
+                try {
+                    auto list = std::make_shared<z::watchlist const>(file);
+                    for (auto& d : decoders) {
+                        d->set_watchlist(list);
+                    }
+                    std::cout << "Reloaded " << list->get_nr_keys() << " watchlisted tags from [" << file << "]" <<
+                        std::endl;
+                } catch (std::exception const& e) {
+                    std::cerr << "Failed to reload watchlist " << file << ", keeping the current one: " <<
+                        e.what() << std::endl;
+                }
+                watchlist_loading = false;
+            });
+    };
+
+    auto reload = [&](usrp::usrp_controller* const radio) {
+        if (!config_file.empty()) {
+            reload_config(radio);
+        }
+        reload_watchlist();
+    };
+
+    // Only take over SIGHUP if there's a config file or a watchlist to reload
+    if (!config_file.empty() || !watchlist_file.empty()) {
+        std::signal(SIGHUP, &handle_sighup);
+    }
+
+    // Pick up the passes the last run was tracking, if it stopped recently enough
+    auto restore_checkpoint = [&]() {
+        std::ifstream in(checkpoint_file, std::ifstream::binary);
+        if (!in.is_open()) {
+            std::cout << "No checkpoint in [" << checkpoint_file << "], starting afresh" << std::endl;
+            return;
+        }
+
+        auto const now = std::chrono::system_clock::now().time_since_epoch();
+        size_t nr_restored = 0;
+
+        try {
+            for (auto& d : decoders) {
+                in.clear();
+                in.seekg(0);
+                nr_restored += d->restore_checkpoint(in,
+                        std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+            }
+        } catch (std::exception const& e) {
+            std::cerr << "Failed to restore checkpoint " << checkpoint_file << ": " << e.what() << std::endl;
+        }
+
+        std::cout << "Restored " << nr_restored << " passes from checkpoint [" << checkpoint_file << "]" << std::endl;
+    };
+
+    // The checkpoint is taken in memory on the capture thread, then written out and flushed
+    // to disk on the side, so the capture loop never waits on the disk. Only one write runs
+    // at a time; a checkpoint that comes due while the last is still being written is skipped.
+    // The writer runs off the capture CPU, without the capture thread's priority.
+    rt::io_thread checkpoint_writer;
+    std::atomic<bool> checkpoint_writing(false);
+
+    auto take_checkpoint = [&]() {
+        std::ostringstream out;
+        for (auto& d : decoders) {
+            d->save_checkpoint(out, wallclock);
+        }
+        return out.str();
+    };
+
+    auto write_checkpoint = [file = checkpoint_file](std::string const& data) {
+        int const err = replace_file(file, data);
+        if (0 != err) {
+            std::cerr << "Failed to save checkpoint " << file << ": " << std::strerror(err) << std::endl;
+        }
+        return 0 == err;
+    };
+
+    auto save_checkpoint = [&]() {
+        if (checkpoint_writing) {
+            std::cerr << "Still writing the last checkpoint, skipping this one." << std::endl;
+            return;
+        }
+
+        if (checkpoint_writer.joinable()) {
+            checkpoint_writer.join();
+        }
+
+        checkpoint_writing = true;
+        checkpoint_writer = rt::io_thread([&checkpoint_writing, write_checkpoint, data = take_checkpoint()]() {
+                write_checkpoint(data);
+                checkpoint_writing = false;
+            });
+    };
+
+    // Apply the thread settings once the radio (and any threads it starts) is up, so
+    // only the capture loop is pinned and prioritized. Threads started from the capture
+    // loop are kept off its CPU.
+    auto apply_rt_profile = [&]() {
+        if (!rt::set_io_cpus(rt_io_cpus, rt_cpu)) {
+            rt_failures++;
+        }
+
+        if (0 <= rt_cpu && !rt::pin_thread(rt_cpu)) {
+            rt_failures++;
+        }
+
+        if (0 != rt_priority && !rt::set_fifo_priority(rt_priority)) {
+            rt_failures++;
+        }
+
+        if (0 != rt_failures) {
+            std::cerr << rt_failures << " real-time setting(s) could not be applied, see above." << std::endl;
+        }
+    };
+
+    if (replaying) {
+        std::string replay_file = args["replay"].as<std::string>();
+        replay::replay_source source(replay_file, decoder->get_required_input_samples(), spacing,
+                z::wallclock_t(replay_start * 1e6));
+        std::vector<z::wallclock_t> at(fft_batch);
+        size_t nr_read = 0;
+
+        std::cout << "Replaying [" << replay_file << "] in batches of " << fft_batch << " intervals." << std::endl;
+
+        apply_rt_profile();
+
+        auto start = std::chrono::steady_clock::now();
+        while (running && 0 != (nr_read = source.read_intervals(decoder->get_sample_buffer(),
+                        decoder->get_fft_len(), &at.front(), fft_batch))) {
+            if (reload_requested) {
+                reload_requested = false;
+                reload(nullptr);
+            }
+
+            decoder->process_batch(&at.front(), nr_read);
+            wallclock = at[nr_read - 1];
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        std::cout << "Replayed " << source.get_interval_count() << " intervals in " << std::fixed <<
+            elapsed.count() << " seconds (" << double(source.get_interval_count())/elapsed.count() <<
+            " intervals/sec)" << std::endl;
+    } else if (batching) {
+        std::vector<std::string> batch_files = args["batch"].as<std::vector<std::string>>();
+        size_t const nr_workers = 0 != batch_workers ? batch_workers :
+            std::max<size_t>(1, std::thread::hardware_concurrency());
+        std::unique_ptr<replay::batch_decoder> batch;
+
+        try {
+            batch = std::make_unique<replay::batch_decoder>(batch_files, decoder->get_required_input_samples(),
+                    spacing, batch_segment * 1000000/spacing, batch_overlap * 1000000/spacing,
+                    z::wallclock_t(replay_start * 1e6));
+        } catch (std::exception const& e) {
+            std::cerr << "Failed to open batch: " << e.what() << ", aborting." << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+
+        std::cout << "Decoding " << batch_files.size() << " recording(s) in " << batch->get_stats().nr_segments <<
+            " segments on " << nr_workers << " workers." << std::endl;
+
+        // Every decoder is chatty about every peak it finds, which from many threads at once is just noise.
+        z::set_log_handler(z::log_handler_t());
+
+        // There's no capture loop to pin or prioritize; this thread goes on the I/O CPUs instead, so the
+        // workers it starts do too.
+        if (!rt::set_io_cpus(rt_io_cpus, -1) || !rt::run_on_io_cpus()) {
+            rt_failures++;
+        }
+
+        if (0 != rt_failures) {
+            std::cerr << rt_failures << " real-time setting(s) could not be applied, see above." << std::endl;
+        }
+
+        try {
+            batch->run(nr_workers, [&]() {
+                    auto d = std::make_unique<z::decoder>(center_freq, sample_rate, interval_len, max_age,
+                            fft_batch, nullptr, max_passes, fft_len);
+                    configure_decoder(*d);
+                    return d;
+                }, publish, running);
+        } catch (std::exception const& e) {
+            std::cerr << "Batch decode failed: " << e.what() << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+
+        std::cout << batch->get_stats();
+    } else {
+        std::unique_ptr<usrp::usrp_controller> radio = std::make_unique<usrp::usrp_controller>(device,
+                center_freq, tx_port, rx_port, tx_ant, rx_ant, sample_rate, sample_rate,
+                tx_gain, rx_gain, interval_len, activation_len, gps_pps, rx_channels);
+
+        std::cout << "Letting the radio settle..." << std::endl;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        if (!checkpoint_file.empty()) {
+            restore_checkpoint();
+        }
+
+        apply_budget(decode_budget);
+
+        apply_rt_profile();
+
+        // The first checkpoint is due a full period after the first interval
+        z::wallclock_t checkpoint_at = 0;
+
+        std::cout << "Starting the trigger loop." << std::endl;
+
+        do {
+            if (reload_requested) {
+                reload_requested = false;
+                reload(radio.get());
+            }
+
+            z::decoder& d = schedule.get_decoder();
+
+            try {
+                wallclock = radio->arm_and_fire(d.get_sample_buffer(), spacing, d.get_fft_len());
+            } catch (usrp::stream_error const& e) {
+                // Live passes and the rest of the decoder's state carry on through this
+                radio->recover(e);
+                continue;
+            }
+
+            d.process_data(wallclock);
+
+            if (schedule.next_interval()) {
+                radio->set_center_freq(schedule.get_center_freq());
+            }
+
+            if (!checkpoint_file.empty() && 0 != checkpoint_every) {
+                if (0 == checkpoint_at) {
+                    checkpoint_at = wallclock + checkpoint_every;
+                } else if (wallclock >= checkpoint_at) {
+                    save_checkpoint();
+                    checkpoint_at = wallclock + checkpoint_every;
+                }
+            }
+        } while (running);
+
+        if (checkpoint_writer.joinable()) {
+            checkpoint_writer.join();
+        }
+
+        if (!checkpoint_file.empty() && 0 != wallclock && write_checkpoint(take_checkpoint())) {
+            std::cout << "Saved the passes being tracked to checkpoint [" << checkpoint_file << "]" << std::endl;
+        }
+
+        std::cout << radio->get_recovery_stats();
+        if (scanning) {
+            std::cout << schedule.get_stats();
+        }
+    }
+
+    if (watchlist_loader.joinable()) {
+        watchlist_loader.join();
+    }
+
+    if (!batching) {
+        std::cout << "Shutting down at wallclock " << double(wallclock)/1e6 << std::endl;
+        for (size_t i = 0; i < decoders.size(); i++) {
+            if (scanning) {
+                std::cout << "Decoder for " << std::fixed << double(centers[i])/1e6 <<
+                    "MHz:" << std::endl;
+            }
+            std::cout << decoders[i]->get_stats();
+        }
+    }
+
+    if (nullptr != profiler) {
+        profiler->write_report(profile_out);
+        std::cout << profiler->get_total();
+        if (nullptr != profiler->get_failure()) {
+            std::cerr << "Profiling stopped part way through the run: " << profiler->get_failure() << std::endl;
+        }
+        std::cout << "Wrote the profile of each " << profile_every << " intervals to [" << profile_file << "]" <<
+            std::endl;
+    }
 
     return EXIT_SUCCESS;
 }
-
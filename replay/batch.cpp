@@ -0,0 +1,296 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <replay/batch.hh>
+#include <replay/replay.hh>
+#include <zepass/decoder.hh>
+#include <zepass/pass.hh>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ctime>
+
+using namespace replay;
+
+namespace z = zepass;
+
+/// Intervals a pass can go without being fed and still be decoded: a pass is decoded,
+/// or given up on, within 32 of its intervals
+static size_t const decode_horizon = 33;
+
+/// Split a set of recordings into segments.
+/// \param filenames The recordings, in the order they were captured
+/// \param samples_per_interval The number of samples in each capture interval
+/// \param spacing_us The pulse spacing, in microseconds, the recordings were made at
+/// \param segment_len The number of intervals in each segment
+/// \param overlap_len The number of intervals decoded before each segment, to let the decoder settle
+/// \param start_us The time the first interval of the first recording was captured at, in microseconds
+batch_decoder::batch_decoder(std::vector<std::string> const& filenames,
+                             size_t const samples_per_interval,
+                             z::wallclock_t const spacing_us,
+                             size_t const segment_len,
+                             size_t const overlap_len,
+                             z::wallclock_t const start_us) : m_filenames(filenames),
+                                                         m_samples_per_interval(samples_per_interval),
+                                                         m_spacing_us(spacing_us)
+{
+    if (0 == segment_len) {
+        throw std::invalid_argument("segment_len");
+    }
+
+    z::wallclock_t file_start_us = start_us;
+
+    for (size_t file = 0; file < m_filenames.size(); file++) {
+        size_t const nr_intervals = replay_source(m_filenames[file], samples_per_interval,
+                spacing_us).get_recorded_intervals();
+        m_nr_recorded.push_back(nr_intervals);
+
+        for (size_t first = 0; first < nr_intervals; first += segment_len) {
+            segment seg;
+            seg.file = file;
+            seg.first = first;
+            seg.end = std::min(first + segment_len, nr_intervals);
+            seg.decode_from = first > overlap_len ? first - overlap_len : 0;
+            seg.start_us = file_start_us;
+            m_segments.push_back(std::move(seg));
+        }
+
+        // The next recording carries on where this one left off
+        file_start_us += z::wallclock_t(nr_intervals) * spacing_us;
+        m_stats.nr_intervals += nr_intervals;
+    }
+
+    m_stats.nr_files = m_filenames.size();
+    m_stats.nr_segments = m_segments.size();
+    m_stats.recorded_us = file_start_us - start_us;
+}
+
+batch_decoder::~batch_decoder()
+{
+}
+
+/// Return the CPU time used by the calling thread, in seconds.
+static
+double thread_cpu_secs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return double(ts.tv_sec) + double(ts.tv_nsec)/1e9;
+}
+
+/// Decode one segment with a decoder of its own, keeping the reads that belong to it.
+void batch_decoder::decode_segment(segment& seg, decoder_factory_t const& make_decoder,
+                                   bool const volatile& running)
+{
+    double const start = thread_cpu_secs();
+
+    std::unique_ptr<z::decoder> decoder = make_decoder();
+    replay_source source(m_filenames[seg.file], m_samples_per_interval, m_spacing_us, seg.start_us);
+    source.seek(seg.decode_from);
+
+    z::wallclock_t const own_from = seg.start_us + z::wallclock_t(seg.first) * m_spacing_us;
+    z::wallclock_t const own_to = seg.start_us + z::wallclock_t(seg.end) * m_spacing_us;
+
+    decoder->add_read_handler([&seg, own_from, own_to](z::pass const& p) {
+            if (p.first_seen_at() < own_from || p.first_seen_at() >= own_to) {
+                seg.nr_overlap_reads++;
+                return;
+            }
+
+            z::read_record rec;
+            p.fill_record(rec);
+            seg.reads.push_back(rec);
+        });
+
+    std::vector<z::wallclock_t> at(decoder->get_batch_len());
+    size_t next = seg.decode_from;
+    size_t const nr_recorded = m_nr_recorded[seg.file];
+    z::wallclock_t const horizon = z::wallclock_t(decode_horizon) * m_spacing_us;
+    z::wallclock_t last_at = 0;
+
+    // Past the end of the segment, only go on while one of its passes is undecided, and
+    // still being fed; one left unfed for the decode horizon won't be decoded here
+    while (next < nr_recorded && running &&
+            (next < seg.end || decoder->has_undecoded(own_to, last_at > horizon ? last_at - horizon : 0)))
+    {
+        size_t const want = next < seg.end ? std::min(seg.end - next, at.size()) : 1;
+        size_t const nr_read = source.read_intervals(decoder->get_sample_buffer(), decoder->get_fft_len(),
+                &at.front(), want);
+        if (0 == nr_read) {
+            break;
+        }
+
+        decoder->process_batch(&at.front(), nr_read);
+        last_at = at[nr_read - 1];
+        next += nr_read;
+        seg.nr_decoded += nr_read;
+    }
+
+    decoder.reset();
+
+    seg.busy_secs = thread_cpu_secs() - start;
+}
+
+/// Decode every segment, on up to nr_workers threads, and hand over the reads in
+/// timestamp order as soon as every segment they could interleave with is done.
+/// \param nr_workers The number of threads to decode on
+/// \param make_decoder Makes the decoder for each segment. Called from the worker threads.
+/// \param handler Called with each read, on this thread
+/// \param running Checked between batches of intervals; once it is false, decoding
+///                stops and the reads from the segments finished so far are handed over
+void batch_decoder::run(size_t const nr_workers, decoder_factory_t const& make_decoder,
+                        record_handler_t const& handler, bool const volatile& running)
+{
+    if (0 == nr_workers) {
+        throw std::invalid_argument("nr_workers");
+    }
+
+    std::mutex lock;
+    std::condition_variable cond;
+    std::atomic<size_t> next_segment(0);
+    size_t nr_finished = 0;
+    std::string error;
+
+    m_stats.nr_workers = nr_workers;
+    m_stats.nr_decoded_intervals = 0;
+    m_stats.nr_reads = 0;
+    m_stats.nr_overlap_reads = 0;
+    m_stats.busy_secs = 0.0;
+
+    for (auto& seg: m_segments) {
+        seg.reads.clear();
+        seg.nr_overlap_reads = 0;
+        seg.nr_decoded = 0;
+        seg.done = false;
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < nr_workers; i++) {
+        workers.emplace_back([&]() {
+                for (size_t k = next_segment++; k < m_segments.size() && running; k = next_segment++) {
+                    try {
+                        decode_segment(m_segments[k], make_decoder, running);
+                    } catch (std::exception const& e) {
+                        std::lock_guard<std::mutex> guard(lock);
+                        error = m_filenames[m_segments[k].file] + ": " + e.what();
+                        next_segment = m_segments.size();
+                    }
+
+                    std::lock_guard<std::mutex> guard(lock);
+                    m_segments[k].done = error.empty();
+                    cond.notify_all();
+                }
+
+                std::lock_guard<std::mutex> guard(lock);
+                nr_finished++;
+                cond.notify_all();
+            });
+    }
+
+    // A read's pass starts in its own segment, so nothing from later segments can
+    // come before the start of the next one
+    std::vector<z::read_record> pending;
+
+    for (size_t k = 0; k < m_segments.size(); k++) {
+        segment& seg = m_segments[k];
+
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cond.wait(guard, [&]() { return seg.done || nr_finished == nr_workers; });
+            if (!seg.done) {
+                break;
+            }
+        }
+
+        pending.insert(pending.end(), seg.reads.begin(), seg.reads.end());
+        std::vector<z::read_record>().swap(seg.reads);
+
+        std::stable_sort(pending.begin(), pending.end(), [](z::read_record const& a, z::read_record const& b) {
+                return a.last_seen_at < b.last_seen_at;
+            });
+
+        z::wallclock_t limit = std::numeric_limits<z::wallclock_t>::max();
+        if (k + 1 < m_segments.size()) {
+            segment const& next = m_segments[k + 1];
+            limit = next.start_us + z::wallclock_t(next.first) * m_spacing_us;
+        }
+
+        auto it = pending.begin();
+        for (; it != pending.end() && it->last_seen_at < limit; ++it) {
+            handler(*it);
+            m_stats.nr_reads++;
+        }
+        pending.erase(pending.begin(), it);
+
+        m_stats.nr_decoded_intervals += seg.nr_decoded;
+        m_stats.nr_overlap_reads += seg.nr_overlap_reads;
+        m_stats.busy_secs += seg.busy_secs;
+    }
+
+    // Whatever is left came from segments that finished before a stop
+    for (auto const& rec: pending) {
+        handler(rec);
+        m_stats.nr_reads++;
+    }
+
+    for (auto& worker: workers) {
+        worker.join();
+    }
+
+    std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+    m_stats.elapsed_secs = elapsed.count();
+
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+}
+
+std::ostream& operator<<(std::ostream& os, replay::batch_stats const& s)
+{
+    double const elapsed = std::max(s.elapsed_secs, 1e-9);
+
+    // Workers busy on average is the speedup over decoding every segment one after
+    // another; overlaps are decoded more than once, so cost some of it
+    double const speedup = s.busy_secs/elapsed;
+    double const overlap_cost = 0 != s.nr_decoded_intervals ?
+        double(s.nr_intervals)/double(s.nr_decoded_intervals) : 1.0;
+
+    os << "Recordings: " << s.nr_files << ", " << s.nr_intervals << " intervals covering " <<
+        double(s.recorded_us)/1e6 << " seconds" << std::endl;
+    os << "Segments: " << s.nr_segments << " on " << s.nr_workers << " workers, " << s.nr_decoded_intervals <<
+        " intervals decoded including overlaps" << std::endl;
+    os << "Reads: " << s.nr_reads << " kept, " << s.nr_overlap_reads << " dropped from overlaps" << std::endl;
+    os << "Throughput: " << double(s.nr_intervals)/elapsed << " intervals/sec, " <<
+        double(s.recorded_us)/1e6/elapsed << " times real time, in " << s.elapsed_secs << " seconds" << std::endl;
+    os << "Scaling: " << speedup << " workers busy on average, " << speedup * overlap_cost <<
+        " times one decoder after overlaps" << std::endl;
+
+    return os;
+}
@@ -0,0 +1,112 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <zepass/decoder.hh>
+#include <zepass/record.hh>
+#include <zepass/types.hh>
+
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace replay {
+
+///
+/// \brief What a batch decode got through, and how well it used the workers.
+///
+struct batch_stats {
+    size_t nr_files = 0; //< Recordings decoded
+    size_t nr_segments = 0; //< Segments the recordings were split into
+    size_t nr_workers = 0; //< Threads decoding segments
+    size_t nr_intervals = 0; //< Intervals in the recordings
+    size_t nr_decoded_intervals = 0; //< Intervals decoded, counting those in overlaps more than once
+    size_t nr_reads = 0; //< Reads kept
+    size_t nr_overlap_reads = 0; //< Reads dropped because they belong to a neighbouring segment
+    zepass::wallclock_t recorded_us = 0; //< Capture time the intervals cover, in microseconds
+    double elapsed_secs = 0.0; //< Time taken, start to finish
+    double busy_secs = 0.0; //< CPU time the workers spent decoding, summed over all of them
+};
+
+///
+/// \brief Decode a set of recordings on many threads at once.
+/// Each recording is cut into segments of consecutive intervals. Each segment is
+/// decoded by its own decoder, starting some intervals before the segment so the
+/// noise floors and gates have settled, and carrying on past it until every pass
+/// that started in the segment is decoded or given up on. A read belongs to the
+/// segment its pass started in, so one seen from two segments is kept only once. Reads are
+/// handed over in timestamp order. Recordings follow one another in time, in the
+/// order given.
+///
+class batch_decoder {
+public:
+    /// Make a decoder, configured and ready to use, for one segment
+    typedef std::function<std::unique_ptr<zepass::decoder>()> decoder_factory_t;
+
+    /// Called with each read, in timestamp order, on the thread that called run()
+    typedef std::function<void(zepass::read_record const&)> record_handler_t;
+
+    batch_decoder(std::vector<std::string> const& filenames,
+                  size_t const samples_per_interval,
+                  zepass::wallclock_t const spacing_us,
+                  size_t const segment_len,
+                  size_t const overlap_len,
+                  zepass::wallclock_t const start_us = 0);
+    ~batch_decoder();
+
+    void run(size_t const nr_workers, decoder_factory_t const& make_decoder,
+             record_handler_t const& handler, bool const volatile& running);
+
+    /// Return the counters from the last run
+    batch_stats const& get_stats() const { return m_stats; }
+
+private:
+    ///
+    /// \brief A run of intervals from one recording, and the reads it produced.
+    ///
+    struct segment {
+        size_t file; //< Index of the recording
+        size_t first; //< First interval of the segment
+        size_t end; //< One past the last interval of the segment
+        size_t decode_from; //< First interval decoded, before first to let the decoder settle
+        zepass::wallclock_t start_us; //< Time of the first interval of the recording
+        std::vector<zepass::read_record> reads; //< Reads whose pass started in the segment
+        size_t nr_overlap_reads = 0; //< Reads belonging to another segment
+        size_t nr_decoded = 0; //< Intervals actually decoded
+        double busy_secs = 0.0; //< CPU time spent decoding the segment
+        bool done = false; //< Whether the reads are complete
+    };
+
+    void decode_segment(segment& seg, decoder_factory_t const& make_decoder, bool const volatile& running);
+
+    std::vector<std::string> m_filenames; //< The recordings, in time order
+    size_t m_samples_per_interval; //< The number of samples in each recorded interval
+    zepass::wallclock_t m_spacing_us; //< Time between intervals, in microseconds
+    std::vector<size_t> m_nr_recorded; //< The number of intervals in each recording
+    std::vector<segment> m_segments; //< Every segment, in time order
+    batch_stats m_stats; //< Counters from the last run
+};
+
+} // end namespace replay
+
+/// ostream operator to render batch decode counters, one per line
+std::ostream& operator<<(std::ostream& os, replay::batch_stats const& s);
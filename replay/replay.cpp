@@ -0,0 +1,109 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <replay/replay.hh>
+#include <zepass/types.hh>
+
+#include <algorithm>
+#include <complex>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+using namespace replay;
+
+namespace z = zepass;
+
+/// Open a recording for replay.
+/// \param filename The recording to read
+/// \param samples_per_interval The number of samples in each capture interval
+/// \param spacing_us The pulse spacing, in microseconds, the recording was made at
+/// \param start_us The time to give the first interval of the recording, in microseconds
+replay_source::replay_source(std::string const& filename,
+                             size_t const samples_per_interval,
+                             z::wallclock_t const spacing_us,
+                             z::wallclock_t const start_us) : m_file(filename, std::ifstream::binary),
+                                                              m_samples_per_interval(samples_per_interval),
+                                                              m_spacing_us(spacing_us),
+                                                              m_start_us(start_us)
+{
+    if (!m_file.is_open()) {
+        throw std::runtime_error("failed to open replay file " + filename);
+    }
+
+    if (0 == m_samples_per_interval) {
+        throw std::invalid_argument("samples_per_interval");
+    }
+}
+
+replay_source::~replay_source()
+{
+}
+
+/// Return the number of whole intervals in the recording. The read position is kept.
+size_t replay_source::get_recorded_intervals()
+{
+    m_file.clear();
+    std::streampos const pos = m_file.tellg();
+    m_file.seekg(0, std::ifstream::end);
+    std::streamoff const len = m_file.tellg();
+    m_file.seekg(pos);
+
+    return size_t(len)/(sizeof(std::complex<float>) * m_samples_per_interval);
+}
+
+/// Move to an interval of the recording. Timestamps carry on from there, as if the
+/// intervals before it had been read.
+/// \param interval The index of the next interval to read
+void replay_source::seek(size_t const interval)
+{
+    m_file.clear();
+    m_file.seekg(std::streamoff(interval * m_samples_per_interval * sizeof(std::complex<float>)));
+
+    if (!m_file) {
+        throw std::runtime_error("failed to seek the replay file");
+    }
+
+    m_nr_intervals = interval;
+}
+
+/// Read the next intervals of the recording. A trailing partial interval is ignored.
+/// \param target_buffer Where to write the first interval
+/// \param stride The distance, in samples, between the start of each interval in target_buffer
+/// \param at Filled in with the time each interval was captured at
+/// \param nr_intervals The maximum number of intervals to read
+/// \return The number of intervals read, 0 at the end of the recording
+size_t replay_source::read_intervals(z::sample_t* target_buffer, size_t const stride,
+                                     z::wallclock_t* at, size_t const nr_intervals)
+{
+    m_read_buf.resize(m_samples_per_interval * nr_intervals);
+
+    m_file.read(reinterpret_cast<char*>(&m_read_buf.front()),
+            sizeof(std::complex<float>) * m_read_buf.size());
+    size_t const nr_read = size_t(m_file.gcount())/(sizeof(std::complex<float>) * m_samples_per_interval);
+
+    for (size_t i = 0; i < nr_read; i++) {
+        std::copy(m_read_buf.begin() + i * m_samples_per_interval,
+                  m_read_buf.begin() + (i + 1) * m_samples_per_interval,
+                  target_buffer + i * stride);
+        at[i] = m_start_us + z::wallclock_t(m_nr_intervals++) * m_spacing_us;
+    }
+
+    return nr_read;
+}
@@ -0,0 +1,65 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <zepass/types.hh>
+
+#include <complex>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace replay {
+
+///
+/// \brief Source of recorded capture intervals.
+/// Reads raw interleaved single-precision complex samples (fc32), one capture
+/// interval after another, with no framing. Interval timestamps are synthesized
+/// from the pulse spacing the capture was made with, counting from a given start.
+///
+class replay_source {
+public:
+    replay_source(std::string const& filename,
+                  size_t const samples_per_interval,
+                  zepass::wallclock_t const spacing_us,
+                  zepass::wallclock_t const start_us = 0);
+    ~replay_source();
+
+    size_t get_recorded_intervals();
+    void seek(size_t const interval);
+
+    size_t read_intervals(zepass::sample_t* target_buffer, size_t const stride,
+                          zepass::wallclock_t* at, size_t const nr_intervals);
+
+    /// Return the index of the next interval to read, which is the number read so far
+    /// unless seek() was used
+    size_t get_interval_count() const { return m_nr_intervals; }
+
+private:
+    std::ifstream m_file;
+    size_t m_samples_per_interval; //< The number of samples in each recorded interval
+    zepass::wallclock_t m_spacing_us; //< Time between intervals, in microseconds
+    zepass::wallclock_t m_start_us; //< Time of the first interval in the recording, in microseconds
+    size_t m_nr_intervals = 0; //< Index of the next interval to read
+    std::vector<std::complex<float>> m_read_buf; //< Staging buffer for the raw samples
+};
+
+} // end namespace replay
+
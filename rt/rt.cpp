@@ -0,0 +1,303 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <rt/rt.hh>
+
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+/// The CPUs the process could run on when set_io_cpus() was first called
+cpu_set_t allowed_cpus;
+bool have_allowed_cpus = false;
+
+/// The CPUs io_thread runs on
+cpu_set_t io_cpus;
+bool have_io_cpus = false;
+
+}  // end anonymous namespace
+
+/// Check that a CPU exists, before it is handed to CPU_SET.
+static
+bool check_cpu(int const cpu, char const* const what)
+{
+    // CPU_SET doesn't check its argument; the kernel turns down CPUs that exist but
+    // are offline, or that this process isn't allowed on
+    long const nr_cpus = sysconf(_SC_NPROCESSORS_CONF);
+    if (cpu < 0 || cpu >= CPU_SETSIZE || (0 < nr_cpus && cpu >= nr_cpus)) {
+        std::cerr << "Can't " << what << " CPU " << cpu << ": no such CPU" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/// Lock all current and future pages of the process into RAM, so the capture loop
+/// never takes a page fault.
+bool rt::lock_memory()
+{
+    if (0 != mlockall(MCL_CURRENT | MCL_FUTURE)) {
+        std::cerr << "Failed to lock memory: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    std::cout << "Locked all memory into RAM" << std::endl;
+
+    return true;
+}
+
+/// Pin the calling thread to a single core.
+bool rt::pin_thread(int const cpu)
+{
+    cpu_set_t cpus;
+
+    if (!check_cpu(cpu, "pin thread to")) {
+        return false;
+    }
+
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (0 != ret) {
+        std::cerr << "Failed to pin thread to CPU " << cpu << ": " << std::strerror(ret) << std::endl;
+        return false;
+    }
+
+    std::cout << "Pinned thread to CPU " << cpu << std::endl;
+
+    return true;
+}
+
+/// Run the calling thread under SCHED_FIFO at the given priority.
+bool rt::set_fifo_priority(int const priority)
+{
+    sched_param param;
+
+    std::memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+
+    int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (0 != ret) {
+        std::cerr << "Failed to set SCHED_FIFO priority " << priority << ": " << std::strerror(ret) << std::endl;
+        return false;
+    }
+
+    std::cout << "Running with SCHED_FIFO priority " << priority << std::endl;
+
+    return true;
+}
+
+/// Set aside the CPUs threads off the capture path run on. Call this before pinning
+/// the capture thread, since the first call takes note of where the process can run.
+/// \param cpu_list The CPUs, as a comma separated list of CPUs and ranges of them
+///                 (such as 2,4-7), or empty for every CPU the process can run on
+///                 except the capture thread's
+/// \param rt_cpu The CPU the capture thread is pinned to, or -1 if it isn't
+/// \return false if the list can't be used, in which case the default is
+bool rt::set_io_cpus(std::string const& cpu_list, int const rt_cpu)
+{
+    if (!have_allowed_cpus) {
+        CPU_ZERO(&allowed_cpus);
+        if (0 != sched_getaffinity(0, sizeof(allowed_cpus), &allowed_cpus)) {
+            std::cerr << "Failed to get the CPUs the process can run on: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        have_allowed_cpus = true;
+    }
+
+    io_cpus = allowed_cpus;
+    have_io_cpus = true;
+
+    if (0 <= rt_cpu && rt_cpu < CPU_SETSIZE && CPU_ISSET(rt_cpu, &io_cpus) && 1 < CPU_COUNT(&io_cpus)) {
+        CPU_CLR(rt_cpu, &io_cpus);
+    }
+
+    if (cpu_list.empty()) {
+        if (0 <= rt_cpu && !CPU_ISSET(rt_cpu, &io_cpus)) {
+            std::cout << "Running I/O threads on the " << CPU_COUNT(&io_cpus) << " CPU(s) other than CPU " <<
+                rt_cpu << std::endl;
+        }
+        return true;
+    }
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+
+    std::istringstream in(cpu_list);
+    std::string range;
+    while (std::getline(in, range, ',')) {
+        char const* const str = range.c_str();
+        char* end = nullptr;
+        long const first = std::strtol(str, &end, 10);
+        long last = first;
+        bool valid = end != str;
+
+        if (valid && '-' == *end) {
+            char const* const to = end + 1;
+            last = std::strtol(to, &end, 10);
+            valid = end != to;
+        }
+
+        if (!valid || '\0' != *end || first > last || first < INT_MIN || last > INT_MAX) {
+            std::cerr << "Can't run I/O threads on [" << cpu_list << "]: [" << range <<
+                "] is not a CPU or range of CPUs" << std::endl;
+            return false;
+        }
+
+        for (int cpu = int(first); cpu <= int(last); cpu++) {
+            if (!check_cpu(cpu, "run I/O threads on")) {
+                return false;
+            }
+            CPU_SET(cpu, &cpus);
+        }
+    }
+
+    io_cpus = cpus;
+
+    std::cout << "Running I/O threads on CPU(s) " << cpu_list << std::endl;
+
+    return true;
+}
+
+/// Move the calling thread onto the CPUs set aside for I/O, under SCHED_OTHER, for
+/// when it has no real-time role of its own. Threads it starts from then on follow it.
+bool rt::run_on_io_cpus()
+{
+    sched_param param;
+
+    std::memset(&param, 0, sizeof(param));
+
+    int ret = pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    if (0 != ret) {
+        std::cerr << "Failed to run under SCHED_OTHER: " << std::strerror(ret) << std::endl;
+        return false;
+    }
+
+    if (have_io_cpus) {
+        ret = pthread_setaffinity_np(pthread_self(), sizeof(io_cpus), &io_cpus);
+        if (0 != ret) {
+            std::cerr << "Failed to move thread to the I/O CPUs: " << std::strerror(ret) << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// Start a thread running the given function.
+/// \throws std::system_error if the thread can't be started
+rt::io_thread::io_thread(std::function<void()> fn)
+{
+    std::unique_ptr<std::function<void()>> body(new std::function<void()>(std::move(fn)));
+    pthread_attr_t attr;
+    sched_param param;
+
+    std::memset(&param, 0, sizeof(param));
+
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    pthread_attr_setschedparam(&attr, &param);
+    if (have_io_cpus) {
+        pthread_attr_setaffinity_np(&attr, sizeof(io_cpus), &io_cpus);
+    }
+
+    int ret = pthread_create(&m_thread, &attr, &io_thread::run, body.get());
+
+    // The I/O CPUs may have gone offline since; rather run anywhere than not at all
+    if (EINVAL == ret && have_io_cpus && have_allowed_cpus) {
+        std::cerr << "Failed to start a thread on the I/O CPUs: " << std::strerror(ret) <<
+            ", starting it on any CPU" << std::endl;
+        pthread_attr_setaffinity_np(&attr, sizeof(allowed_cpus), &allowed_cpus);
+        ret = pthread_create(&m_thread, &attr, &io_thread::run, body.get());
+    }
+
+    pthread_attr_destroy(&attr);
+
+    if (0 != ret) {
+        throw std::system_error(ret, std::generic_category(), "pthread_create");
+    }
+
+    body.release();
+    m_joinable = true;
+}
+
+/// Like a std::thread, an io_thread must be joined before it goes away.
+rt::io_thread::~io_thread()
+{
+    if (m_joinable) {
+        std::terminate();
+    }
+}
+
+rt::io_thread::io_thread(io_thread&& other) noexcept : m_thread(other.m_thread),
+                                                       m_joinable(other.m_joinable)
+{
+    other.m_joinable = false;
+}
+
+rt::io_thread& rt::io_thread::operator=(io_thread&& other) noexcept
+{
+    if (m_joinable) {
+        std::terminate();
+    }
+
+    m_thread = other.m_thread;
+    m_joinable = other.m_joinable;
+    other.m_joinable = false;
+
+    return *this;
+}
+
+/// Wait for the thread to finish.
+void rt::io_thread::join()
+{
+    if (!m_joinable) {
+        throw std::system_error(EINVAL, std::generic_category(), "io_thread::join");
+    }
+
+    pthread_join(m_thread, nullptr);
+    m_joinable = false;
+}
+
+void* rt::io_thread::run(void* const arg)
+{
+    std::unique_ptr<std::function<void()>> body(static_cast<std::function<void()>*>(arg));
+
+    (*body)();
+
+    return nullptr;
+}
@@ -0,0 +1,66 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include <pthread.h>
+
+namespace rt {
+
+bool lock_memory();
+bool pin_thread(int const cpu);
+bool set_fifo_priority(int const priority);
+bool set_io_cpus(std::string const& cpu_list, int const rt_cpu);
+bool run_on_io_cpus();
+
+///
+/// \brief Thread for work kept off the capture path, such as writing to disk.
+/// Started with scheduling attributes of its own, rather than inheriting those of
+/// the thread that starts it: SCHED_OTHER, on the CPUs set aside with set_io_cpus().
+/// Otherwise used like a std::thread.
+///
+class io_thread {
+public:
+    io_thread() = default;
+    explicit io_thread(std::function<void()> fn);
+    ~io_thread();
+
+    io_thread(io_thread&& other) noexcept;
+    io_thread& operator=(io_thread&& other) noexcept;
+
+    io_thread(io_thread const&) = delete;
+    io_thread& operator=(io_thread const&) = delete;
+
+    /// Return whether or not the thread was started, and not joined yet
+    bool joinable() const { return m_joinable; }
+
+    void join();
+
+private:
+    static void* run(void* const arg);
+
+    pthread_t m_thread; //< The thread, if joinable
+    bool m_joinable = false; //< Whether m_thread was started, and not joined yet
+};
+
+}  // end namespace rt
+
@@ -0,0 +1,153 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <scan/scan.hh>
+#include <zepass/decoder.hh>
+
+#include <iomanip>
+#include <stdexcept>
+#include <vector>
+
+#include <cmath>
+
+using namespace scan;
+
+namespace z = zepass;
+
+/// How much each visit moves a channel's activity towards what was seen on it
+static double const activity_weight = 0.25;
+
+/// Set up an empty scan.
+/// \param min_dwell The fewest intervals to spend on a channel each visit
+/// \param max_dwell The most intervals to spend on a channel each visit
+scan_schedule::scan_schedule(size_t const min_dwell, size_t const max_dwell)
+{
+    set_dwell(min_dwell, max_dwell);
+}
+
+scan_schedule::~scan_schedule()
+{
+}
+
+/// Add a channel to the end of the scan. The scan starts on the first channel added.
+/// \param center_freq The center frequency to tune to, in Hz
+/// \param dec The decoder for intervals captured on the channel; it must outlive the scan
+void scan_schedule::add_channel(z::freq_t const center_freq, z::decoder* const dec)
+{
+    if (nullptr == dec) {
+        throw std::invalid_argument("a scan channel needs a decoder");
+    }
+
+    m_channels.push_back(channel{center_freq, dec});
+
+    if (1 == m_channels.size()) {
+        m_channels.front().nr_visits++;
+        m_nr_left = get_dwell(0);
+    }
+}
+
+/// Change how long each visit to a channel lasts, from the next visit on.
+/// \param min_dwell The fewest intervals to spend on a channel each visit
+/// \param max_dwell The most intervals to spend on a channel each visit, when it's the only busy one
+void scan_schedule::set_dwell(size_t const min_dwell, size_t const max_dwell)
+{
+    if (0 == min_dwell || max_dwell < min_dwell) {
+        throw std::invalid_argument("scan dwell must be at least one interval, and the maximum no less than the minimum");
+    }
+
+    m_min_dwell = min_dwell;
+    m_max_dwell = max_dwell;
+}
+
+/// Return how many intervals the next visit to a channel should last.
+size_t scan_schedule::get_dwell(size_t const chan) const
+{
+    double total = 0.0;
+    for (auto const& c : m_channels) {
+        total += c.activity;
+    }
+
+    if (0.0 >= total) {
+        return m_min_dwell;
+    }
+
+    return m_min_dwell + size_t(std::round(double(m_max_dwell - m_min_dwell) * m_channels[chan].activity/total));
+}
+
+/// Account for the interval just decoded on the current channel, and move on to the
+/// next channel if the visit is over.
+/// \return true if the next interval is on a different channel, and the radio needs retuning
+bool scan_schedule::next_interval()
+{
+    channel& cur = m_channels[m_current];
+
+    cur.nr_intervals++;
+    m_busy += double(cur.dec->get_nr_undecoded());
+    m_nr_visited++;
+
+    if (0 != --m_nr_left) {
+        return false;
+    }
+
+    cur.activity += activity_weight * (m_busy/double(m_nr_visited) - cur.activity);
+    m_busy = 0.0;
+    m_nr_visited = 0;
+
+    size_t const last = m_current;
+    m_current = (m_current + 1) % m_channels.size();
+    m_channels[m_current].nr_visits++;
+    m_nr_left = get_dwell(m_current);
+
+    if (last == m_current) {
+        return false;
+    }
+
+    m_nr_retunes++;
+    return true;
+}
+
+/// Return a snapshot of the scan counters.
+scan_stats scan_schedule::get_stats() const
+{
+    scan_stats s;
+
+    s.nr_retunes = m_nr_retunes;
+    for (auto const& c : m_channels) {
+        channel_stats cs;
+        cs.center_freq = c.center_freq;
+        cs.nr_visits = c.nr_visits;
+        cs.nr_intervals = c.nr_intervals;
+        cs.activity = c.activity;
+        s.channels.push_back(cs);
+    }
+
+    return s;
+}
+
+std::ostream& operator<<(std::ostream& os, scan::scan_stats const& s)
+{
+    os << "Scan retunes: " << s.nr_retunes << std::endl;
+    for (auto const& c : s.channels) {
+        os << "Channel " << std::fixed << std::setprecision(3) << double(c.center_freq)/1e6 << "MHz: " <<
+            c.nr_visits << " visits, " << c.nr_intervals << " intervals, activity " <<
+            std::setprecision(2) << c.activity << std::endl;
+    }
+
+    return os;
+}
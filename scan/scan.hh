@@ -0,0 +1,103 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+#pragma once
+
+#include <zepass/decoder.hh>
+#include <zepass/types.hh>
+
+#include <ostream>
+#include <vector>
+
+namespace scan {
+
+///
+/// \brief How much time one channel of a scan has had, and how busy it has been.
+///
+struct channel_stats {
+    zepass::freq_t center_freq = 0; //< Center frequency of the channel, in Hz
+    size_t nr_visits = 0; //< Times the radio was tuned to the channel
+    size_t nr_intervals = 0; //< Intervals captured on the channel
+    double activity = 0.0; //< Recent average of the passes waiting to be decoded
+};
+
+///
+/// \brief Counters describing a scan.
+///
+struct scan_stats {
+    size_t nr_retunes = 0; //< Times the radio moved to another channel
+    std::vector<channel_stats> channels; //< Each channel, in scan order
+};
+
+///
+/// \brief Which center frequency the radio should capture each interval on, when
+///        there is more to cover than one capture bandwidth.
+/// The channels are visited in turn, for a dwell of some number of intervals each.
+/// Every channel has a decoder of its own, so its passes, noise floors and gates
+/// carry on from one visit to the next. A channel's activity is how many passes its
+/// decoder has waiting to be decoded, averaged over its recent visits; the dwells
+/// are the minimum, plus a share of the difference to the maximum in proportion to
+/// activity. A quiet channel is still visited, so new tags are found.
+///
+class scan_schedule {
+public:
+    scan_schedule(size_t const min_dwell, size_t const max_dwell);
+    ~scan_schedule();
+
+    void add_channel(zepass::freq_t const center_freq, zepass::decoder* const dec);
+    void set_dwell(size_t const min_dwell, size_t const max_dwell);
+    bool next_interval();
+    scan_stats get_stats() const;
+
+    /// Return the number of channels being scanned
+    size_t get_nr_channels() const { return m_channels.size(); }
+
+    /// Return the center frequency the next interval is to be captured on
+    zepass::freq_t get_center_freq() const { return m_channels[m_current].center_freq; }
+
+    /// Return the decoder for the channel the next interval is to be captured on
+    zepass::decoder& get_decoder() const { return *m_channels[m_current].dec; }
+
+private:
+    ///
+    /// \brief A center frequency, and the decoder that keeps track of it.
+    ///
+    struct channel {
+        zepass::freq_t center_freq; //< Center frequency, in Hz
+        zepass::decoder* dec; //< Decoder for intervals captured here
+        double activity = 0.0; //< Recent average of the passes waiting to be decoded
+        size_t nr_visits = 0; //< Times the channel was visited
+        size_t nr_intervals = 0; //< Intervals captured on the channel
+    };
+
+    size_t get_dwell(size_t const chan) const;
+
+    std::vector<channel> m_channels; //< Every channel, in scan order
+    size_t m_min_dwell; //< Fewest intervals spent on a channel per visit
+    size_t m_max_dwell; //< Most intervals spent on a channel per visit
+    size_t m_current = 0; //< Index of the channel being visited
+    size_t m_nr_left = 0; //< Intervals left in the current visit
+    size_t m_nr_visited = 0; //< Intervals captured so far in the current visit
+    double m_busy = 0.0; //< Passes waiting to be decoded, summed over the current visit
+    size_t m_nr_retunes = 0; //< Times the channel changed
+};
+
+} // end namespace scan
+
+/// ostream operator to render the scan counters, one channel per line
+std::ostream& operator<<(std::ostream& os, scan::scan_stats const& s);
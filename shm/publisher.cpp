@@ -0,0 +1,110 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <shm/publisher.hh>
+#include <shm/ring.hh>
+
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace shm;
+
+/// Create a ring, and map it.
+/// \param name The name of the ring; it appears as /dev/shm/<name>
+/// \param nr_slots The number of records the ring can hold, a power of 2
+ring_publisher::ring_publisher(std::string const& name, size_t const nr_slots) : m_name("/" + name),
+                                                                                 m_size(ring_size(nr_slots)),
+                                                                                 m_mask(nr_slots - 1)
+{
+    if (0 == nr_slots || 0 != (nr_slots & (nr_slots - 1))) {
+        throw std::invalid_argument("nr_slots");
+    }
+
+    // Readers of a stale ring keep their mapping, and stop seeing new records
+    shm_unlink(m_name.c_str());
+
+    int fd = shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (0 > fd) {
+        throw std::system_error(errno, std::system_category(), "shm_open " + m_name);
+    }
+
+    if (0 != ftruncate(fd, off_t(m_size))) {
+        int err = errno;
+        close(fd);
+        shm_unlink(m_name.c_str());
+        throw std::system_error(err, std::system_category(), "ftruncate " + m_name);
+    }
+
+    void* region = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int err = errno;
+    close(fd);
+
+    if (MAP_FAILED == region) {
+        shm_unlink(m_name.c_str());
+        throw std::system_error(err, std::system_category(), "mmap " + m_name);
+    }
+
+    // The object is zero filled, so every slot starts out with a stamp no record matches
+    m_hdr = new (region) ring_header;
+    m_hdr->version = ring_version;
+    m_hdr->record_size = sizeof(zepass::read_record);
+    m_hdr->nr_slots = std::uint32_t(nr_slots);
+    m_hdr->head.store(0, std::memory_order_relaxed);
+    m_slots = ring_slots(m_hdr);
+
+    for (size_t i = 0; i < nr_slots; i++) {
+        new (&m_slots[i]) ring_slot;
+        m_slots[i].stamp.store(0, std::memory_order_relaxed);
+    }
+
+    std::atomic_thread_fence(std::memory_order_release);
+    m_hdr->magic = ring_magic;
+}
+
+ring_publisher::~ring_publisher()
+{
+    munmap(m_hdr, m_size);
+    shm_unlink(m_name.c_str());
+}
+
+/// Write a record to the ring, overwriting the oldest one.
+void ring_publisher::publish(zepass::read_record const& rec)
+{
+    ring_slot* const slot = &m_slots[m_next & m_mask];
+
+    // Mark the slot as being rewritten before touching the record, so a reader
+    // partway through the old one can tell it was clobbered.
+    slot->stamp.store(complete_stamp(m_next) - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    std::memcpy(&slot->rec, &rec, sizeof(rec));
+
+    slot->stamp.store(complete_stamp(m_next), std::memory_order_release);
+    m_hdr->head.store(++m_next, std::memory_order_release);
+}
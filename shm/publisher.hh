@@ -0,0 +1,59 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <shm/ring.hh>
+#include <zepass/record.hh>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace shm {
+
+///
+/// \brief Writer side of a shared memory ring of decoded reads.
+/// Creates the ring in /dev/shm under the given name, replacing any stale ring
+/// left behind, and removes it again when destroyed. Publishing never blocks; a
+/// reader that falls more than a ring's worth of records behind loses the oldest.
+///
+class ring_publisher {
+public:
+    typedef std::shared_ptr<ring_publisher> ptr_t;
+
+    ring_publisher(std::string const& name, size_t const nr_slots);
+    ~ring_publisher();
+
+    void publish(zepass::read_record const& rec);
+
+    /// Return the number of records published so far
+    std::uint64_t get_published_count() const { return m_next; }
+
+private:
+    std::string m_name; //< Name of the shared memory object
+    ring_header* m_hdr = nullptr; //< The mapped ring
+    ring_slot* m_slots = nullptr; //< The slots of the ring
+    size_t m_size = 0; //< Size of the mapping, in bytes
+    std::uint64_t m_mask = 0; //< Mask to turn a sequence number into a slot index
+    std::uint64_t m_next = 0; //< Sequence number of the next record
+};
+
+} // end namespace shm
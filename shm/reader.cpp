@@ -0,0 +1,175 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <shm/reader.hh>
+#include <shm/ring.hh>
+
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace shm;
+
+/// Attach to a ring created by the daemon.
+/// \param name The name of the ring, as given to the daemon
+/// \param from_oldest Start with the oldest record still in the ring, rather than
+///                    only records published from now on
+ring_reader::ring_reader(std::string const& name, bool const from_oldest)
+{
+    std::string const path = "/" + name;
+
+    int fd = shm_open(path.c_str(), O_RDONLY, 0);
+    if (0 > fd) {
+        throw std::system_error(errno, std::system_category(), "shm_open " + path);
+    }
+
+    struct stat st;
+    if (0 != fstat(fd, &st)) {
+        int err = errno;
+        close(fd);
+        throw std::system_error(err, std::system_category(), "fstat " + path);
+    }
+
+    m_size = size_t(st.st_size);
+
+    if (m_size < sizeof(ring_header)) {
+        close(fd);
+        throw std::runtime_error(path + " is not a ring");
+    }
+
+    void* region = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    int err = errno;
+    close(fd);
+
+    if (MAP_FAILED == region) {
+        throw std::system_error(err, std::system_category(), "mmap " + path);
+    }
+
+    m_hdr = reinterpret_cast<ring_header const*>(region);
+
+    // A ring caught mid-initialization isn't worth waiting for; the caller can retry
+    std::uint32_t const magic = m_hdr->magic;
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (ring_magic != magic || ring_version != m_hdr->version ||
+            sizeof(zepass::read_record) != m_hdr->record_size ||
+            0 == m_hdr->nr_slots || ring_size(m_hdr->nr_slots) > m_size)
+    {
+        munmap(const_cast<ring_header*>(m_hdr), m_size);
+        throw std::runtime_error(path + " is not a compatible ring");
+    }
+
+    m_slots = ring_slots(m_hdr);
+    m_nr_slots = m_hdr->nr_slots;
+
+    std::uint64_t const head = m_hdr->head.load(std::memory_order_acquire);
+    if (from_oldest) {
+        m_next = head > m_nr_slots ? head - m_nr_slots : 0;
+    } else {
+        m_next = head;
+    }
+}
+
+ring_reader::~ring_reader()
+{
+    munmap(const_cast<ring_header*>(m_hdr), m_size);
+}
+
+/// Return the next record in place, or null if there are no new records. The
+/// record must be released with consume(), which says whether it was overwritten
+/// while it was being looked at.
+zepass::read_record const* ring_reader::peek()
+{
+    if (nullptr != m_peeked) {
+        return &m_peeked->rec;
+    }
+
+    for (;;) {
+        std::uint64_t const head = m_hdr->head.load(std::memory_order_acquire);
+
+        if (m_next >= head) {
+            return nullptr;
+        }
+
+        if (head - m_next > m_nr_slots) {
+            // Lapped; skip to the oldest record that could still be intact
+            m_nr_lost += head - m_nr_slots - m_next;
+            m_next = head - m_nr_slots;
+        }
+
+        ring_slot const* const slot = &m_slots[m_next % m_nr_slots];
+        std::uint64_t const stamp = slot->stamp.load(std::memory_order_acquire);
+
+        if (complete_stamp(m_next) == stamp) {
+            m_peeked = slot;
+            return &slot->rec;
+        }
+
+        // The writer got to this slot again between reading the head and the stamp
+        m_nr_lost++;
+        m_next++;
+    }
+}
+
+/// Release the record returned by peek().
+/// \return true if the record was intact the whole time, false if the writer
+///         overwrote it and whatever was read from it must be discarded.
+bool ring_reader::consume()
+{
+    if (nullptr == m_peeked) {
+        return false;
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    bool const intact = complete_stamp(m_next) == m_peeked->stamp.load(std::memory_order_relaxed);
+
+    if (!intact) {
+        m_nr_lost++;
+    }
+
+    m_peeked = nullptr;
+    m_next++;
+
+    return intact;
+}
+
+/// Copy out the next intact record.
+/// \return true if a record was read, false if there are no new records
+bool ring_reader::read(zepass::read_record& rec)
+{
+    zepass::read_record const* in_place = nullptr;
+
+    while (nullptr != (in_place = peek())) {
+        std::memcpy(&rec, in_place, sizeof(rec));
+        if (consume()) {
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,63 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <shm/ring.hh>
+#include <zepass/record.hh>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace shm {
+
+///
+/// \brief Reader side of a shared memory ring of decoded reads.
+/// Maps the ring read-only. Records can be read in place with peek() and
+/// consume(), or copied out with read(). If the reader falls so far behind that
+/// the daemon overwrites records it hasn't read yet, it skips ahead to the
+/// oldest record still in the ring and counts the ones it lost.
+///
+class ring_reader {
+public:
+    ring_reader(std::string const& name, bool const from_oldest = false);
+    ~ring_reader();
+
+    zepass::read_record const* peek();
+    bool consume();
+    bool read(zepass::read_record& rec);
+
+    /// Return the sequence number of the next record to be read
+    std::uint64_t get_sequence() const { return m_next; }
+
+    /// Return the number of records lost to the writer lapping this reader
+    std::uint64_t get_overrun_count() const { return m_nr_lost; }
+
+private:
+    ring_header const* m_hdr = nullptr; //< The mapped ring
+    ring_slot const* m_slots = nullptr; //< The slots of the ring
+    size_t m_size = 0; //< Size of the mapping, in bytes
+    std::uint64_t m_nr_slots = 0; //< Number of slots in the ring
+    std::uint64_t m_next = 0; //< Sequence number of the next record to read
+    ring_slot const* m_peeked = nullptr; //< Slot handed out by peek(), not yet consumed
+    std::uint64_t m_nr_lost = 0; //< Records overwritten before they could be read
+};
+
+} // end namespace shm
@@ -0,0 +1,87 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <zepass/record.hh>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+///
+/// Layout of the shared memory ring decoded reads are published into. There is
+/// one writer, the daemon, and any number of readers that never write to the
+/// ring. Each slot carries a sequence stamp, so a reader can tell whether the
+/// record it is looking at is the one it expects, or if it has been lapped.
+///
+namespace shm {
+
+static constexpr std::uint32_t ring_magic = 0x5a505253; //< "ZPRS"
+static constexpr std::uint32_t ring_version = 1;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the ring needs lock-free 64-bit atomics");
+
+///
+/// \brief Header at the start of the ring.
+///
+struct ring_header {
+    std::uint32_t magic; //< ring_magic, written once everything else is initialized
+    std::uint32_t version; //< ring_version
+    std::uint32_t record_size; //< sizeof(zepass::read_record)
+    std::uint32_t nr_slots; //< Number of slots in the ring, a power of 2
+    alignas(64) std::atomic<std::uint64_t> head; //< Sequence number of the next record to be written
+};
+
+///
+/// \brief One entry in the ring.
+///
+struct alignas(64) ring_slot {
+    std::atomic<std::uint64_t> stamp; //< 2n + 1 while record n is being written, 2n + 2 once it is complete
+    zepass::read_record rec; //< The record itself
+};
+
+/// Return the stamp of a slot once record seq has been completely written to it.
+static inline
+std::uint64_t complete_stamp(std::uint64_t const seq)
+{
+    return 2 * seq + 2;
+}
+
+/// Return the size, in bytes, of a ring with the given number of slots.
+static inline
+std::size_t ring_size(std::size_t const nr_slots)
+{
+    return sizeof(ring_header) + nr_slots * sizeof(ring_slot);
+}
+
+/// Return the slots following the ring header.
+static inline
+ring_slot* ring_slots(ring_header* const hdr)
+{
+    return reinterpret_cast<ring_slot*>(reinterpret_cast<char*>(hdr) + sizeof(ring_header));
+}
+
+static inline
+ring_slot const* ring_slots(ring_header const* const hdr)
+{
+    return reinterpret_cast<ring_slot const*>(reinterpret_cast<char const*>(hdr) + sizeof(ring_header));
+}
+
+} // end namespace shm
@@ -0,0 +1,236 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <zepass/pass.hh>
+#include <zepass/checkpoint.hh>
+
+#include <boost/crc.hpp>
+
+#include <bitset>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+namespace z = zepass;
+
+static int failures = 0;
+
+static
+void check(bool const ok, std::string const& what)
+{
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+static z::freq_t const sampling_rate = 3000000;
+static size_t const interval_len = 580;
+static size_t const samples_per_interval = sampling_rate * interval_len / 1000000;
+static size_t const samples_per_bit = sampling_rate / 500000;
+static size_t const frame_start = 30;
+
+static unsigned const agency_id = 12;
+static unsigned const serial_num = 345678;
+
+/// Build a valid 256 bit frame, fields first and the CRC-16 over them last.
+static
+std::bitset<256> make_frame()
+{
+    std::bitset<256> bits;
+
+    auto put = [&bits](size_t const start, size_t const len, std::uint64_t const v) {
+        for (size_t i = 0; i < len; i++) {
+            bits[start + i] = (v >> (len - 1 - i)) & 1;
+        }
+    };
+
+    put(0, 3, 5);
+    put(3, 3, 1);
+    put(6, 3, 1);
+    put(9, 7, 65);
+    put(16, 7, agency_id);
+    put(23, 24, serial_num);
+
+    std::uint32_t state = 0x2545f491;
+    for (size_t i = 47; i < 240; i++) {
+        state = state * 1664525 + 1013904223;
+        bits[i] = (state >> 16) & 1;
+    }
+
+    boost::crc_optimal<16, 0x1021, 0, 0, false, false> crc;
+    for (size_t i = 0; i < 240/8; i++) {
+        std::uint8_t v = 0;
+        for (size_t j = 0; j < 8; j++) {
+            v = (v << 1) | bits[i * 8 + j];
+        }
+        crc(v);
+    }
+    put(240, 16, crc());
+
+    return bits;
+}
+
+/// Render a frame as the accumulated, basebanded envelope of a transponder: high
+/// then low for a 1, low then high for a 0.
+/// \param bits The frame
+/// \param weak Bits that come out wrong, but with little margin, as noise would leave them
+/// \param strong Bits that come out wrong at full strength
+static
+std::vector<z::sample_t> render(std::bitset<256> const& bits, std::set<size_t> const& weak,
+                                std::set<size_t> const& strong = std::set<size_t>())
+{
+    std::vector<z::sample_t> sig(samples_per_interval, 0.0);
+
+    for (size_t b = 0; b < bits.size(); b++) {
+        bool const value = strong.count(b) ? !bits[b] : bits[b];
+        double first = value ? 1.0 : 0.0,
+               second = value ? 0.0 : 1.0;
+
+        if (weak.count(b)) {
+            first = value ? 0.4 : 0.6;
+            second = value ? 0.6 : 0.4;
+        }
+
+        for (size_t s = 0; s < samples_per_bit; s++) {
+            sig[frame_start + b * samples_per_bit + s] = s < samples_per_bit/2 ? first : second;
+        }
+    }
+
+    return sig;
+}
+
+/// Decode an accumulated signal with the given error correction budget.
+static
+bool decode(std::vector<z::sample_t> const& sig, size_t const chase_bits, size_t const chase_flips,
+            z::pass& p)
+{
+    z::pass_checkpoint cp = z::pass_checkpoint();
+    cp.nr_acc = 1;
+
+    p.restore(cp, sig.data());
+    p.set_error_correction(chase_bits, chase_flips);
+
+    return p.decode();
+}
+
+/// A clean frame decodes without any correction.
+static
+void test_clean_frame()
+{
+    z::pass p(0.0, samples_per_interval, sampling_rate, interval_len);
+
+    check(decode(render(make_frame(), {}), 12, 3, p), "a clean frame decodes");
+    check(0 == p.get_corrected_bits(), "a clean frame needs no correction");
+    check(agency_id == p.get_agency_id() && serial_num == p.get_serial_number(), "a clean frame decodes to its tag");
+}
+
+/// Up to chase-flips weak errors are corrected, back to the transmitted tag.
+static
+void test_correctable_errors()
+{
+    std::vector<std::set<size_t>> const errors = {
+        { 30 },
+        { 17, 101 },
+        { 25, 140, 244 },
+    };
+
+    for (auto const& weak: errors) {
+        z::pass p(0.0, samples_per_interval, sampling_rate, interval_len);
+        std::string const what = std::to_string(weak.size()) + " weak errors";
+
+        check(decode(render(make_frame(), weak), 12, 3, p), what + " are corrected");
+        check(weak.size() == p.get_corrected_bits(), what + " are each flipped back");
+        check(agency_id == p.get_agency_id() && serial_num == p.get_serial_number(),
+                what + " decode to the transmitted tag");
+    }
+}
+
+/// Frames with errors beyond the budget are rejected, rather than corrected into
+/// some other tag.
+static
+void test_uncorrectable_errors()
+{
+    std::bitset<256> const frame = make_frame();
+
+    {
+        z::pass p(0.0, samples_per_interval, sampling_rate, interval_len);
+        check(!decode(render(frame, { 30 }), 0, 3, p), "nothing is corrected with error correction off");
+    }
+
+    {
+        z::pass p(0.0, samples_per_interval, sampling_rate, interval_len);
+        check(!decode(render(frame, { 5, 30, 77, 200 }), 12, 3, p), "more weak errors than chase-flips are rejected");
+    }
+
+    {
+        z::pass p(0.0, samples_per_interval, sampling_rate, interval_len);
+        check(!decode(render(frame, { 17, 101 }), 12, 1, p), "two weak errors are rejected with one flip allowed");
+    }
+
+    {
+        std::set<size_t> weak;
+        for (size_t b = 20; weak.size() < 13; b += 17) {
+            weak.insert(b);
+        }
+
+        z::pass p(0.0, samples_per_interval, sampling_rate, interval_len);
+        check(!decode(render(frame, weak), 12, 3, p), "more bits in doubt than chase-bits are rejected");
+    }
+
+    {
+        z::pass p(0.0, samples_per_interval, sampling_rate, interval_len);
+        check(!decode(render(frame, {}, { 64 }), 12, 3, p), "a reliable wrong bit is not flipped");
+    }
+
+    // A strong error, with a couple of weak ones beside it, must never be "fixed" by
+    // flipping other bits to match the CRC. The one exception is the leading bit,
+    // which is also the start of the frame the slicer syncs to.
+    size_t nr_accepted = 0,
+           nr_wrong = 0;
+    for (size_t b = 1; b < frame.size(); b++) {
+        z::pass p(0.0, samples_per_interval, sampling_rate, interval_len);
+        if (decode(render(frame, { (b + 40) % 256, (b + 90) % 256 }, { b }), 12, 3, p)) {
+            nr_accepted++;
+            if (agency_id != p.get_agency_id() || serial_num != p.get_serial_number()) {
+                nr_wrong++;
+            }
+        }
+    }
+    check(0 == nr_accepted, "frames with a strong error are rejected, " + std::to_string(nr_accepted) + " were not");
+    check(0 == nr_wrong, "no frame decodes to another tag, " + std::to_string(nr_wrong) + " did");
+}
+
+int main()
+{
+    test_clean_frame();
+    test_correctable_errors();
+    test_uncorrectable_errors();
+
+    if (0 != failures) {
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "error_correction: OK" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <zepass/timing_wheel.hh>
+
+#include <iostream>
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+namespace z = zepass;
+
+static int failures = 0;
+
+static
+void check(bool const ok, char const* const what)
+{
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+/// A fresh wheel starts at tick 0, while live wallclocks are microseconds since the
+/// epoch; the first advance must not step through every tick in between.
+static
+void test_fresh_wheel_at_epoch()
+{
+    z::timing_wheel wheel(10);
+    z::wallclock_t const now = 1792331227000000ull;
+    std::vector<z::wheel_entry*> expired;
+    auto collect = [&expired](z::wheel_entry* const e) { expired.push_back(e); };
+
+    z::wheel_entry soon, later;
+    wheel.schedule(&soon, now + 30000000);
+    wheel.schedule(&later, now + 60000000);
+
+    wheel.advance(now, collect);
+    check(expired.empty(), "nothing expires on the first advance");
+    check(2 == wheel.size(), "both entries are still on the wheel");
+
+    wheel.advance(now + 30000000 + 1024, collect);
+    check(1 == expired.size() && &soon == expired[0], "the first entry expires on time");
+
+    wheel.advance(now + 59000000, collect);
+    check(1 == expired.size(), "the second entry doesn't expire early");
+
+    wheel.advance(now + 60000000 + 1024, collect);
+    check(2 == expired.size() && &later == expired[1], "the second entry expires on time");
+    check(0 == wheel.size(), "the wheel is empty");
+}
+
+/// An entry that is already due when the wheel jumps expires in the jump.
+static
+void test_jump_expires_due_entries()
+{
+    z::timing_wheel wheel(10);
+    z::wallclock_t const now = 1792331227000000ull;
+    size_t nr_expired = 0;
+
+    z::wheel_entry entry;
+    wheel.schedule(&entry, now - 1000000);
+    wheel.advance(now, [&nr_expired](z::wheel_entry*) { nr_expired++; });
+
+    check(1 == nr_expired, "an entry due before the jump target expires");
+    check(!entry.is_scheduled(), "the expired entry is off the wheel");
+}
+
+int main()
+{
+    test_fresh_wheel_at_epoch();
+    test_jump_expires_due_entries();
+
+    if (0 != failures) {
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "timing_wheel: OK" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,255 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <zepass/decoder.hh>
+#include <zepass/profiler.hh>
+#include <zepass/types.hh>
+
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <complex>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+#include <fftw3.h>
+
+namespace po = boost::program_options;
+namespace z = zepass;
+
+typedef std::chrono::steady_clock bench_clock;
+
+///
+/// \brief A synthetic transponder: a random 256 bit frame, Manchester coded and on/off
+///        keyed at 500kbps, at a fixed offset from the centre frequency. The frames
+///        don't carry a valid CRC, so every pass integrates and attempts to decode
+///        until it is thrown away, which is the decoder's most expensive case.
+///
+struct synthetic_tag {
+    std::bitset<256> bits;
+    double freq_delta;
+    size_t nr_left;
+};
+
+/// Add a tag's response to an interval, starting 30 microseconds in.
+static
+void render_tag(synthetic_tag const& tag, z::sample_t* const buf, size_t const nr_samples,
+                z::freq_t const sampling_rate, double const amplitude, double const phase)
+{
+    size_t const samples_per_bit = sampling_rate/500000;
+    size_t const start = sampling_rate * 30/1000000;
+
+    for (size_t bit = 0; bit < tag.bits.size(); bit++) {
+        for (size_t s = 0; s < samples_per_bit; s++) {
+            // A 1 is high then low, a 0 is low then high
+            bool const high = tag.bits[bit] == (s < samples_per_bit/2);
+            size_t const i = start + bit * samples_per_bit + s;
+
+            if (i >= nr_samples) {
+                return;
+            }
+
+            if (high) {
+                buf[i] += std::polar(amplitude, phase + 2.0 * M_PI * tag.freq_delta * double(i)/double(sampling_rate));
+            }
+        }
+    }
+}
+
+/// Return the given percentile of a set of timings, in microseconds.
+static
+double percentile(std::vector<double> timings, double const pct)
+{
+    auto nth = timings.begin() + size_t(pct/100.0 * double(timings.size() - 1));
+    std::nth_element(timings.begin(), nth, timings.end());
+    return *nth;
+}
+
+int main(int const argc, char const* const argv[])
+{
+    po::options_description desc("Options");
+
+    desc.add_options()
+        ("help,h", "Get some help (this screen)")
+        ("sample-rate,s", po::value<z::freq_t>()->default_value(3000000), "Sample rate to benchmark, in samples per second")
+        ("fft-len", po::value<size_t>()->default_value(0), "FFT length, or 0 for the next power of two up from the interval")
+        ("intervals,n", po::value<size_t>()->default_value(2000), "Number of intervals to time")
+        ("tags,t", po::value<size_t>()->default_value(4), "Number of transponders present in every interval")
+        ("amplitude,a", po::value<double>()->default_value(1.0), "Transponder amplitude relative to the noise, at 3Msps")
+        ("pulse-spacing,p", po::value<std::uint64_t>()->default_value(25), "Pulse interval the budget is measured against, in milliseconds")
+        ("decode-budget", po::value<double>()->default_value(0.0), "Share of the pulse spacing, in percent, an interval may take before work is shed, 0 for no limit")
+        ("profile", "Count cycles, instructions, cache and branch misses in each decoder stage")
+        ;
+
+    po::variables_map args;
+    po::store(po::parse_command_line(argc, argv, desc), args);
+    po::notify(args);
+
+    if (args.count("help")) {
+        std::cout << "Usage: " << argv[0] << " [options]" << std::endl;
+        std::cout << desc << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    z::freq_t const sample_rate = args["sample-rate"].as<z::freq_t>();
+    size_t const nr_intervals = args["intervals"].as<size_t>();
+    size_t const nr_tags = args["tags"].as<size_t>();
+    // Noise power grows with the capture bandwidth while a transponder's doesn't, so
+    // keep the energy per bit the same at every rate
+    double const amplitude = args["amplitude"].as<double>() * std::sqrt(3000000.0/double(sample_rate));
+    double const spacing = double(args["pulse-spacing"].as<std::uint64_t>() * 1000);
+    size_t const interval_len = 580;
+
+    if (0 == nr_intervals) {
+        std::cerr << "Need at least one interval to time" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::unique_ptr<z::decoder> decoder;
+    try {
+        decoder = std::make_unique<z::decoder>(915750000, sample_rate, interval_len, 100000, 1, nullptr, 64,
+                args["fft-len"].as<size_t>());
+        decoder->set_budget(spacing * args["decode-budget"].as<double>()/100.0);
+    } catch (std::exception const& e) {
+        std::cerr << "Invalid decoder configuration: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    z::profiler::ptr_t profiler;
+    if (args.count("profile")) {
+        try {
+            profiler = std::make_shared<z::profiler>(nr_intervals);
+        } catch (std::exception const& e) {
+            std::cerr << "Failed to start the profiler: " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        decoder->set_profiler(profiler);
+    }
+
+    size_t const nr_samples = decoder->get_required_input_samples();
+    size_t const fft_len = decoder->get_fft_len();
+
+    std::mt19937 rng(1);
+    std::normal_distribution<double> noise(0.0, std::sqrt(0.5));
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    // Each tag sticks around for a while, then is replaced by a new one elsewhere in the band
+    auto new_tag = [&](synthetic_tag& tag) {
+        for (size_t i = 0; i < tag.bits.size(); i++) {
+            tag.bits[i] = rng() & 1;
+        }
+        tag.freq_delta = (uniform(rng) - 0.5) * 0.8 * double(sample_rate);
+        tag.nr_left = 20 + rng() % 40;
+    };
+
+    std::vector<synthetic_tag> tags(nr_tags);
+    for (auto& tag : tags) {
+        new_tag(tag);
+    }
+
+    std::vector<double> timings;
+    timings.reserve(nr_intervals);
+
+    for (size_t interval = 0; interval < nr_intervals; interval++) {
+        z::sample_t* const buf = decoder->get_sample_buffer();
+
+        for (size_t i = 0; i < nr_samples; i++) {
+            buf[i] = z::sample_t(noise(rng), noise(rng));
+        }
+
+        for (auto& tag : tags) {
+            render_tag(tag, buf, nr_samples, sample_rate, amplitude, 2.0 * M_PI * uniform(rng));
+            if (0 == --tag.nr_left) {
+                new_tag(tag);
+            }
+        }
+
+        auto const start = bench_clock::now();
+        decoder->process_data(z::wallclock_t(interval * spacing));
+        auto const end = bench_clock::now();
+
+        timings.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+    }
+
+    z::decoder_stats const stats = decoder->get_stats();
+    decoder.reset();
+
+    // Time the FFT on its own, with the same plan the decoder uses
+    std::vector<double> fft_timings;
+    fft_timings.reserve(nr_intervals);
+    {
+        fftw_complex* in = reinterpret_cast<fftw_complex*>(fftw_malloc(sizeof(fftw_complex) * fft_len));
+        fftw_complex* out = reinterpret_cast<fftw_complex*>(fftw_malloc(sizeof(fftw_complex) * fft_len));
+        fftw_plan plan = fftw_plan_dft_1d(int(fft_len), in, out, FFTW_FORWARD, FFTW_MEASURE | FFTW_PRESERVE_INPUT);
+
+        for (size_t i = 0; i < fft_len; i++) {
+            in[i][0] = i < nr_samples ? noise(rng) : 0.0;
+            in[i][1] = i < nr_samples ? noise(rng) : 0.0;
+        }
+
+        for (size_t interval = 0; interval < nr_intervals; interval++) {
+            auto const start = bench_clock::now();
+            fftw_execute(plan);
+            auto const end = bench_clock::now();
+
+            fft_timings.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+        }
+
+        fftw_destroy_plan(plan);
+        fftw_free(in);
+        fftw_free(out);
+    }
+
+    double const mean = std::accumulate(timings.begin(), timings.end(), 0.0)/double(nr_intervals);
+    double const p99 = percentile(timings, 99.0);
+    double const fft_mean = std::accumulate(fft_timings.begin(), fft_timings.end(), 0.0)/double(nr_intervals);
+
+    std::cout << "Sample rate: " << sample_rate << " samples/sec, " << nr_samples << " samples per interval, "
+        << fft_len << " point FFT" << std::endl;
+    std::cout << "Intervals: " << nr_intervals << " with " << nr_tags << " transponders, "
+        << stats.nr_passes << " passes created" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Per interval: mean " << mean << "us, p99 " << p99 << "us (FFT mean " << fft_mean
+        << "us, everything else " << mean - fft_mean << "us)" << std::endl;
+    std::cout << std::setprecision(2);
+    std::cout << "Budget: " << 100.0 * mean/spacing << "% mean, " << 100.0 * p99/spacing
+        << "% p99 of a " << spacing/1000.0 << "ms pulse spacing" << std::endl;
+    if (0 != stats.nr_overruns) {
+        std::cout << "Over budget: " << stats.nr_overruns << " intervals, " << stats.nr_shed << " peaks shed, "
+            << stats.nr_deferred << " decodes deferred" << std::endl;
+    }
+    if (nullptr != profiler) {
+        std::cout << profiler->get_total();
+        if (nullptr != profiler->get_failure()) {
+            std::cerr << "Profiling stopped part way through the run: " << profiler->get_failure() << std::endl;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
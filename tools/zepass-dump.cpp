@@ -0,0 +1,110 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <zepass/record.hh>
+#include <zepass/serializer.hh>
+
+#include <boost/program_options.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <cstdlib>
+#include <cstring>
+
+namespace po = boost::program_options;
+
+int main(int const argc, char const* const argv[])
+{
+    po::options_description desc("Options"),
+                            hidden("Hidden");
+
+    desc.add_options()
+        ("help,h", "Get some help (this screen)")
+        ;
+
+    hidden.add_options()
+        ("input-file", po::value<std::string>()->default_value("-"), "Input file");
+
+    po::positional_options_description popt;
+    popt.add("input-file", 1);
+
+    po::options_description all_desc;
+    all_desc.add(desc).add(hidden);
+
+    po::variables_map args;
+    po::store(po::command_line_parser(argc, argv)
+            .options(all_desc)
+            .positional(popt)
+            .run(), args);
+    po::notify(args);
+
+    if (args.count("help")) {
+        std::cout << "Usage: " << argv[0] << " [options] [binary output file, or - for stdin]" << std::endl;
+        std::cout << desc << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    std::string input_file = args["input-file"].as<std::string>();
+    std::ifstream file;
+    std::istream* in = &std::cin;
+
+    if (input_file != "-") {
+        file.open(input_file, std::ifstream::binary);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open " << input_file << ", aborting." << std::endl;
+            return EXIT_FAILURE;
+        }
+        in = &file;
+    }
+
+    zepass::record_serializer serializer;
+    std::vector<char> buf(64 * 1024);
+    char line[zepass::record_serializer::max_json_len + 1];
+    size_t nr_held = 0;
+
+    while (*in) {
+        in->read(buf.data() + nr_held, buf.size() - nr_held);
+        nr_held += in->gcount();
+
+        size_t offs = 0;
+        zepass::read_record rec;
+
+        while (size_t const used = serializer.read_binary(buf.data() + offs, nr_held - offs, rec)) {
+            size_t len = serializer.write_json(rec, line, sizeof(line));
+            line[len++] = '\n';
+            std::cout.write(line, len);
+            offs += used;
+        }
+
+        // Keep the start of a record that straddles the end of what was read
+        std::memmove(buf.data(), buf.data() + offs, nr_held - offs);
+        nr_held -= offs;
+    }
+
+    std::cout.flush();
+
+    if (0 != nr_held) {
+        std::cerr << "Ignoring " << nr_held << " bytes of truncated record at the end of the input" << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <shm/reader.hh>
+#include <zepass/record.hh>
+#include <zepass/serializer.hh>
+
+#include <boost/program_options.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+
+namespace po = boost::program_options;
+
+static volatile bool running = true;
+
+void handle_sigint(int)
+{
+    running = false;
+}
+
+int main(int const argc, char const* const argv[])
+{
+    po::options_description desc("Options");
+
+    desc.add_options()
+        ("help,h", "Get some help (this screen)")
+        ("ring,r", po::value<std::string>()->default_value("zepassd"), "Name of the shared memory ring to read")
+        ("from-oldest,o", "Start from the oldest read still in the ring, rather than new reads only")
+        ("poll,p", po::value<size_t>()->default_value(1000), "How long to sleep when there are no new reads, in microseconds")
+        ;
+
+    po::variables_map args;
+    po::store(po::parse_command_line(argc, argv, desc), args);
+    po::notify(args);
+
+    if (args.count("help")) {
+        std::cout << "Usage: " << argv[0] << " [options]" << std::endl;
+        std::cout << desc << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    std::string ring_name = args["ring"].as<std::string>();
+    std::chrono::microseconds poll(args["poll"].as<size_t>());
+    std::unique_ptr<shm::ring_reader> reader;
+
+    try {
+        reader = std::make_unique<shm::ring_reader>(ring_name, !!args.count("from-oldest"));
+    } catch (std::exception const& e) {
+        std::cerr << "Failed to attach to ring [" << ring_name << "]: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::signal(SIGINT, &handle_sigint);
+
+    zepass::record_serializer serializer;
+    char line[zepass::record_serializer::max_json_len + 1];
+    std::uint64_t nr_lost = 0;
+
+    while (running) {
+        zepass::read_record const* rec = reader->peek();
+
+        if (nullptr == rec) {
+            std::this_thread::sleep_for(poll);
+            continue;
+        }
+
+        // Snapshot the record, and only trust it if it was intact throughout
+        zepass::read_record copy = *rec;
+        if (reader->consume()) {
+            size_t len = serializer.write_json(copy, line, sizeof(line));
+            line[len++] = '\n';
+            std::cout.write(line, len).flush();
+        }
+
+        if (nr_lost != reader->get_overrun_count()) {
+            nr_lost = reader->get_overrun_count();
+            std::cerr << "Fell behind, " << nr_lost << " read(s) lost so far" << std::endl;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
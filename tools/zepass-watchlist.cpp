@@ -0,0 +1,189 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <zepass/watchlist.hh>
+
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace po = boost::program_options;
+namespace z = zepass;
+
+/// Parse an unsigned decimal field ending at a comma or the end of the string.
+/// \return The character after the field, or null if it isn't a number no more than max
+static
+char const* parse_field(char const* p, std::uint64_t const max, std::uint64_t& value)
+{
+    value = 0;
+    char const* const start = p;
+
+    while (*p >= '0' && *p <= '9') {
+        value = value * 10 + unsigned(*p - '0');
+        if (value > max) {
+            return nullptr;
+        }
+        p++;
+    }
+
+    if (p == start || (*p != ',' && *p != '\0')) {
+        return nullptr;
+    }
+
+    return p;
+}
+
+/// Read agency,serial,list lines from a stream into entries, naming lists as they turn up.
+/// \return false if the input is malformed, having said why
+static
+bool read_entries(std::istream& in, std::string const& name, std::vector<z::watchlist::entry>& entries,
+                  std::vector<std::string>& list_names)
+{
+    std::string line;
+    size_t line_nr = 0;
+
+    while (std::getline(in, line)) {
+        line_nr++;
+
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::uint64_t agency_id, serial_num;
+        char const* p = parse_field(line.c_str(), 0xffff, agency_id);
+        if (nullptr != p && *p == ',') {
+            p = parse_field(p + 1, 0xffffffff, serial_num);
+        } else {
+            p = nullptr;
+        }
+
+        if (nullptr == p || *p != ',' || p[1] == '\0') {
+            std::cerr << name << ":" << line_nr << ": expected agency,serial,list" << std::endl;
+            return false;
+        }
+
+        std::string const list(p + 1);
+        auto it = std::find(list_names.begin(), list_names.end(), list);
+        if (it == list_names.end()) {
+            if (z::watchlist::max_lists == list_names.size()) {
+                std::cerr << name << ":" << line_nr << ": more than " << z::watchlist::max_lists <<
+                    " lists" << std::endl;
+                return false;
+            }
+            it = list_names.insert(list_names.end(), list);
+        }
+
+        entries.push_back(z::watchlist::entry{ std::uint16_t(agency_id), std::uint32_t(serial_num),
+                std::uint8_t(1u << (it - list_names.begin())) });
+    }
+
+    return true;
+}
+
+int main(int const argc, char const* const argv[])
+{
+    po::options_description desc("Options"),
+                            hidden("Hidden");
+
+    desc.add_options()
+        ("help,h", "Get some help (this screen)")
+        ("output,o", po::value<std::string>(), "Index file to write")
+        ;
+
+    hidden.add_options()
+        ("input-file", po::value<std::vector<std::string>>(), "Input files");
+
+    po::positional_options_description popt;
+    popt.add("input-file", -1);
+
+    po::options_description all_desc;
+    all_desc.add(desc).add(hidden);
+
+    po::variables_map args;
+    po::store(po::command_line_parser(argc, argv)
+            .options(all_desc)
+            .positional(popt)
+            .run(), args);
+    po::notify(args);
+
+    if (args.count("help") || !args.count("output")) {
+        std::cout << "Usage: " << argv[0] << " -o [index file] [agency,serial,list CSV files, or - for stdin]" <<
+            std::endl;
+        std::cout << desc << std::endl;
+        return args.count("help") ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    std::vector<std::string> inputs = { "-" };
+    if (args.count("input-file")) {
+        inputs = args["input-file"].as<std::vector<std::string>>();
+    }
+
+    std::vector<z::watchlist::entry> entries;
+    std::vector<std::string> list_names;
+
+    for (auto const& input: inputs) {
+        bool ok;
+
+        if (input == "-") {
+            ok = read_entries(std::cin, "stdin", entries, list_names);
+        } else {
+            std::ifstream in(input);
+            if (!in.is_open()) {
+                std::cerr << "Failed to open " << input << ", aborting." << std::endl;
+                return EXIT_FAILURE;
+            }
+            ok = read_entries(in, input, entries, list_names);
+        }
+
+        if (!ok) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::string const output = args["output"].as<std::string>();
+
+    try {
+        z::watchlist::build(output, std::move(entries), list_names);
+
+        // Read it back, as the daemon will
+        z::watchlist const list(output);
+        std::cout << "Wrote " << list.get_nr_keys() << " tags to [" << output << "]" << std::endl;
+        for (size_t i = 0; i < list.get_nr_lists(); i++) {
+            std::cout << "    list " << i << " (watchlists bit " << (1u << i) << "): " << list.get_list_name(i) <<
+                std::endl;
+        }
+    } catch (std::exception const& e) {
+        std::cerr << "Failed to build " << output << ": " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -21,16 +21,22 @@
 #include <zepass/types.hh>
 #include <zepass/priv.hh>
 
+#include <uhd/exception.hpp>
 #include <uhd/usrp/multi_usrp.hpp>
 #include <uhd/utils/thread_priority.hpp>
 
+#include <algorithm>
+#include <chrono>
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <iostream>
 #include <iomanip>
 #include <complex>
+#include <thread>
 
 #include <cmath>
+#include <ctime>
 
 using namespace usrp;
 
@@ -49,11 +55,25 @@ struct usrp_controller::usrp_controller_impl {
                          double const rx_gain,
                          size_t const rx_len_us,
                          size_t const activation_len_us,
-                         bool const use_pps);
+                         bool const use_pps,
+                         size_t const nr_rx_channels);
     ~usrp_controller_impl();
 
-    z::wallclock_t arm_and_fire(z::sample_t* target_buffer, z::wallclock_t const delay);
+    z::wallclock_t arm_and_fire(z::sample_t* target_buffer, z::wallclock_t const delay, size_t const channel_stride);
+    void recover(stream_error const& error);
+    recovery_stats get_recovery_stats() const { return m_stats; }
+    void set_tx_gain(double const gain);
+    void set_rx_gain(double const gain);
+    void set_activation_len(size_t const activation_len_us);
+    void set_center_freq(size_t const center_freq);
 private:
+    void build_pulse(size_t const activation_len_us);
+    void open_device();
+    void open_streams();
+    void sync_time();
+    void flush_streams();
+    z::wallclock_t receive(z::sample_t* target_buffer, z::wallclock_t const delay, size_t const channel_stride);
+
     uhd::usrp::multi_usrp::sptr m_usrp;
     std::string m_device_id;
     size_t m_center_freq;
@@ -70,6 +90,8 @@ private:
     size_t m_samples_per_interval;
     size_t m_tx_center_freq;
     size_t m_rx_center_freq;
+    size_t m_nr_rx_channels; //< Phase-coherent receive channels, one for each subdevice in the RX port spec
+    bool m_retune = false; //< Whether the front ends are due to be tuned to the center frequency
 
     uhd::tx_streamer::sptr m_tx_stream;
     uhd::rx_streamer::sptr m_rx_stream;
@@ -83,6 +105,13 @@ private:
     size_t m_pulse_samps;
 
     bool m_use_pps; //< Whether or not to use the GPS PPS signal port
+
+    std::vector<std::complex<double>> m_flush_buf; //< Somewhere to drain stale samples into
+    uhd::time_spec_t m_last_rx_time; //< Device time of the last interval received
+    std::chrono::steady_clock::time_point m_last_rx_at; //< Host time of the last interval received
+    std::chrono::steady_clock::time_point m_failed_at; //< When the current outage started
+    size_t m_nr_failures = 0; //< Consecutive failures since the last interval received
+    recovery_stats m_stats; //< Running recovery counters
 };
 
 usrp_controller::usrp_controller_impl::usrp_controller_impl(std::string const& device_id,
@@ -97,7 +126,8 @@ usrp_controller::usrp_controller_impl::usrp_controller_impl(std::string const& d
                                                             double const rx_gain,
                                                             size_t const rx_len_us,
                                                             size_t const activation_len_us,
-                                                            bool const use_pps)
+                                                            bool const use_pps,
+                                                            size_t const nr_rx_channels)
     : m_device_id(device_id),
       m_center_freq(center_freq),
       m_tx_port_id(tx_port_id),
@@ -110,18 +140,11 @@ usrp_controller::usrp_controller_impl::usrp_controller_impl(std::string const& d
       m_rx_gain(rx_gain),
       m_rx_len_us(rx_len_us),
       m_activation_len_us(activation_len_us),
+      m_nr_rx_channels(nr_rx_channels),
       m_use_pps(use_pps)
 {
     uhd::set_thread_priority_safe();
 
-    m_usrp = uhd::usrp::multi_usrp::make(m_device_id);
-    m_usrp->set_tx_rate(m_tx_rate);
-    std::cout << "Requested TX rate: " << std::fixed << double(tx_rate)/1e6 << "Msps got " <<
-        double(m_usrp->get_tx_rate())/1e6 << "Msps" << std::endl;
-    m_usrp->set_rx_rate(m_rx_rate);
-    std::cout << "Requested RX rate: " << std::fixed << double(rx_rate)/1e6 << "Msps got " <<
-        double(m_usrp->get_rx_rate())/1e6 << "Msps" << std::endl;
-
     m_samples_per_interval = size_t(double(rx_rate) * z::priv::us_to_sec(m_rx_len_us));
     std::cout << "Samples in " << rx_len_us << " microsecond interval: " << m_samples_per_interval << std::endl;
 
@@ -131,20 +154,71 @@ usrp_controller::usrp_controller_impl::usrp_controller_impl(std::string const& d
     m_tx_center_freq = m_center_freq + 200000;
     m_rx_center_freq = m_center_freq;
 
+    open_device();
+
+    build_pulse(m_activation_len_us);
+    m_rx_buff.resize(m_nr_rx_channels, NULL);
+    m_flush_buf.resize(m_samples_per_interval * m_nr_rx_channels);
+
+    if (m_use_pps) {
+        std::cout << "Time sources: " << std::endl;
+        for (auto &ts : m_usrp->get_time_sources(0)) {
+            std::cout << "    " << ts << std::endl;
+        }
+    }
+
+    sync_time();
+    std::cout << "Time is: " << std::fixed << m_usrp->get_time_now().get_real_secs() << std::endl;
+}
+
+usrp_controller::usrp_controller_impl::~usrp_controller_impl()
+{
+}
+
+/// Open the device, and set up its rates, front ends and streamers.
+void usrp_controller::usrp_controller_impl::open_device()
+{
+    m_usrp = uhd::usrp::multi_usrp::make(m_device_id);
+    m_usrp->set_tx_rate(m_tx_rate);
+    std::cout << "Requested TX rate: " << std::fixed << double(m_tx_rate)/1e6 << "Msps got " <<
+        double(m_usrp->get_tx_rate())/1e6 << "Msps" << std::endl;
+    m_usrp->set_rx_rate(m_rx_rate);
+    std::cout << "Requested RX rate: " << std::fixed << double(m_rx_rate)/1e6 << "Msps got " <<
+        double(m_usrp->get_rx_rate())/1e6 << "Msps" << std::endl;
+
+    // The decoder and the activation pulse are built for exactly the requested rates
+    if (std::fabs(m_usrp->get_tx_rate() - double(m_tx_rate)) > 1.0) {
+        throw std::runtime_error("radio can't transmit at the requested sample rate");
+    }
+
+    if (std::fabs(m_usrp->get_rx_rate() - double(m_rx_rate)) > 1.0) {
+        throw std::runtime_error("radio can't receive at the requested sample rate");
+    }
+
     std::cout << "Tuning transmit front-end to " << std::fixed << double(m_tx_center_freq) << "MHz" << std::endl;
 
     // Set up the front end routing and state.
     uhd::tune_request_t tx_tune(m_tx_center_freq);
     m_usrp->set_tx_subdev_spec(m_tx_port_id, 0);
     m_usrp->set_tx_antenna(m_tx_ant_id, 0);
-    m_usrp->set_tx_gain(tx_gain, 0);
+    m_usrp->set_tx_gain(m_tx_gain, 0);
     m_usrp->set_tx_freq(tx_tune, 0);
 
+    // Each subdevice in the RX port spec is a receive channel; for diversity, they all
+    // get the same antenna port, gain and frequency
     uhd::tune_request_t rx_tune(m_rx_center_freq);
     m_usrp->set_rx_subdev_spec(m_rx_port_id, 0);
-    m_usrp->set_rx_antenna(m_rx_ant_id, 0);
-    m_usrp->set_rx_gain(rx_gain, 0);
-    m_usrp->set_rx_freq(rx_tune, 0);
+
+    if (m_usrp->get_rx_num_channels() < m_nr_rx_channels) {
+        throw std::runtime_error("radio has fewer receive channels than requested, the RX port needs a subdevice for each");
+    }
+
+    for (size_t c = 0; c < m_nr_rx_channels; c++) {
+        m_usrp->set_rx_antenna(m_rx_ant_id, c);
+        m_usrp->set_rx_gain(m_rx_gain, c);
+        m_usrp->set_rx_freq(rx_tune, c);
+    }
+    m_retune = false;
 
     std::cout << "TX Channel specs: " << std::endl;
     for (size_t i = 0; i < m_usrp->get_tx_num_channels(); i++) {
@@ -156,9 +230,39 @@ usrp_controller::usrp_controller_impl::usrp_controller_impl(std::string const& d
         std::cout << "    " << m_usrp->get_rx_subdev_name(i) << std::endl;
     }
 
+    open_streams();
+}
+
+/// Set the device time from the host clock, so interval wallclocks (and the times
+/// reads are stamped with) are in microseconds since the epoch. With PPS, the next
+/// whole second is latched on the next pulse.
+void usrp_controller::usrp_controller_impl::sync_time()
+{
+    std::chrono::duration<double> const host = std::chrono::system_clock::now().time_since_epoch();
+    std::time_t const secs = std::time_t(host.count());
+
+    if (m_use_pps) {
+        m_usrp->set_time_next_pps(uhd::time_spec_t(secs + 1, 0.0));
+        // Wait for the pulse to pass, so nothing is scheduled against the old time
+        std::this_thread::sleep_for(std::chrono::duration<double>(double(secs) + 1.2 - host.count()));
+    } else {
+        m_usrp->set_time_now(uhd::time_spec_t(secs, host.count() - double(secs)));
+    }
+}
+
+/// Create the receive and transmit streamers, replacing any existing ones.
+void usrp_controller::usrp_controller_impl::open_streams()
+{
+    // Let go of the old streamers first, so their transports are released
+    m_rx_stream.reset();
+    m_tx_stream.reset();
+
     // Set up the RX streamer
     uhd::stream_args_t rx_stream_args("fc64");
-    rx_stream_args.channels = { 0 };
+    rx_stream_args.channels.clear();
+    for (size_t c = 0; c < m_nr_rx_channels; c++) {
+        rx_stream_args.channels.push_back(c);
+    }
 
     m_rx_stream = m_usrp->get_rx_stream(rx_stream_args);
 
@@ -167,50 +271,110 @@ usrp_controller::usrp_controller_impl::usrp_controller_impl(std::string const& d
     tx_stream_args.channels = { 0 };
 
     m_tx_stream = m_usrp->get_tx_stream(tx_stream_args);
+}
 
-    // Create frequency shifted sinusoid for the trigger pulse
-    m_pulse_samps = z::priv::us_to_sec(m_activation_len_us) * double(m_tx_rate);
-    std::cout << "Pulse is " << m_pulse_samps << " samples long" << std::endl;
+/// Create the frequency shifted sinusoid for the trigger pulse.
+void usrp_controller::usrp_controller_impl::build_pulse(size_t const activation_len_us)
+{
+    size_t pulse_samps = z::priv::us_to_sec(activation_len_us) * double(m_tx_rate);
+    std::cout << "Pulse is " << pulse_samps << " samples long" << std::endl;
 
-    if (m_tx_stream->get_max_num_samps() < m_pulse_samps) {
+    if (m_tx_stream->get_max_num_samps() < pulse_samps) {
         throw std::range_error("pulse length is too long!");
     }
 
+    if (pulse_samps < 2) {
+        throw std::range_error("pulse length is too short!");
+    }
+
+    m_activation_len_us = activation_len_us;
+    m_pulse_samps = pulse_samps;
+
     double time_delta = z::priv::us_to_sec(m_activation_len_us)/(m_pulse_samps - 1);
-    m_tx_buf.resize(m_pulse_samps, 0.0);
+    m_tx_buf.assign(m_pulse_samps, 0.0);
     for (size_t i = 0; i < m_pulse_samps; i++) {
         m_tx_buf[i] = std::complex<float>(0.9, 0.9) *
             std::exp(std::complex<float>(0.0, -2.0 * M_PI * double(200000) * double(i) * time_delta));
     }
-    m_tx_buff.resize(1, &m_tx_buf.front());
-    m_rx_buff.resize(1, NULL);
+    m_tx_buff.assign(1, &m_tx_buf.front());
+}
+
+/// Change the transmit gain, effective from the next activation. If the device is
+/// closed, waiting to be reopened, the gain is applied when it is.
+void usrp_controller::usrp_controller_impl::set_tx_gain(double const gain)
+{
+    if (nullptr == m_usrp) {
+        m_tx_gain = gain;
+        std::cout << "TX gain will be " << std::fixed << m_tx_gain << "dB once the radio is reopened" << std::endl;
+        return;
+    }
 
-    if (m_use_pps) {
-        std::cout << "Time sources: " << std::endl;
-        for (auto &ts : m_usrp->get_time_sources(0)) {
-            std::cout << "    " << ts << std::endl;
-        }
+    m_usrp->set_tx_gain(gain, 0);
+    m_tx_gain = m_usrp->get_tx_gain(0);
+    std::cout << "TX gain is now " << std::fixed << m_tx_gain << "dB" << std::endl;
+}
 
-        uhd::time_spec_t cur_time = m_usrp->get_time_now();
-        std::cout << "Time is: " << cur_time.get_real_secs() << std::endl;
+/// Change the receive gain of every receive channel, effective from the next activation.
+/// If the device is closed, waiting to be reopened, the gain is applied when it is.
+void usrp_controller::usrp_controller_impl::set_rx_gain(double const gain)
+{
+    if (nullptr == m_usrp) {
+        m_rx_gain = gain;
+        std::cout << "RX gain will be " << std::fixed << m_rx_gain << "dB once the radio is reopened" << std::endl;
+        return;
+    }
+
+    for (size_t c = 0; c < m_nr_rx_channels; c++) {
+        m_usrp->set_rx_gain(gain, c);
     }
+    m_rx_gain = m_usrp->get_rx_gain(0);
+    std::cout << "RX gain is now " << std::fixed << m_rx_gain << "dB" << std::endl;
 }
 
-usrp_controller::usrp_controller_impl::~usrp_controller_impl()
+/// Change the length of the activation pulse, effective from the next activation.
+/// The receive window moves out to follow the end of the pulse.
+void usrp_controller::usrp_controller_impl::set_activation_len(size_t const activation_len_us)
 {
+    build_pulse(activation_len_us);
+}
+
+/// Change the center frequency, effective from the next activation. Both front ends
+/// are tuned by timed commands, in the idle time before the pulse.
+void usrp_controller::usrp_controller_impl::set_center_freq(size_t const center_freq)
+{
+    m_center_freq = center_freq;
+    m_tx_center_freq = m_center_freq + 200000;
+    m_rx_center_freq = m_center_freq;
+    m_retune = true;
 }
 
-z::wallclock_t usrp_controller::usrp_controller_impl::arm_and_fire(z::sample_t* target_buffer, z::wallclock_t const pulse_delay)
+/// Send the activation pulse and receive the following interval, every receive
+/// channel at once, channel_stride samples apart in the target buffer.
+/// \throw stream_error if the radio didn't do as it was told
+z::wallclock_t usrp_controller::usrp_controller_impl::receive(z::sample_t* target_buffer, z::wallclock_t const pulse_delay,
+                                                              size_t const channel_stride)
 {
     uhd::stream_cmd_t rx_cmd(uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_DONE);
     uhd::rx_metadata_t rx_md;
 
-    m_rx_buff[0] = target_buffer;
+    for (size_t c = 0; c < m_nr_rx_channels; c++) {
+        m_rx_buff[c] = target_buffer + c * channel_stride;
+    }
 
     // Get the commands queued up (with fuuuuudge)
     auto start_of_epoch = m_usrp->get_time_now();
     m_usrp->set_command_time(start_of_epoch + z::priv::us_to_sec(pulse_delay - 15000));
 
+    // A retune goes in with the other timed commands, so the front ends settle on the
+    // new frequency while waiting for the pulse, rather than holding up the host
+    if (m_retune) {
+        m_usrp->set_tx_freq(uhd::tune_request_t(m_tx_center_freq), 0);
+        for (size_t c = 0; c < m_nr_rx_channels; c++) {
+            m_usrp->set_rx_freq(uhd::tune_request_t(m_rx_center_freq), c);
+        }
+        m_retune = false;
+    }
+
     // Arm an m_activation_len_us microsecond pulse to transmit
     uhd::tx_metadata_t tx_md;
     tx_md.start_of_burst = true;
@@ -233,26 +397,161 @@ z::wallclock_t usrp_controller::usrp_controller_impl::arm_and_fire(z::sample_t*
     // Send the burst
     size_t sent = m_tx_stream->send(m_tx_buff, m_pulse_samps, tx_md, 1.0);
     if (sent < m_pulse_samps) {
-        throw std::runtime_error("didn't transmit enough samples, aborting");
+        throw stream_error(fault::stream, "didn't transmit enough samples");
     }
 
     // Kick off the receive operation
     size_t received = m_rx_stream->recv(m_rx_buff, m_samples_per_interval, rx_md, 1.0);
-    if (received < m_samples_per_interval) {
-        std::cout << "Got " << received << " samples" << std::endl;
+    if (rx_md.error_code != uhd::rx_metadata_t::ERROR_CODE_NONE) {
+        std::cout << "Transmit time was: " << rx_cmd.time_spec.get_real_secs() << std::endl;
         std::cout << "Receive metadata was: " << rx_md.to_pp_string(false) << std::endl;
-        throw std::runtime_error("didn't receive enough samples, aborting.");
+
+        switch (rx_md.error_code) {
+        case uhd::rx_metadata_t::ERROR_CODE_TIMEOUT:
+        case uhd::rx_metadata_t::ERROR_CODE_LATE_COMMAND:
+        case uhd::rx_metadata_t::ERROR_CODE_OVERFLOW:
+            throw stream_error(fault::transient, rx_md.strerror());
+        default:
+            throw stream_error(fault::stream, rx_md.strerror());
+        }
     }
 
-    if (rx_md.error_code != uhd::rx_metadata_t::ERROR_CODE_NONE) {
-        std::cout << "Transmit time was: " << rx_cmd.time_spec.get_real_secs() << std::endl;
+    if (received < m_samples_per_interval) {
+        std::cout << "Got " << received << " samples" << std::endl;
         std::cout << "Receive metadata was: " << rx_md.to_pp_string(false) << std::endl;
-        throw std::runtime_error(rx_md.strerror());
+        throw stream_error(fault::transient, "didn't receive enough samples");
     }
 
+    m_last_rx_time = rx_md.time_spec;
+
     return z::wallclock_t(rx_md.time_spec.get_real_secs() * 1000000.0);
 }
 
+/// Send the activation pulse and receive the following interval, turning any failure
+/// of the device into a stream_error, and closing out any outage in progress.
+z::wallclock_t usrp_controller::usrp_controller_impl::arm_and_fire(z::sample_t* target_buffer, z::wallclock_t const pulse_delay,
+                                                                   size_t const channel_stride)
+{
+    // The channels would overwrite one another
+    if (1 < m_nr_rx_channels && channel_stride < m_samples_per_interval) {
+        throw std::invalid_argument("channel_stride");
+    }
+
+    if (nullptr == m_usrp || nullptr == m_rx_stream || nullptr == m_tx_stream) {
+        throw stream_error(fault::device, "radio is not open");
+    }
+
+    z::wallclock_t at;
+
+    try {
+        at = receive(target_buffer, pulse_delay, channel_stride);
+    } catch (uhd::exception const& e) {
+        throw stream_error(fault::device, e.what());
+    }
+
+    m_last_rx_at = std::chrono::steady_clock::now();
+
+    if (0 != m_nr_failures) {
+        std::chrono::duration<double> const blind = m_last_rx_at - m_failed_at;
+
+        m_stats.blind_secs += blind.count();
+        m_stats.longest_blind_secs = std::max(m_stats.longest_blind_secs, blind.count());
+        m_nr_failures = 0;
+
+        std::cout << "Radio recovered after " << std::fixed << blind.count() <<
+            " seconds" << std::endl;
+    }
+
+    return at;
+}
+
+/// Drop whatever is queued on the device or buffered on the host, so the next
+/// activation starts from a clean slate.
+void usrp_controller::usrp_controller_impl::flush_streams()
+{
+    m_usrp->clear_command_time();
+    m_rx_stream->issue_stream_cmd(uhd::stream_cmd_t(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS));
+
+    uhd::rx_metadata_t rx_md;
+    std::vector<std::complex<double>*> buffs(m_nr_rx_channels);
+    for (size_t c = 0; c < m_nr_rx_channels; c++) {
+        buffs[c] = m_flush_buf.data() + c * m_samples_per_interval;
+    }
+    while (0 != m_rx_stream->recv(buffs, m_samples_per_interval, rx_md, 0.05)) {
+    }
+
+    uhd::async_metadata_t async_md;
+    while (m_tx_stream->recv_async_msg(async_md, 0.0)) {
+    }
+}
+
+/// Try to get the radio streaming again after a failure, without disturbing the
+/// decoder. The remedy starts with what the error calls for, and escalates if the
+/// stream keeps failing: a few flushes, then fresh streamers, then reopening the
+/// device. Attempts after the first back off, from 10ms doubling up to 2 seconds.
+/// Call arm_and_fire() again afterwards; if it fails, call this again.
+/// \param error The error arm_and_fire() failed with
+void usrp_controller::usrp_controller_impl::recover(stream_error const& error)
+{
+    auto const now = std::chrono::steady_clock::now();
+
+    if (0 == m_nr_failures) {
+        m_failed_at = now;
+        m_stats.nr_outages++;
+    }
+
+    m_nr_failures++;
+
+    fault step = error.get_fault();
+    if (m_nr_failures > 6) {
+        step = fault::device;
+    } else if (m_nr_failures > 3 && fault::transient == step) {
+        step = fault::stream;
+    }
+
+    if (m_nr_failures > 1) {
+        size_t const backoff_ms = std::min<size_t>(2000, size_t(10) << std::min<size_t>(m_nr_failures - 2, 8));
+        std::this_thread::sleep_for(std::chrono::milliseconds(backoff_ms));
+    }
+
+    std::cerr << "Radio error: " << error.what() << " (failure " << m_nr_failures << "), " <<
+        (fault::device == step ? "reopening the device" :
+         fault::stream == step ? "recreating the streamers" : "flushing the streams") << std::endl;
+
+    try {
+        switch (step) {
+        case fault::device:
+            m_rx_stream.reset();
+            m_tx_stream.reset();
+            m_usrp.reset();
+            open_device();
+
+            // Carry on from where the old device time left off, so interval times keep
+            // increasing and live passes age properly. With no interval received yet,
+            // there's nothing to carry on from, so set it from the host clock as at startup.
+            if (std::chrono::steady_clock::time_point() != m_last_rx_at) {
+                std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - m_last_rx_at;
+                m_usrp->set_time_now(m_last_rx_time + elapsed.count());
+            } else {
+                sync_time();
+            }
+
+            m_stats.nr_reopened++;
+            break;
+        case fault::stream:
+            open_streams();
+            m_stats.nr_restreamed++;
+            break;
+        case fault::transient:
+            flush_streams();
+            m_stats.nr_flushed++;
+            break;
+        }
+    } catch (std::exception const& e) {
+        std::cerr << "Radio recovery failed: " << e.what() << std::endl;
+    }
+}
+
 /// Construct a new USRP controller. This object precisely controls the dispatch
 /// of the activation signal and the reception of the OOK message, to be fed into
 /// the zepass decoder pieces.
@@ -268,7 +567,8 @@ usrp_controller::usrp_controller(std::string const& device_id,
                                  double const rx_gain,
                                  size_t const rx_len_us,
                                  size_t const activation_len_us,
-                                 bool const use_pps)
+                                 bool const use_pps,
+                                 size_t const nr_rx_channels)
 {
     m_pimpl = std::make_unique<usrp_controller::usrp_controller_impl>(device_id,
                                                                       center_freq,
@@ -282,7 +582,8 @@ usrp_controller::usrp_controller(std::string const& device_id,
                                                                       rx_gain,
                                                                       rx_len_us,
                                                                       activation_len_us,
-                                                                      use_pps);
+                                                                      use_pps,
+                                                                      nr_rx_channels);
 }
 
 usrp_controller::~usrp_controller()
@@ -290,9 +591,62 @@ usrp_controller::~usrp_controller()
 }
 
 /// Arm the USRP to send the activation pulse, then receive signals data into the
-/// target buffer.
-z::wallclock_t usrp_controller::arm_and_fire(z::sample_t* target_buffer, z::wallclock_t const delay)
+/// target buffer. With several receive channels, channel c is written channel_stride
+/// samples after channel c - 1, so the stride must be at least an interval long; it
+/// is ignored with a single channel.
+z::wallclock_t usrp_controller::arm_and_fire(z::sample_t* target_buffer, z::wallclock_t const delay,
+                                             size_t const channel_stride)
+{
+    return m_pimpl->arm_and_fire(target_buffer, delay, channel_stride);
+}
+
+/// Change the transmit gain, in dB, without interrupting the radio.
+void usrp_controller::set_tx_gain(double const gain)
+{
+    m_pimpl->set_tx_gain(gain);
+}
+
+/// Change the receive gain, in dB, without interrupting the radio.
+void usrp_controller::set_rx_gain(double const gain)
+{
+    m_pimpl->set_rx_gain(gain);
+}
+
+/// Change the length of the activation pulse, in microseconds, without
+/// interrupting the radio.
+void usrp_controller::set_activation_len(size_t const activation_len_us)
+{
+    m_pimpl->set_activation_len(activation_len_us);
+}
+
+/// Change the center frequency, in Hz, from the next activation on. The transmit
+/// front end follows, keeping its offset.
+void usrp_controller::set_center_freq(size_t const center_freq)
 {
-    return m_pimpl->arm_and_fire(target_buffer, delay);
+    m_pimpl->set_center_freq(center_freq);
 }
 
+/// Get the radio streaming again after arm_and_fire() failed; see
+/// usrp_controller_impl::recover().
+void usrp_controller::recover(stream_error const& error)
+{
+    m_pimpl->recover(error);
+}
+
+/// Return a snapshot of the radio recovery counters.
+recovery_stats usrp_controller::get_recovery_stats() const
+{
+    return m_pimpl->get_recovery_stats();
+}
+
+std::ostream& operator<<(std::ostream& os, usrp::recovery_stats const& s)
+{
+    os << "Radio outages: " << s.nr_outages << std::endl;
+    os << "Radio recoveries by flushing the streams: " << s.nr_flushed << std::endl;
+    os << "Radio recoveries by recreating the streamers: " << s.nr_restreamed << std::endl;
+    os << "Radio recoveries by reopening the device: " << s.nr_reopened << std::endl;
+    os << "Seconds without a working radio: " << std::fixed << s.blind_secs <<
+        " (longest " << s.longest_blind_secs << ")" << std::endl;
+
+    return os;
+}
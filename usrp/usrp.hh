@@ -22,10 +22,49 @@
 #include <zepass/types.hh>
 
 #include <memory>
+#include <ostream>
+#include <stdexcept>
 #include <string>
 
 namespace usrp {
 
+///
+/// \brief How badly a radio stream has failed, and so how much has to be torn down to
+///        recover from it.
+///
+enum class fault {
+    transient, //< A late command, overflow or timeout; flush the streams and carry on
+    stream, //< The streamers are in a bad state (broken chain, bad packet, short send)
+    device, //< The device itself failed, or went away
+};
+
+///
+/// \brief An error in the radio stream, classified by what it takes to recover.
+///
+class stream_error : public std::runtime_error {
+public:
+    stream_error(fault const f, std::string const& what) : std::runtime_error(what), m_fault(f) {}
+
+    /// Return the class of failure
+    fault get_fault() const { return m_fault; }
+
+private:
+    fault m_fault; //< What it takes to recover
+};
+
+///
+/// \brief Counters describing how often the radio stream failed, and how long it took
+///        to get it back.
+///
+struct recovery_stats {
+    size_t nr_outages = 0; //< Times a working stream failed
+    size_t nr_flushed = 0; //< Recoveries that flushed the streams
+    size_t nr_restreamed = 0; //< Recoveries that recreated the streamers
+    size_t nr_reopened = 0; //< Recoveries that reopened the device
+    double blind_secs = 0.0; //< Total time without a working stream, in seconds
+    double longest_blind_secs = 0.0; //< Longest single outage, in seconds
+};
+
 class usrp_controller {
 public:
     usrp_controller(std::string const& device_id,
@@ -40,10 +79,18 @@ public:
                     double const rx_gain,
                     size_t const rx_len_us,
                     size_t const activation_len_us,
-                    bool const use_pps);
+                    bool const use_pps,
+                    size_t const nr_rx_channels = 1);
     ~usrp_controller();
 
-    zepass::wallclock_t arm_and_fire(zepass::sample_t* target_buffer, zepass::wallclock_t const delay);
+    zepass::wallclock_t arm_and_fire(zepass::sample_t* target_buffer, zepass::wallclock_t const delay,
+                                     size_t const channel_stride);
+    void recover(stream_error const& error);
+    recovery_stats get_recovery_stats() const;
+    void set_tx_gain(double const gain);
+    void set_rx_gain(double const gain);
+    void set_activation_len(size_t const activation_len_us);
+    void set_center_freq(size_t const center_freq);
 private:
     struct usrp_controller_impl;
     std::unique_ptr<usrp_controller_impl> m_pimpl;
@@ -51,3 +98,6 @@ private:
 
 } // end namespace usrp
 
+/// ostream operator to render the radio recovery counters, one per line
+std::ostream& operator<<(std::ostream& os, usrp::recovery_stats const& s);
+
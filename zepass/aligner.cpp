@@ -0,0 +1,165 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <zepass/aligner.hh>
+#include <zepass/types.hh>
+
+#include <algorithm>
+#include <complex>
+#include <limits>
+
+#include <cstddef>
+
+using namespace zepass;
+
+/// Create an aligner for intervals of the given length. It does nothing until it
+/// is given a maximum shift.
+/// \param samples_per_interval The number of samples in a capture interval
+/// \param sampling_rate The sampling rate of the input signal
+/// \param mem Arena to allocate the working space from, or null to use the heap
+aligner::aligner(size_t const samples_per_interval, freq_t const sampling_rate, arena* mem)
+    : m_samples_per_interval(samples_per_interval),
+      m_chip_len(std::max<size_t>(1, size_t(sampling_rate/500000/2))),
+      m_ref_env(samples_per_interval - std::min(samples_per_interval, m_chip_len - 1), 0.0,
+              arena_allocator<double>(mem)),
+      m_sig_env(m_ref_env.size(), 0.0, arena_allocator<double>(mem)),
+      m_shifted(samples_per_interval, 0.0, arena_allocator<sample_t>(mem))
+{
+}
+
+aligner::~aligner()
+{
+}
+
+/// Calculate the envelope of a signal, low pass filtered over one chip so the
+/// other transponders in the capture mostly cancel out, with its mean removed.
+/// \param sig The signal
+/// \param shift Vector to shift the signal to baseband, or null if it is already there
+/// \param out Where to put the envelope, m_ref_env.size() long
+void aligner::envelope(sample_t const* const sig, sample_t const* const shift, double* const out) const
+{
+    size_t const len = m_ref_env.size();
+    sample_t sum = 0.0;
+    double mean = 0.0;
+
+    auto baseband = [sig, shift](size_t const i) { return nullptr != shift ? sig[i] * shift[i] : sig[i]; };
+
+    for (size_t i = 0; i < m_chip_len - 1; i++) {
+        sum += baseband(i);
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        sum += baseband(i + m_chip_len - 1);
+        out[i] = std::abs(sum);
+        mean += out[i];
+        sum -= baseband(i);
+    }
+
+    mean /= double(len);
+
+    for (size_t i = 0; i < len; i++) {
+        out[i] -= mean;
+    }
+}
+
+/// Find how far an interval should be moved to line up with an accumulation. The
+/// envelopes are correlated at every shift up to the maximum, and the shift with
+/// the largest correlation wins. The interval is only moved if that correlation
+/// beats not moving it by more than the noise could explain: three standard
+/// deviations of the difference between the two.
+/// \param ref The accumulation, at baseband
+/// \param sig The interval
+/// \param shift Vector to shift the interval to baseband, or null if it is already there
+/// \return The offset into sig that lines up with the start of ref, or 0 to leave it be
+std::ptrdiff_t aligner::find_shift(sample_t const* const ref, sample_t const* const sig,
+                                   sample_t const* const shift)
+{
+    if (0 == m_max_shift) {
+        return 0;
+    }
+
+    envelope(ref, nullptr, m_ref_env.data());
+    envelope(sig, shift, m_sig_env.data());
+
+    std::ptrdiff_t const len = m_ref_env.size();
+    std::ptrdiff_t const max_shift = std::min<std::ptrdiff_t>(m_max_shift, len - 1);
+
+    double unmoved = 0.0,
+           ref_power = 0.0;
+
+    for (std::ptrdiff_t i = 0; i < len; i++) {
+        unmoved += m_ref_env[i] * m_sig_env[i];
+        ref_power += m_ref_env[i] * m_ref_env[i];
+    }
+
+    std::ptrdiff_t best = 0;
+    double best_margin = 0.0;
+
+    for (std::ptrdiff_t offset = -max_shift; offset <= max_shift; offset++) {
+        if (0 == offset) {
+            continue;
+        }
+
+        std::ptrdiff_t const first = std::max<std::ptrdiff_t>(0, -offset);
+        std::ptrdiff_t const last = std::min(len, len - offset);
+        double corr = 0.0,
+               diff_power = 0.0;
+
+        for (std::ptrdiff_t i = first; i < last; i++) {
+            double const diff = m_sig_env[i + offset] - m_sig_env[i];
+            corr += m_ref_env[i] * m_sig_env[i + offset];
+            diff_power += diff * diff;
+        }
+
+        // The difference from not moving is the reference correlated against
+        // the difference of the two envelopes; its spread is the product of their norms
+        double const gain = corr - unmoved;
+        double const spread = std::sqrt(ref_power * diff_power/double(last - first));
+
+        if (0.0 < gain && gain > 3.0 * spread && gain - 3.0 * spread > best_margin) {
+            best_margin = gain - 3.0 * spread;
+            best = offset;
+        }
+    }
+
+    return best;
+}
+
+/// Move an interval by the given offset, filling in the samples it no longer covers
+/// with zeros.
+/// \param sig The interval
+/// \param offset The offset into sig that should become the first sample
+/// \return The moved interval, valid until the next call, or sig itself if the offset is 0
+sample_t const* aligner::apply_shift(sample_t const* const sig, std::ptrdiff_t const offset)
+{
+    if (0 == offset) {
+        return sig;
+    }
+
+    std::ptrdiff_t const len = m_samples_per_interval;
+
+    m_nr_shifted++;
+
+    for (std::ptrdiff_t i = 0; i < len; i++) {
+        std::ptrdiff_t const from = i + offset;
+        m_shifted[i] = 0 <= from && from < len ? sig[from] : sample_t(0.0);
+    }
+
+    return m_shifted.data();
+}
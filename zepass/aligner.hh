@@ -0,0 +1,70 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <zepass/types.hh>
+#include <zepass/arena.hh>
+
+#include <cstddef>
+#include <vector>
+
+namespace zepass {
+
+///
+/// \brief Lines up each interval of a pass with what it has accumulated so far.
+/// Transponder turn-on jitter moves the response around by a few samples from one
+/// interval to the next, which smears the coherent sum. The envelope of each new
+/// interval is cross-correlated against the envelope of the accumulation, over a
+/// bounded range of shifts, and the interval is moved by the best one before it is
+/// added. A decoder's passes share one aligner, for its working space.
+///
+class aligner {
+public:
+    aligner(size_t const samples_per_interval, freq_t const sampling_rate, arena* mem = nullptr);
+    ~aligner();
+
+    /// Set the furthest an interval may be moved, in samples, or 0 to not align
+    void set_max_shift(size_t const max_shift) { m_max_shift = max_shift; }
+
+    /// Return the furthest an interval may be moved, in samples, 0 if not aligning
+    size_t get_max_shift() const { return m_max_shift; }
+
+    /// Return the number of times something has actually been moved
+    size_t get_nr_shifted() const { return m_nr_shifted; }
+
+    std::ptrdiff_t find_shift(sample_t const* const ref, sample_t const* const sig,
+                              sample_t const* const shift);
+    sample_t const* apply_shift(sample_t const* const sig, std::ptrdiff_t const offset);
+
+private:
+    void envelope(sample_t const* const sig, sample_t const* const shift, double* const out) const;
+
+    typedef std::vector<double, arena_allocator<double>> envelope_t;
+
+    size_t m_samples_per_interval; //< The number of samples in an interval
+    size_t m_chip_len; //< Length of one Manchester chip (half a bit), in samples
+    size_t m_max_shift = 0; //< Furthest an interval may be moved, in samples, or 0 to not align
+    size_t m_nr_shifted = 0; //< Number of times something has been moved
+    envelope_t m_ref_env; //< Envelope of the accumulation being aligned to
+    envelope_t m_sig_env; //< Envelope of the interval being aligned
+    std::vector<sample_t, arena_allocator<sample_t>> m_shifted; //< The interval, once moved into line
+};
+
+} // end namespace zepass
@@ -0,0 +1,127 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <zepass/arena.hh>
+
+#include <fstream>
+#include <new>
+#include <string>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/mman.h>
+
+using namespace zepass;
+
+static size_t const huge_page_size = 2ul * 1024 * 1024;
+
+/// Return the bytes of the mapping holding the given address that are backed by
+/// transparent huge pages, as /proc/self/smaps has it.
+static
+size_t anon_huge_bytes(void const* addr)
+{
+    std::uintptr_t const at = reinterpret_cast<std::uintptr_t>(addr);
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    bool in_mapping = false;
+
+    while (std::getline(smaps, line)) {
+        unsigned long start = 0,
+                      end = 0;
+        size_t kib = 0;
+
+        if (2 == std::sscanf(line.c_str(), "%lx-%lx ", &start, &end)) {
+            in_mapping = (start <= at && at < end);
+        } else if (in_mapping && 1 == std::sscanf(line.c_str(), "AnonHugePages: %zu kB", &kib)) {
+            return kib * 1024;
+        }
+    }
+
+    return 0;
+}
+
+/// Map an arena of at least the given size, and fault it all in.
+/// \param size The size of the arena, in bytes. Rounded up to a whole huge page.
+/// \param huge_pages Whether to try for huge pages: explicit ones from the hugetlb
+///                   pool first, then transparent huge pages
+arena::arena(size_t const size, bool const huge_pages)
+    : m_size((size + huge_page_size - 1) & ~(huge_page_size - 1))
+{
+    if (huge_pages) {
+        m_base = mmap(NULL, m_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        m_huge = (MAP_FAILED != m_base);
+    }
+
+    if (!m_huge) {
+        // Map a huge page more than needed and trim it back to a huge page boundary,
+        // so transparent huge pages can back all of it
+        size_t const mapped = m_size + huge_page_size;
+        void* const raw = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == raw) {
+            throw std::bad_alloc();
+        }
+
+        std::uintptr_t const raw_at = reinterpret_cast<std::uintptr_t>(raw);
+        std::uintptr_t const base_at = (raw_at + huge_page_size - 1) & ~(huge_page_size - 1);
+        size_t const head = base_at - raw_at;
+
+        m_base = reinterpret_cast<void*>(base_at);
+        if (0 != head) {
+            munmap(raw, head);
+        }
+        if (huge_page_size != head) {
+            munmap(static_cast<std::uint8_t*>(m_base) + m_size, huge_page_size - head);
+        }
+
+        if (huge_pages) {
+            madvise(m_base, m_size, MADV_HUGEPAGE);
+        }
+
+        // Fault the whole region in now, rather than on the hot path
+        std::memset(m_base, 0, m_size);
+
+        // The advice is only a hint; see what the kernel actually gave us
+        m_huge = huge_pages && m_size <= anon_huge_bytes(m_base);
+    }
+}
+
+arena::~arena()
+{
+    munmap(m_base, m_size);
+}
+
+/// Carve a block out of the arena.
+/// \param size The size of the block, in bytes
+/// \param alignment The alignment of the block; must be a power of two
+/// \throws std::bad_alloc if the arena is exhausted
+void* arena::allocate(size_t const size, size_t const alignment)
+{
+    size_t const start = (m_used + alignment - 1) & ~(alignment - 1);
+
+    if (start + size > m_size) {
+        throw std::bad_alloc();
+    }
+
+    m_used = start + size;
+
+    return static_cast<std::uint8_t*>(m_base) + start;
+}
@@ -0,0 +1,109 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+
+#include <cstddef>
+
+namespace zepass {
+
+///
+/// \brief Fixed-size memory region, mapped and faulted in up front.
+/// Backed by huge pages when the system has them to give. Allocations are never
+/// returned; the whole region goes away with the arena.
+///
+class arena {
+public:
+    typedef std::shared_ptr<arena> ptr_t; //< Pointer type for an arena
+
+    arena(size_t const size, bool const huge_pages);
+    ~arena();
+
+    void* allocate(size_t const size, size_t const alignment = 64);
+
+    /// Return whether or not the arena is backed by (explicit or transparent) huge pages
+    bool is_huge() const { return m_huge; }
+
+    /// Return the size of the arena, in bytes
+    size_t get_size() const { return m_size; }
+
+    /// Return the number of bytes allocated from the arena so far
+    size_t get_used() const { return m_used; }
+
+private:
+    void* m_base = nullptr; //< Start of the mapped region
+    size_t m_size; //< Size of the mapped region, in bytes
+    size_t m_used = 0; //< Bytes handed out so far
+    bool m_huge = false; //< Whether or not the region is backed by huge pages
+};
+
+///
+/// \brief Standard allocator that carves from an arena, if given one.
+/// Without an arena it falls back to the heap. Memory from an arena is never
+/// returned, so containers using this should be sized once and left alone.
+///
+template <typename T>
+class arena_allocator {
+public:
+    typedef T value_type;
+
+    arena_allocator(arena* mem = nullptr) : m_arena(mem) {}
+
+    template <typename U>
+    arena_allocator(arena_allocator<U> const& other) : m_arena(other.get_arena()) {}
+
+    T* allocate(size_t const n)
+    {
+        if (nullptr != m_arena) {
+            return static_cast<T*>(m_arena->allocate(n * sizeof(T), std::max<size_t>(64, alignof(T))));
+        }
+
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t const n)
+    {
+        if (nullptr == m_arena) {
+            std::allocator<T>().deallocate(p, n);
+        }
+    }
+
+    arena* get_arena() const { return m_arena; }
+
+private:
+    arena* m_arena;
+};
+
+template <typename T, typename U>
+bool operator==(arena_allocator<T> const& a, arena_allocator<U> const& b)
+{
+    return a.get_arena() == b.get_arena();
+}
+
+template <typename T, typename U>
+bool operator!=(arena_allocator<T> const& a, arena_allocator<U> const& b)
+{
+    return !(a == b);
+}
+
+} // end namespace zepass
+
@@ -0,0 +1,136 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <zepass/candidate.hh>
+#include <zepass/types.hh>
+
+#include <algorithm>
+#include <complex>
+#include <stdexcept>
+
+#include <cmath>
+
+using namespace zepass;
+
+/// Create a new candidate at the given peak.
+/// \param center_freq_hz_delta The center frequency, in hertz, to baseband
+/// \param samples_per_interval The number of samples in a capture interval
+/// \param sampling_rate The sampling rate of the input signal
+/// \param decimation How many input samples to sum into each decimated sample. This
+///                   should be well under half a bit period, so the on/off keying
+///                   survives regardless of where the chips fall.
+/// \param mem Arena to allocate the candidate's buffer from, or null to use the heap
+candidate::candidate(double const center_freq_hz_delta,
+                     size_t const samples_per_interval,
+                     freq_t const sampling_rate,
+                     size_t const decimation,
+                     arena* mem) : m_accumulated(arena_allocator<sample_t>(mem)),
+                                   m_samples_per_interval(samples_per_interval),
+                                   m_sampling_rate(sampling_rate),
+                                   m_decimation(decimation)
+{
+    if (0 == m_decimation) {
+        throw std::invalid_argument("decimation");
+    }
+
+    m_chip_len = std::max<size_t>(1, size_t(m_sampling_rate/500000/2)/m_decimation);
+    m_accumulated.resize(m_samples_per_interval/m_decimation, 0.0);
+    retune(center_freq_hz_delta);
+}
+
+candidate::~candidate()
+{
+}
+
+/// Move the candidate to a new center frequency, following a drifting peak.
+void candidate::retune(double const center_freq_hz_delta)
+{
+    m_center_freq_hz = center_freq_hz_delta;
+    m_shift_step = std::exp(sample_t(0.0, -2.0 * M_PI * m_center_freq_hz/double(m_sampling_rate)));
+}
+
+/// Throw away everything accumulated so far, to re-evaluate from scratch.
+/// \param center_freq_hz_delta The center frequency, in hertz, to baseband
+void candidate::reset(double const center_freq_hz_delta)
+{
+    std::fill(m_accumulated.begin(), m_accumulated.end(), 0.0);
+    m_nr_acc = 0;
+    m_last_at = 0;
+    m_rejected_until = 0;
+    retune(center_freq_hz_delta);
+}
+
+/// Shift the interval to baseband, integrate-and-dump it down by the decimation
+/// factor and accumulate it, normalized to the phase of the FFT peak. The shift
+/// is done by rotating a phasor, rather than with a precomputed vector, so a
+/// candidate stays small.
+void candidate::accumulate(sample_t const* const sig, sample_t const est_phase, wallclock_t const at)
+{
+    sample_t rot = std::conj(est_phase)/std::abs(est_phase);
+
+    for (size_t i = 0; i < m_accumulated.size(); i++) {
+        sample_t sum = 0.0;
+        for (size_t j = 0; j < m_decimation; j++) {
+            sum += sig[i * m_decimation + j] * rot;
+            rot *= m_shift_step;
+        }
+        m_accumulated[i] += sum;
+    }
+
+    m_nr_acc++;
+    m_last_at = at;
+}
+
+/// Return the variance of the accumulated envelope, relative to its squared mean.
+/// The envelope is integrated over each Manchester chip, at every possible chip
+/// alignment, and the best aligned score is returned. A constant envelope (a CW
+/// spur, say) scores close to 0, noise alone scores a bit over 0.27 (the Rayleigh
+/// distribution), and the on/off keying of a transponder response scores well
+/// above that.
+double candidate::get_modulation_index() const
+{
+    double best = 0.0;
+
+    for (size_t phase = 0; phase < m_chip_len; phase++) {
+        double sum = 0.0,
+               sum_sq = 0.0;
+        size_t n = 0;
+
+        for (size_t i = phase; i + m_chip_len <= m_accumulated.size(); i += m_chip_len) {
+            sample_t chip = 0.0;
+            for (size_t j = 0; j < m_chip_len; j++) {
+                chip += m_accumulated[i + j];
+            }
+
+            double const mag = std::abs(chip);
+            sum += mag;
+            sum_sq += mag * mag;
+            n++;
+        }
+
+        double const mean = sum/double(n);
+        if (0.0 == mean) {
+            continue;
+        }
+
+        best = std::max(best, (sum_sq/double(n) - mean * mean)/(mean * mean));
+    }
+
+    return best;
+}
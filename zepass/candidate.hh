@@ -0,0 +1,80 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <zepass/types.hh>
+#include <zepass/arena.hh>
+
+#include <vector>
+
+namespace zepass {
+
+///
+/// \brief A peak that has not yet been promoted to a full pass.
+/// Accumulates a few intervals of a cheap, decimated version of the signal at
+/// the peak, to check for the on/off keying of a transponder response before
+/// committing to the cost of a pass.
+///
+class candidate {
+public:
+    candidate(double const center_freq_hz_delta,
+              size_t const samples_per_interval,
+              freq_t const sampling_rate,
+              size_t const decimation,
+              arena* mem = nullptr);
+    ~candidate();
+
+    void accumulate(sample_t const* const sig, sample_t const est_phase, wallclock_t const at);
+    void retune(double const center_freq_hz_delta);
+    void reset(double const center_freq_hz_delta);
+
+    double get_modulation_index() const;
+
+    /// Return the difference between the radio center frequency and the center
+    /// frequency of this candidate.
+    double get_center_freq_delta() const { return m_center_freq_hz; }
+
+    /// Return the number of intervals that have been accumulated
+    size_t get_measure_count() const { return m_nr_acc; }
+
+    /// Return the last time (relatively) that we updated the candidate
+    wallclock_t last_updated_at() const { return m_last_at; }
+
+    /// Mark this candidate as not tag-like; ignore it until the given time
+    void reject_until(wallclock_t const until) { m_rejected_until = until; }
+
+    /// Return whether or not this candidate was rejected, and the rejection still holds
+    bool is_rejected(wallclock_t const at) const { return at < m_rejected_until; }
+
+private:
+    double m_center_freq_hz;
+    sample_t m_shift_step; //< Per-sample rotation that shifts this candidate to baseband
+    std::vector<sample_t, arena_allocator<sample_t>> m_accumulated; //< The accumulated, decimated sample vector
+    size_t m_samples_per_interval; //< The number of samples in an interval
+    freq_t m_sampling_rate; //< The sampling rate of the input signal
+    size_t m_decimation; //< Number of input samples summed into each decimated sample
+    size_t m_chip_len; //< Length of half a bit (one Manchester chip), in decimated samples
+    size_t m_nr_acc = 0; //< The number of accumulated intervals
+    wallclock_t m_last_at = 0; //< Last time interval this was seen at
+    wallclock_t m_rejected_until = 0; //< Time until which this candidate is ignored
+};
+
+} // end namespace zepass
+
@@ -0,0 +1,93 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#include <zepass/candidate_pool.hh>
+
+#include <stdexcept>
+
+using namespace zepass;
+
+/// Create a pool of candidates, allocating all of their buffers up front.
+/// \param capacity The number of candidates that can be vetted at once
+/// \param samples_per_interval The number of samples in a capture interval
+/// \param sampling_rate The sampling rate of the input signal
+/// \param decimation How many input samples each candidate sums into each of its own
+/// \param mem Arena to allocate the candidate buffers from, or null to use the heap
+candidate_pool::candidate_pool(size_t const capacity,
+                               size_t const samples_per_interval,
+                               freq_t const sampling_rate,
+                               size_t const decimation,
+                               arena* mem)
+{
+    if (0 == capacity) {
+        throw std::invalid_argument("capacity");
+    }
+
+    m_slots.reserve(capacity);
+    m_free.reserve(capacity);
+
+    for (size_t i = 0; i < capacity; i++) {
+        m_slots.push_back(std::make_unique<slot>(samples_per_interval, sampling_rate, decimation, mem));
+        m_free.push_back(m_slots.back().get());
+    }
+}
+
+candidate_pool::~candidate_pool()
+{
+}
+
+/// Take a slot from the pool, with its candidate reset to track the given frequency.
+/// \return The slot, or null if every slot is in use
+candidate_pool::slot* candidate_pool::acquire(double const center_freq_hz_delta, freq_t const bin)
+{
+    if (m_free.empty()) {
+        return nullptr;
+    }
+
+    slot* s = m_free.back();
+    m_free.pop_back();
+
+    s->c.reset(center_freq_hz_delta);
+    s->bin = bin;
+    s->in_use = true;
+
+    return s;
+}
+
+/// Return a slot to the pool.
+void candidate_pool::release(slot* const s)
+{
+    s->in_use = false;
+    m_free.push_back(s);
+}
+
+/// Return the slot in use whose candidate was fed longest ago, or null if none are in use.
+candidate_pool::slot* candidate_pool::get_stalest() const
+{
+    slot* stalest = nullptr;
+
+    for (auto const& s : m_slots) {
+        if (s->in_use && (nullptr == stalest || s->c.last_updated_at() < stalest->c.last_updated_at())) {
+            stalest = s.get();
+        }
+    }
+
+    return stalest;
+}
@@ -0,0 +1,77 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <zepass/types.hh>
+#include <zepass/arena.hh>
+#include <zepass/candidate.hh>
+
+#include <memory>
+#include <vector>
+
+namespace zepass {
+
+///
+/// \brief Fixed set of candidate slots, allocated once and recycled.
+/// Taking and returning a slot never touches the allocator. When every slot is
+/// in use, the candidate fed longest ago makes way for the new one.
+///
+class candidate_pool {
+public:
+    ///
+    /// \brief A candidate, along with the decoder's bookkeeping for it.
+    ///
+    struct slot {
+        slot(size_t const samples_per_interval, freq_t const sampling_rate, size_t const decimation,
+             arena* mem) : c(0.0, samples_per_interval, sampling_rate, decimation, mem) {}
+
+        zepass::candidate c; //< The candidate itself
+        freq_t bin = 0; //< FFT bin the candidate is currently tracked at
+        bool in_use = false; //< Whether or not the slot is handed out
+    };
+
+    candidate_pool(size_t const capacity,
+                   size_t const samples_per_interval,
+                   freq_t const sampling_rate,
+                   size_t const decimation,
+                   arena* mem = nullptr);
+    ~candidate_pool();
+
+    slot* acquire(double const center_freq_hz_delta, freq_t const bin);
+    void release(slot* const s);
+    slot* get_stalest() const;
+
+    /// Return the slot at the given index, in use or not
+    slot* get_slot(size_t const index) const { return m_slots[index].get(); }
+
+    /// Return the number of slots in the pool
+    size_t get_capacity() const { return m_slots.size(); }
+
+    /// Return the number of slots currently handed out
+    size_t get_in_use() const { return m_slots.size() - m_free.size(); }
+
+private:
+    std::vector<std::unique_ptr<slot>> m_slots; //< Every slot in the pool
+    std::vector<slot*> m_free; //< Stack of free slots
+};
+
+} // end namespace zepass
+
@@ -0,0 +1,79 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+#pragma once
+
+#include <zepass/types.hh>
+
+#include <cstdint>
+#include <type_traits>
+
+namespace zepass {
+
+/// checkpoint_header::magic, "ZPCK" in a little-endian file
+static constexpr std::uint32_t checkpoint_magic = 0x4b43505a;
+
+/// checkpoint_header::version, bumped whenever the layout changes
+static constexpr std::uint32_t checkpoint_version = 2;
+
+///
+/// \brief The start of one decoder's section of a pass checkpoint.
+/// A checkpoint is only read back on the machine that wrote it, so everything is in
+/// host byte order. The header is followed by nr_passes pass_checkpoints, each
+/// followed by nr_samples accumulated samples. A file holds one section per decoder.
+///
+struct checkpoint_header {
+    std::uint32_t magic; //< checkpoint_magic
+    std::uint32_t version; //< checkpoint_version
+    std::int64_t centre_freq; //< Center frequency of the decoder, in Hz
+    std::int64_t sampling_rate; //< Sampling rate, in Hz
+    std::uint64_t samples_per_interval; //< Samples in each interval
+    std::uint64_t fft_len; //< Length of the FFT, and so the number of bins
+    std::uint64_t nr_channels; //< Receive channels combined into each pass
+    std::uint64_t saved_at; //< Wallclock of the last interval before the checkpoint, in microseconds
+    std::uint64_t nr_passes; //< Number of passes that follow
+};
+
+///
+/// \brief A live pass, as kept in a checkpoint.
+///
+struct pass_checkpoint {
+    std::int64_t bin; //< FFT bin the pass is tracked at
+    double center_freq_delta; //< Offset of the transponder from the center frequency, in Hz
+    double signal_sum; //< Amplitude of the transponder in the accumulated FFT peak
+    double noise_sum; //< Power of the noise in the accumulated FFT peak
+    std::uint64_t nr_acc; //< Number of intervals accumulated
+    std::uint64_t first_at; //< Wallclock of the first interval accumulated, in microseconds
+    std::uint64_t last_at; //< Wallclock of the last interval accumulated, in microseconds
+    std::uint64_t nr_samples; //< Accumulated samples that follow, 0 once the pass is decoded
+    std::uint32_t serial_num; //< Tag serial number, if decoded
+    std::uint32_t agency_id; //< Issuing agency, if decoded
+    std::uint8_t header; //< Tag header field, if decoded
+    std::uint8_t tag_type; //< Tag type field, if decoded
+    std::uint8_t app_id; //< Application ID field, if decoded
+    std::uint8_t group_id; //< Group ID field, if decoded
+    std::uint8_t decoded; //< Whether the pass has been decoded
+    std::uint8_t nr_corrected; //< Bits flipped by error correction to decode the pass
+    std::uint8_t watchlists; //< Watchlists the decoded tag is on
+    std::uint8_t reserved; //< Zero
+};
+
+static_assert(std::is_trivially_copyable<checkpoint_header>::value, "checkpoint_header is written as is");
+static_assert(std::is_trivially_copyable<pass_checkpoint>::value, "pass_checkpoint is written as is");
+
+} // end namespace zepass
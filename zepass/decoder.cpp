@@ -18,32 +18,49 @@
 //
 
 #include <zepass/decoder.hh>
+#include <zepass/checkpoint.hh>
+#include <zepass/log.hh>
 #include <zepass/pass.hh>
 #include <zepass/priv.hh>
 
-#include <array>
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
+#include <mutex>
+#include <cstdlib>
 #include <cstring>
 #include <stdexcept>
 #include <sstream>
 
+#include <cmath>
+
 #include <fftw3.h>
 
 using namespace zepass;
 
+/// Only fftw_execute() is thread-safe, so decoders made and destroyed on different
+/// threads take turns with the planner
+static std::mutex fftw_planner_lock;
+
 decoder::decoder(freq_t const centre_freq,
                  freq_t const sampling_rate,
                  size_t const interval_len,
                  wallclock_t const max_age,
-                 std::shared_ptr<std::ofstream> out_file) :
+                 size_t const batch_len,
+                 arena::ptr_t mem,
+                 size_t const max_passes,
+                 size_t const fft_len,
+                 size_t const nr_channels) :
                                               m_freq_vec(NULL),
                                               m_in_vec(NULL),
                                               m_centre_freq(centre_freq),
                                               m_sampling_rate(sampling_rate),
+                                              m_batch_len(batch_len),
+                                              m_nr_channels(nr_channels),
                                               m_interval_len(interval_len),
                                               m_max_age(max_age),
-                                              m_out_file(out_file)
+                                              m_arena(mem),
+                                              m_expiry(10)
 {
     if (0 >= sampling_rate) {
         throw std::invalid_argument("sampling_rate");
@@ -53,30 +70,114 @@ decoder::decoder(freq_t const centre_freq,
         throw std::invalid_argument("center_freq");
     }
 
+    if (0 == batch_len) {
+        throw std::invalid_argument("batch_len");
+    }
+
+    if (0 == nr_channels) {
+        throw std::invalid_argument("nr_channels");
+    }
+
+    // Bits are 2 microseconds long, and must span a whole number of samples
+    if (m_sampling_rate < 2000000 || 0 != m_sampling_rate % 500000) {
+        throw std::invalid_argument("sampling_rate");
+    }
+
     m_samp_t_len = size_t(double(m_sampling_rate) * priv::us_to_sec(m_interval_len));
-    m_fft_len = priv::round_nearest_power_2(m_samp_t_len);
+    m_fft_len = 0 != fft_len ? fft_len : priv::round_nearest_power_2(m_samp_t_len);
+
+    if (m_fft_len < m_samp_t_len || 0 != (m_fft_len & (m_fft_len - 1))) {
+        throw std::invalid_argument("fft_len");
+    }
+
+    m_kernels = &select_kernels(m_samp_t_len, m_fft_len);
 
-    std::cout << "Interval samples: " << m_samp_t_len << " FFT Length: " << m_fft_len << std::endl;
+    log() << "Interval samples: " << m_samp_t_len << " FFT Length: " << m_fft_len << std::endl;
 
-    if (NULL == (m_freq_vec = reinterpret_cast<sample_t*>(fftw_malloc(sizeof(fftw_complex) * m_fft_len)))) {
-        throw std::bad_alloc();
+    if (m_kernels->is_generic()) {
+        log() << "No specialized kernels for this configuration, using generic kernels." << std::endl;
+    } else {
+        log() << "Using kernels specialized for " << m_kernels->samples_per_interval <<
+            " sample intervals." << std::endl;
     }
 
-    if (NULL == (m_in_vec = reinterpret_cast<sample_t*>(fftw_malloc(sizeof(fftw_complex) * m_fft_len)))) {
-        throw std::bad_alloc();
+    m_power.resize(m_fft_len, 0.0);
+    m_noise_floor.resize(m_fft_len, 0.0);
+    m_scratch.resize(m_fft_len, 0.0);
+    if (1 < m_nr_channels) {
+        m_channel_power.resize(m_fft_len * m_nr_channels, 0.0);
     }
+    m_channel_noise.resize(m_nr_channels, 0.0);
+    m_channel_sig.resize(m_nr_channels, nullptr);
+    m_channel_peak.resize(m_nr_channels, 0.0);
+    m_passes.resize(m_fft_len, nullptr);
+    m_candidates.resize(m_fft_len, nullptr);
+    // Peaks are local maxima, so there are at most half as many as bins
+    m_peaks.reserve(m_fft_len/2);
+
+    m_pool = std::make_unique<pass_pool>(max_passes, m_samp_t_len, m_sampling_rate, m_interval_len, m_arena.get());
+    // Candidates decimate to a quarter bit; any coarser and the blocks can straddle
+    // the on/off chips of the Manchester code, washing out the keying we look for.
+    m_candidate_pool = std::make_unique<candidate_pool>(max_passes, m_samp_t_len, m_sampling_rate,
+            std::max<size_t>(1, m_sampling_rate/500000/4), m_arena.get());
+    m_aligner = std::make_unique<aligner>(m_samp_t_len, m_sampling_rate, m_arena.get());
+
+    size_t const nr_ffts = m_batch_len * m_nr_channels;
+    size_t const vec_len = m_fft_len * nr_ffts;
 
-    std::cout << "Planning FFT..." << std::endl;
+    if (nullptr != m_arena) {
+        m_freq_vec = reinterpret_cast<sample_t*>(m_arena->allocate(sizeof(fftw_complex) * vec_len));
+        m_in_vec = reinterpret_cast<sample_t*>(m_arena->allocate(sizeof(fftw_complex) * vec_len));
+    } else {
+        if (NULL == (m_freq_vec = reinterpret_cast<sample_t*>(fftw_malloc(sizeof(fftw_complex) * vec_len)))) {
+            throw std::bad_alloc();
+        }
+
+        if (NULL == (m_in_vec = reinterpret_cast<sample_t*>(fftw_malloc(sizeof(fftw_complex) * vec_len)))) {
+            throw std::bad_alloc();
+        }
+    }
+
+    log() << "Planning FFT..." << std::endl;
+
+    std::lock_guard<std::mutex> planning(fftw_planner_lock);
 
     m_plan = fftw_plan_dft_1d(int(m_fft_len), reinterpret_cast<fftw_complex*>(m_in_vec),
             reinterpret_cast<fftw_complex*>(m_freq_vec), FFTW_FORWARD, FFTW_MEASURE | FFTW_PRESERVE_INPUT);
 
-    std::cout << "FFT planning is done, we are ready to roll." << std::endl;
+    if (1 < nr_ffts) {
+        int const n = int(m_fft_len);
+        log() << "Planning batches of " << nr_ffts << " FFTs..." << std::endl;
+        m_batch_plan = fftw_plan_many_dft(1, &n, int(nr_ffts),
+                reinterpret_cast<fftw_complex*>(m_in_vec), NULL, 1, n,
+                reinterpret_cast<fftw_complex*>(m_freq_vec), NULL, 1, n,
+                FFTW_FORWARD, FFTW_MEASURE | FFTW_PRESERVE_INPUT);
+    }
+
+    // Planning scribbles over the buffers; only the first m_samp_t_len samples of each
+    // channel of each interval are written by the application, the rest must stay zero-padded.
+    std::fill(m_in_vec, m_in_vec + vec_len, 0.0);
+
+    log() << "FFT planning is done, we are ready to roll." << std::endl;
 }
 
 decoder::~decoder()
 {
-    fftw_destroy_plan(m_plan);
+    {
+        std::lock_guard<std::mutex> planning(fftw_planner_lock);
+
+        fftw_destroy_plan(m_plan);
+
+        if (NULL != m_batch_plan) {
+            fftw_destroy_plan(m_batch_plan);
+            m_batch_plan = NULL;
+        }
+    }
+
+    if (nullptr != m_arena) {
+        // The arena owns the buffers
+        return;
+    }
 
     if (NULL != m_freq_vec) {
         fftw_free(m_freq_vec);
@@ -89,81 +190,933 @@ decoder::~decoder()
     }
 }
 
-void decoder::process_peak(double peak_freq, freq_t peak_bin, sample_t const peak, wallclock_t const at)
+/// Set how far a transponder's peak may move between intervals (due to Doppler,
+/// temperature drift, etc.) and still be associated with its existing pass.
+/// \param tolerance_hz The maximum drift, in Hz. Rounded to the nearest FFT bin.
+void decoder::set_drift_tolerance(double const tolerance_hz)
+{
+    if (tolerance_hz < 0.0) {
+        throw std::invalid_argument("tolerance_hz");
+    }
+
+    m_bin_tolerance = freq_t(tolerance_hz * double(m_fft_len)/double(m_sampling_rate) + 0.5);
+}
+
+/// Require new peaks to be vetted as candidates before they become passes.
+/// \param nr_intervals Number of intervals to accumulate a candidate over, or 0 to
+///                     promote every peak straight to a pass
+/// \param threshold Minimum envelope modulation index (see candidate::get_modulation_index)
+///                  for a candidate to be promoted
+void decoder::set_candidate_validation(size_t const nr_intervals, double const threshold)
+{
+    if (threshold < 0.0) {
+        throw std::invalid_argument("threshold");
+    }
+
+    m_candidate_len = nr_intervals;
+    m_candidate_threshold = threshold;
+}
+
+/// Feed a peak that has no pass to its candidate, creating the candidate if needed.
+/// Returns true once the candidate has shown transponder-like on/off keying, and
+/// should be promoted to a pass.
+bool decoder::vet_candidate(sample_t const* const sig, double peak_freq, freq_t peak_bin, sample_t const peak, wallclock_t const at)
+{
+    if (0 == m_candidate_len) {
+        return true;
+    }
+
+    candidate_pool::slot* slot = find_nearest_candidate(peak_bin, at);
+
+    if (nullptr == slot) {
+        slot = m_candidate_pool->acquire(peak_freq, peak_bin);
+        if (nullptr == slot) {
+            // Every slot is taken; the candidate heard from longest ago makes way
+            release_candidate(m_candidate_pool->get_stalest());
+            slot = m_candidate_pool->acquire(peak_freq, peak_bin);
+        }
+        m_candidates[peak_bin] = slot;
+    } else if (slot->bin != peak_bin && nullptr == m_candidates[peak_bin]) {
+        m_candidates[slot->bin] = nullptr;
+        m_candidates[peak_bin] = slot;
+        slot->bin = peak_bin;
+        slot->c.retune(peak_freq);
+    }
+
+    zepass::candidate* const cand = &slot->c;
+
+    if (cand->is_rejected(at)) {
+        return false;
+    }
+
+    if (cand->get_measure_count() >= m_candidate_len) {
+        // The rejection has expired, take another look in case a transponder showed up
+        cand->reset(cand->get_center_freq_delta());
+    }
+
+    cand->accumulate(sig, peak, at);
+
+    if (cand->get_measure_count() < m_candidate_len) {
+        m_vetting_left = m_candidate_len;
+        return false;
+    }
+
+    double const modulation = cand->get_modulation_index();
+    if (modulation < m_candidate_threshold) {
+        log() << "Rejecting candidate at bin " << peak_bin << " (modulation index " <<
+            std::fixed << modulation << ")" << std::endl;
+        cand->reject_until(at + m_candidate_holdoff);
+        return false;
+    }
+
+    release_candidate(slot);
+
+    return true;
+}
+
+/// Find the candidate closest to the given bin, within the drift tolerance, that
+/// has not already been fed a peak during this interval.
+candidate_pool::slot* decoder::find_nearest_candidate(freq_t const peak_bin, wallclock_t const at)
+{
+    for (freq_t dist = 0; dist <= m_bin_tolerance; dist++) {
+        for (freq_t bin : { peak_bin - dist, peak_bin + dist }) {
+            if (bin < 0 || bin >= freq_t(m_fft_len)) {
+                continue;
+            }
+
+            candidate_pool::slot* slot = m_candidates[bin];
+            if (nullptr != slot && slot->c.last_updated_at() != at) {
+                return slot;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+/// Forget a candidate, and return its slot to the pool.
+void decoder::release_candidate(candidate_pool::slot* const slot)
+{
+    m_candidates[slot->bin] = nullptr;
+    m_candidate_pool->release(slot);
+}
+
+/// Find the pass closest to the given bin, within the drift tolerance, that has not
+/// already been fed a peak during this interval.
+pass_pool::slot* decoder::find_nearest_pass(freq_t const peak_bin, wallclock_t const at)
+{
+    for (freq_t dist = 0; dist <= m_bin_tolerance; dist++) {
+        for (freq_t bin : { peak_bin - dist, peak_bin + dist }) {
+            if (bin < 0 || bin >= freq_t(m_fft_len)) {
+                continue;
+            }
+
+            pass_pool::slot* slot = m_passes[bin];
+            if (nullptr != slot && slot->p.last_updated_at() != at) {
+                return slot;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+/// Forget a pass, and return its slot to the pool.
+void decoder::release_pass(pass_pool::slot* const slot)
+{
+    m_expiry.cancel(slot);
+    m_passes[slot->bin] = nullptr;
+    m_pool->release(slot);
+}
+
+/// Any other undecoded passes within the drift tolerance of the given pass that were
+/// not seen this interval are the same transponder, left behind when it drifted.
+/// Fold them into the given pass so their integrations aren't thrown away.
+void decoder::merge_neighbours(pass_pool::slot* const slot, wallclock_t const at)
+{
+    if (slot->p.is_decoded()) {
+        return;
+    }
+
+    freq_t const first = std::max<freq_t>(0, slot->bin - m_bin_tolerance);
+    freq_t const last = std::min<freq_t>(m_fft_len - 1, slot->bin + m_bin_tolerance);
+
+    for (freq_t bin = first; bin <= last; bin++) {
+        pass_pool::slot* other = m_passes[bin];
+        if (nullptr == other || other == slot || other->p.last_updated_at() == at || other->p.is_decoded()) {
+            continue;
+        }
+
+        log() << "Merging pass at bin " << bin << " into bin " << slot->bin << std::endl;
+        slot->p.merge(other->p, m_aligner.get());
+        release_pass(other);
+    }
+}
+
+/// If the transponder drifted, hand its pass off to the bin the peak moved to.
+void decoder::follow_pass(pass_pool::slot* const slot, peak const& pk)
+{
+    if (slot->bin == pk.bin) {
+        return;
+    }
+
+    m_passes[slot->bin] = nullptr;
+    m_passes[pk.bin] = slot;
+    slot->bin = pk.bin;
+    slot->p.retune(pk.freq);
+}
+
+/// Feed a peak to the pass tracking it, starting a pass if there isn't one, and try
+/// to decode the pass once it has enough.
+/// \param sig The interval's samples, each channel m_fft_len after the last
+/// \param freq The interval's FFT, each channel m_fft_len after the last
+/// \param pk The peak
+/// \param at The time of the interval
+void decoder::process_peak(sample_t const* const sig, sample_t const* const freq, peak const& pk, wallclock_t const at)
 {
-    auto freq = m_passes.find(peak_bin);
-    zepass::pass::ptr_t pass;
+    double const peak_freq = pk.freq;
+    freq_t const peak_bin = pk.bin;
+    pass_pool::slot* slot = find_nearest_pass(peak_bin, at);
 
-    if (freq == m_passes.end()) {
-        // Create a new pass instance and insert it
-        std::cout << "Found peak: " << peak_bin << " at dF " <<
+    if (nullptr == slot) {
+        // A candidate is vetted on the channel the peak is strongest in
+        size_t best = 0;
+        for (size_t c = 1; c < m_nr_channels; c++) {
+            if (std::norm(freq[c * m_fft_len + pk.index])/m_channel_noise[c] >
+                    std::norm(freq[best * m_fft_len + pk.index])/m_channel_noise[best])
+            {
+                best = c;
+            }
+        }
+
+        if (!vet_candidate(sig + best * m_fft_len, peak_freq, peak_bin, freq[best * m_fft_len + pk.index], at)) {
+            return;
+        }
+
+        // Take a fresh pass from the pool. If they're all in use, the peak is dropped
+        // (and counted by the pool).
+        if (nullptr == (slot = m_pool->acquire(peak_freq, peak_bin))) {
+            return;
+        }
+
+        log() << "Found peak: " << peak_bin << " at dF " <<
             std::fixed << std::setw(8) << peak_freq <<  " (f=" << peak_freq + m_centre_freq << ")" << std::endl;
 
-        pass = zepass::pass::make_pass(peak_freq, m_samp_t_len,
-                m_sampling_rate, m_interval_len);
-        m_passes.insert(std::make_pair(peak_bin, pass));
+        slot->p.set_combining(m_combining);
+        slot->p.set_error_correction(m_chase_bits, m_chase_max_flips);
+        m_passes[peak_bin] = slot;
+        m_stats.nr_passes++;
     } else {
-        pass = freq->second;
+        follow_pass(slot, pk);
+    }
+
+    zepass::pass& pass = slot->p;
+
+    {
+        profiler::scope prof(m_profiler.get(), stage::accumulate);
+
+        for (size_t c = 0; c < m_nr_channels; c++) {
+            m_channel_sig[c] = sig + c * m_fft_len;
+            m_channel_peak[c] = freq[c * m_fft_len + pk.index];
+        }
+
+        pass.accumulate(m_channel_sig.data(), m_channel_peak.data(), m_channel_noise.data(), m_nr_channels, at,
+                m_aligner.get());
     }
+    m_expiry.schedule(slot, pass.last_updated_at() + m_max_age);
+    merge_neighbours(slot, at);
 
-    pass->accumulate(m_in_vec, peak, at);
-    if (pass->get_measure_count() > 32 and !pass->is_decoded()) {
+    if (pass.get_measure_count() > 32 and !pass.is_decoded()) {
         // If we have integrated 32 times and we haven't been able to decode, throw it all away.
-        std::cout << "Unable to decode, erasing pass in case we're getting owned by noise." << std::endl;
-        m_passes.erase(peak_bin);
-    } else if (pass->get_measure_count() > 16 and !pass->is_decoded()) {
-        if (pass->decode()) {
-            (*m_out_file) << *pass << std::endl;
+        log() << "Unable to decode, erasing pass in case we're getting owned by noise." << std::endl;
+        release_pass(slot);
+    } else if ((pass.get_measure_count() > 16 or (0.0 < m_decode_snr and pass.get_snr() >= m_decode_snr))
+            and !pass.is_decoded())
+    {
+        if (is_overdue()) {
+            // The pass tries again with its next interval, when there may be time
+            m_stats.nr_deferred++;
+            m_overran = true;
+            return;
+        }
+
+        bool decoded;
+        {
+            profiler::scope prof(m_profiler.get(), stage::decode);
+            decoded = m_pool->decode(slot);
+        }
+
+        if (decoded) {
+            m_stats.nr_decoded++;
+            if (0 != pass.get_corrected_bits()) {
+                m_stats.nr_corrected++;
+            }
+
+            watchlist::ptr_t const list = std::atomic_load(&m_watchlist);
+            if (nullptr != list) {
+                pass.set_watchlists(list->lookup(std::uint16_t(pass.get_agency_id()), pass.get_serial_number()));
+                if (0 != pass.get_watchlists()) {
+                    m_stats.nr_watchlisted++;
+                    std::ostream& os = log();
+                    os << "Agency " << pass.get_agency_id() << " serial " << pass.get_serial_number() <<
+                        " is on watchlist(s):";
+                    for (size_t i = 0; i < list->get_nr_lists(); i++) {
+                        if (0 != (pass.get_watchlists() & (1u << i))) {
+                            os << " " << list->get_list_name(i);
+                        }
+                    }
+                    os << std::endl;
+                }
+            }
+
+            for (auto const& handler: m_read_handlers) {
+                handler(pass);
+            }
         }
     }
 }
 
 void decoder::reap_passes(wallclock_t const at)
 {
-    for (auto it = m_passes.cbegin(); it != m_passes.cend();) {
-        auto pass = it->second;
-        if (at - pass->last_updated_at() > m_max_age) {
-            std::cout << "Reaping pass " << *pass << ", it's out of date" << std::endl;
-            it = m_passes.erase(it);
-        } else {
-            ++it;
+    m_expiry.advance(at, [this](wheel_entry* const entry) {
+            auto slot = static_cast<pass_pool::slot*>(entry);
+            log() << "Reaping pass " << slot->p << ", it's out of date" << std::endl;
+            m_passes[slot->bin] = nullptr;
+            m_pool->release(slot);
+            m_stats.nr_expired++;
+        });
+
+    for (size_t i = 0; i < m_candidate_pool->get_capacity(); i++) {
+        candidate_pool::slot* const slot = m_candidate_pool->get_slot(i);
+        if (slot->in_use && at - slot->c.last_updated_at() > m_max_age) {
+            release_candidate(slot);
         }
     }
 }
 
-void decoder::find_passes(wallclock_t const at)
+/// Choose how passes combine the intervals they accumulate, and when to start
+/// trying to decode them. Passes already being tracked keep combining as they were.
+/// \param mode The combining mode for new passes
+/// \param decode_snr_db Start decoding a pass once its estimated SNR per sample reaches
+///                      this, in dB, rather than waiting for 16 intervals
+void decoder::set_combining(combining const mode, double const decode_snr_db)
+{
+    m_combining = mode;
+    m_decode_snr = std::pow(10.0, decode_snr_db/10.0);
+}
+
+/// Enable soft decision error correction for new passes. If a frame fails its CRC,
+/// combinations of up to max_flips of its max_bits least reliable bits are tried.
+/// Every combination tried is a chance of a false read, so keep these small.
+/// \param max_bits The number of bits to consider flipping (up to 24), or 0 to disable
+/// \param max_flips The most bits flipped at once
+void decoder::set_error_correction(size_t const max_bits, size_t const max_flips)
+{
+    if (24 < max_bits) {
+        throw std::invalid_argument("max_bits");
+    }
+
+    m_chase_bits = max_bits;
+    m_chase_max_flips = max_flips;
+}
+
+/// Line each interval up with what its pass has accumulated before adding it, to
+/// take out transponder turn-on jitter. The best shift is searched for up to the
+/// given distance either way.
+/// \param max_shift_us The furthest an interval may be moved, in microseconds, or 0 to
+///                     add intervals as they are
+void decoder::set_alignment(double const max_shift_us)
+{
+    if (0.0 > max_shift_us) {
+        throw std::invalid_argument("max_shift_us");
+    }
+
+    m_aligner->set_max_shift(size_t(std::round(max_shift_us * double(m_sampling_rate)/1000000.0)));
+}
+
+/// Register a function to be called with each pass as soon as it is decoded.
+/// Handlers run on the capture thread, in the order they were added.
+void decoder::add_read_handler(read_handler_t const& handler)
 {
-    std::array<double, 3> window = { 0.0, 0.0, 0.0 };
+    m_read_handlers.push_back(handler);
+}
+
+/// Check every tag decoded from now on against a watchlist, and mark the passes of
+/// those on it. This may be called from any thread; the decoder keeps using the old
+/// watchlist, if any, until it next decodes a tag.
+/// \param list The watchlist, or null to stop checking
+void decoder::set_watchlist(watchlist::ptr_t const& list)
+{
+    std::atomic_store(&m_watchlist, list);
+}
+
+/// Return the watchlist decoded tags are being checked against, or null if none.
+watchlist::ptr_t decoder::get_watchlist() const
+{
+    return std::atomic_load(&m_watchlist);
+}
+
+/// Enable the energy gate. While no pass is waiting to be decoded, an interval whose
+/// total power is within the gate of the idle noise floor is skipped before its FFT.
+/// This is much less sensitive than the FFT peak search, so a transponder has to
+/// stand out from the noise in the time domain to open the gate, but once it has a
+/// pass every interval is processed until it is decoded.
+/// \param gate_db How far, in dB, an interval's power must rise over the idle noise
+///                floor to be processed, or 0 to process every interval
+/// \param refresh Process an idle interval anyway after skipping this many in a row
+void decoder::set_energy_gate(double const gate_db, size_t const refresh)
+{
+    if (gate_db < 0.0) {
+        throw std::invalid_argument("gate_db");
+    }
+
+    m_gate_ratio = 0.0 < gate_db ? std::pow(10.0, gate_db/10.0) : 0.0;
+    m_gate_refresh = refresh;
+}
+
+/// Limit the time spent on each interval. Once the time runs out, the peaks still to
+/// be processed are dropped, and passes due to be decoded wait for a later interval.
+/// Peaks are taken most valuable first, so what's dropped is what matters least.
+/// \param budget_us The time allowed for each interval, in microseconds, from when
+///                  processing starts, or 0 for no limit
+void decoder::set_budget(double const budget_us)
+{
+    if (budget_us < 0.0) {
+        throw std::invalid_argument("budget_us");
+    }
+
+    m_budget = std::chrono::duration_cast<budget_clock::duration>(std::chrono::duration<double, std::micro>(budget_us));
+}
+
+/// Charge the time spent in each stage of decoding to a profiler. The profiler counts
+/// the thread it was made on, so the decoder must only be run there from now on.
+/// \param prof The profiler, which may be shared with other decoders on the same
+///             thread, or null to stop profiling
+void decoder::set_profiler(profiler::ptr_t const& prof)
+{
+    m_profiler = prof;
+}
+
+/// Fold the power spectrum of every interval into a spectrum monitor, and report it
+/// periodically. This reuses the FFT each interval already gets, so it costs one
+/// pass over the bins.
+/// \param nr_bins The number of report bins, a power of 2 no longer than the FFT
+/// \param report_every How often to report, in microseconds
+/// \param handler Called with the monitor when a report is due
+void decoder::set_spectrum_report(size_t const nr_bins, wallclock_t const report_every,
+                                  spectrum_monitor::report_handler_t const& handler)
+{
+    if (0 == report_every) {
+        throw std::invalid_argument("report_every");
+    }
+
+    m_spectrum = std::make_unique<spectrum_monitor>(m_centre_freq, m_sampling_rate, m_samp_t_len, m_fft_len, nr_bins);
+    m_spectrum_every = report_every;
+    m_spectrum_handler = handler;
+}
+
+/// Set how long a pass may go unseen before it is reaped. Live passes pick up the
+/// new age the next time they are seen.
+/// \param max_age The maximum age, in microseconds
+void decoder::set_max_age(wallclock_t const max_age)
+{
+    m_max_age = max_age;
+}
+
+/// Set the fixed peak detection threshold. This is the FFT magnitude a peak must
+/// exceed when CFAR is disabled, or while the noise floor estimate warms up.
+void decoder::set_detection_threshold(double const threshold)
+{
+    if (threshold < 0.0) {
+        throw std::invalid_argument("threshold");
+    }
+
+    m_threshold = threshold;
+}
+
+/// Enable constant false alarm rate peak detection. The noise floor of each bin is
+/// tracked as an exponential average of its power over recent FFTs; a bin is
+/// a candidate if its power exceeds that average by a factor chosen to give the
+/// requested false alarm rate for exponentially distributed noise power.
+/// \param false_alarm_rate Target probability of noise crossing the threshold in a bin,
+///                         or 0 to use the fixed threshold
+/// \param window The number of FFTs to average the noise floor over
+void decoder::set_cfar(double const false_alarm_rate, size_t const window)
+{
+    if (false_alarm_rate < 0.0 || false_alarm_rate >= 1.0) {
+        throw std::invalid_argument("false_alarm_rate");
+    }
+
+    if (window < 1) {
+        throw std::invalid_argument("window");
+    }
+
+    m_cfar_pfa = false_alarm_rate;
+    m_cfar_window = window;
+
+    if (0.0 < m_cfar_pfa) {
+        // An exponential average with rate 1/window has the variance of a plain
+        // average over this many independent cells
+        double const lambda = 1.0/double(m_cfar_window);
+        double const nr_cells = (2.0 - lambda)/lambda;
+        m_cfar_alpha = nr_cells * (std::pow(m_cfar_pfa, -1.0/nr_cells) - 1.0);
+
+        log() << "CFAR threshold is " << std::fixed << 10.0 * std::log10(m_cfar_alpha) <<
+            "dB above the noise floor" << std::endl;
+    }
+}
+
+/// Return the power threshold a peak in the given (unrotated) FFT bin must exceed.
+double decoder::get_threshold(size_t const bin) const
+{
+    if (0.0 < m_cfar_pfa && m_nr_noise_updates >= m_cfar_window) {
+        return m_cfar_alpha * m_noise_floor[bin];
+    }
+
+    return m_threshold * m_threshold;
+}
+
+/// Check whether intervals can be skipped without transforming them: the energy
+/// gate is enabled, every live pass is already decoded, no candidate still being
+/// vetted was fed in the last m_candidate_len intervals processed, and the total
+/// power of each interval is within the gate of the idle noise floor. Decoded passes
+/// are only kept to suppress duplicate reads, and expire on time whether they're fed
+/// or not. The floor tracks the power of intervals that pass the gate; busy intervals
+/// adapt it about a thousand times more slowly, so it still follows a change in gain.
+/// Every so often idle intervals are processed anyway, to keep the CFAR noise floor
+/// and the spectrum survey current.
+/// With several receive channels, the power of an interval is the mean of its channels.
+/// \param sig The first interval's samples; every channel of every interval follows m_fft_len apart
+/// \param nr_intervals The number of intervals, all skipped or none
+/// \return true if the intervals were skipped (and counted)
+bool decoder::is_idle(sample_t const* const sig, size_t const nr_intervals)
+{
+    if (0.0 == m_gate_ratio) {
+        return false;
+    }
+
+    bool quiet = true;
+
+    for (size_t i = 0; i < nr_intervals; i++) {
+        double energy = 0.0;
+        for (size_t c = 0; c < m_nr_channels; c++) {
+            energy += m_kernels->energy(sig + (i * m_nr_channels + c) * m_fft_len, m_samp_t_len);
+        }
+        energy /= double(m_nr_channels);
+
+        // Start with a plain average of everything, so the floor is usable after one window
+        bool const warm = m_nr_gate_updates >= m_gate_window;
+        bool const below = warm && energy < m_gate_floor * m_gate_ratio;
+        double const rate = 1.0/double(std::min(m_nr_gate_updates + 1, m_gate_window));
+
+        m_gate_floor += (warm && !below ? rate/1024.0 : rate) * (energy - m_gate_floor);
+        m_nr_gate_updates++;
+        quiet = quiet && below;
+    }
+
+    if (!quiet || 0 != m_pool->get_nr_undecoded() || m_nr_gate_skipped + nr_intervals > m_gate_refresh ||
+            0 != m_vetting_left)
+    {
+        m_nr_gate_skipped = 0;
+        return false;
+    }
+
+    m_nr_gate_skipped += nr_intervals;
+    m_stats.nr_skipped += nr_intervals;
+
+    return true;
+}
+
+/// Fold the power of the current FFT into the per-bin noise floor. Bins holding a
+/// detection adapt about a thousand times more slowly, so a transponder passing
+/// through doesn't raise the threshold over itself, while a persistent spur is still
+/// absorbed within a minute or so.
+void decoder::update_noise_floor()
+{
+    // Start with a plain average of everything, so the estimate is usable after one window
+    bool const warm = m_nr_noise_updates >= m_cfar_window;
+    double const rate = 1.0/double(std::min(m_nr_noise_updates + 1, m_cfar_window));
+
+    for (size_t i = 0; i < m_fft_len; ++i) {
+        double const r = warm && m_power[i] > get_threshold(i) ? rate/1024.0 : rate;
+        m_noise_floor[i] += r * (m_power[i] - m_noise_floor[i]);
+    }
+
+    m_nr_noise_updates++;
+}
+
+/// Estimate the noise power per FFT bin of the current interval, from the median
+/// bin power. Transponders only occupy a handful of bins, so this isn't pulled
+/// up by them the way the per-bin noise floor is in the bins they sit in.
+/// \param power The power in each FFT bin of one channel of the interval
+double decoder::estimate_interval_noise(double const* const power)
+{
+    std::copy(power, power + m_fft_len, m_scratch.begin());
+    auto median = m_scratch.begin() + m_scratch.size()/2;
+    std::nth_element(m_scratch.begin(), median, m_scratch.end());
+
+    // Noise power in a bin is exponentially distributed, its median is ln(2) of its mean
+    return *median/M_LN2;
+}
+
+/// Work out how much a peak matters, so the most valuable work is done first. A peak
+/// feeding a pass that hasn't been decoded yet comes first, the more intervals it
+/// has the sooner. Then come peaks of transponders already known, as a decoded pass
+/// or a candidate being vetted, and then new peaks, each by how far they clear the
+/// detection threshold.
+void decoder::rank_peak(peak& pk, wallclock_t const at)
+{
+    pass_pool::slot const* const slot = find_nearest_pass(pk.bin, at);
+
+    if (nullptr != slot && !slot->p.is_decoded()) {
+        pk.rank = 0;
+        pk.score = double(slot->p.get_measure_count());
+        return;
+    }
+
+    pk.rank = nullptr != slot || (0 != m_candidate_len && nullptr != find_nearest_candidate(pk.bin, at)) ?
+        1 : 2;
+    pk.score = m_power[pk.index]/get_threshold(pk.index);
+}
+
+void decoder::find_passes(sample_t const* const sig, sample_t const* const freq, wallclock_t const at)
+{
+    profiler::scope prof(m_profiler.get(), stage::find_passes);
+
+    if (1 == m_nr_channels) {
+        m_kernels->power(freq, m_power.data(), m_fft_len);
+    } else {
+        // Peaks are searched for in the mean power of the channels, so a transponder
+        // in a fade on one antenna is still found through the others
+        std::fill(m_power.begin(), m_power.end(), 0.0);
+
+        for (size_t c = 0; c < m_nr_channels; c++) {
+            double* const power = &m_channel_power[c * m_fft_len];
+            m_kernels->power(freq + c * m_fft_len, power, m_fft_len);
+
+            for (size_t i = 0; i < m_fft_len; ++i) {
+                m_power[i] += power[i];
+            }
+        }
+
+        double const scale = 1.0/double(m_nr_channels);
+        for (size_t i = 0; i < m_fft_len; ++i) {
+            m_power[i] *= scale;
+        }
+    }
+
+    m_peaks.clear();
 
-    // TODO: optimize me a bit, at least.
     for (size_t i = 1; i < m_fft_len - 1; ++i) {
-        window[0] = std::abs(m_freq_vec[i - 1]);
-        window[1] = std::abs(m_freq_vec[i]);
-        window[2] = std::abs(m_freq_vec[i + 1]);
+        double const power = m_power[i];
 
-        if (window[1] > window[0] && window[1] > window[2] && window[1] > 500.0) {
+        if (power > m_power[i - 1] && power > m_power[i + 1] && power > get_threshold(i)) {
+            peak pk;
+            pk.index = i;
             // the actual bin ID is rotated by half the length of the FFT
-            freq_t bin_id = (i + (m_fft_len/2)) % m_fft_len;
+            pk.bin = (i + (m_fft_len/2)) % m_fft_len;
             // Using the bin ID and the length of the FFT, calculate our offset, in Hz, from baseband
-            double peak_freq = (double(bin_id) * double(m_sampling_rate)/double(m_fft_len)) - float(m_sampling_rate)/2.0;
+            pk.freq = (double(pk.bin) * double(m_sampling_rate)/double(m_fft_len)) - float(m_sampling_rate)/2.0;
+            rank_peak(pk, at);
+            m_peaks.push_back(pk);
 
-            process_peak(peak_freq, bin_id, m_freq_vec[i], at);
+            if (nullptr != m_spectrum) {
+                m_spectrum->mark_peak(i);
+            }
         }
     }
+
+    if (m_peaks.empty()) {
+        return;
+    }
+
+    std::sort(m_peaks.begin(), m_peaks.end(), [](peak const& a, peak const& b) {
+            if (a.rank != b.rank) {
+                return a.rank < b.rank;
+            }
+            return a.score != b.score ? a.score > b.score : a.bin < b.bin;
+        });
+
+    // Each channel is weighted by its own noise, since the front ends may differ
+    for (size_t c = 0; c < m_nr_channels; c++) {
+        m_channel_noise[c] = estimate_interval_noise(1 == m_nr_channels ? m_power.data() : &m_channel_power[c * m_fft_len]);
+    }
+
+    for (auto const& pk : m_peaks) {
+        if (is_overdue()) {
+            // A decoded pass takes no work to feed, so its peak is still followed as if
+            // it had been processed; otherwise a drifting tag could lose its pass, and
+            // be read again. Its expiry stays where it was, as it would if processed.
+            pass_pool::slot* const slot = 1 == pk.rank ? find_nearest_pass(pk.bin, at) : nullptr;
+            if (nullptr != slot && slot->p.is_decoded()) {
+                follow_pass(slot, pk);
+                continue;
+            }
+
+            m_stats.nr_shed++;
+            m_overran = true;
+            continue;
+        }
+
+        process_peak(sig, freq, pk, at);
+    }
+}
+
+/// Return the number of samples the application must write into each interval's
+/// sample buffer.
+size_t decoder::get_required_input_samples() const
+{
+    return m_samp_t_len;
+}
+
+/// Search the spectrum of an interval for transponders, and feed them to their passes.
+/// \param sig The interval's samples, each channel m_fft_len after the last
+/// \param freq The interval's FFT, each channel m_fft_len after the last
+void decoder::process_interval(sample_t const* const sig, sample_t const* const freq, wallclock_t const at)
+{
+    m_stats.nr_intervals++;
+    if (0 != m_vetting_left) {
+        m_vetting_left--;
+    }
+
+    // Find all candidate passes
+    find_passes(sig, freq, at);
+
+    if (nullptr != m_spectrum) {
+        m_spectrum->update(m_power.data(), at);
+
+        if (at - m_spectrum->first_updated_at() >= m_spectrum_every) {
+            m_spectrum_handler(*m_spectrum);
+            m_spectrum->reset();
+        }
+    }
+
+    // Track the noise floor for adaptive detection
+    update_noise_floor();
+
+    // Reap any stale passes
+    reap_passes(at);
+
+    if (m_overran) {
+        m_stats.nr_overruns++;
+        m_overran = false;
+    }
+
+    if (nullptr != m_profiler) {
+        m_profiler->end_interval();
+    }
 }
 
 /// Given a vector of samples of T=m_interval_len uS, extract various components and
 /// process the signal. ``
+/// With several receive channels, each is read from get_sample_buffer(0, channel),
+/// and they are combined into one pass per transponder.
 /// \param sig A vector of samples, as double-precision integers.
 void decoder::process_data(wallclock_t const at)
 {
+    m_deadline = budget_clock::now() + m_budget;
+
+    if (is_idle(m_in_vec, 1)) {
+        return;
+    }
+
     // Calculate FFT for the data set
-    fftw_execute(m_plan);
+    transform(1);
 
-    // Find all candidate passes
-    find_passes(at);
+    process_interval(m_in_vec, m_freq_vec, at);
+}
 
-    // Reap any stale passes
-    reap_passes(at);
+/// Process several intervals at once, written to the sample buffers returned by
+/// get_sample_buffer(0) through get_sample_buffer(nr_intervals - 1). A full batch is
+/// transformed with a single FFTW call; the intervals are then processed in order.
+/// \param at The time each interval was captured at
+/// \param nr_intervals The number of intervals to process, at most get_batch_len()
+void decoder::process_batch(wallclock_t const* const at, size_t const nr_intervals)
+{
+    if (nr_intervals > m_batch_len) {
+        throw std::invalid_argument("nr_intervals");
+    }
+
+    if (is_idle(m_in_vec, nr_intervals)) {
+        return;
+    }
+
+    transform(nr_intervals);
+
+    // Each interval gets a budget of its own, the FFTs having been shared
+    size_t const stride = m_nr_channels * m_fft_len;
+    for (size_t i = 0; i < nr_intervals; i++) {
+        m_deadline = budget_clock::now() + m_budget;
+        process_interval(m_in_vec + i * stride, m_freq_vec + i * stride, at[i]);
+    }
 }
 
+/// Transform every channel of the first nr_intervals intervals. A full batch takes
+/// a single FFTW call.
+void decoder::transform(size_t const nr_intervals)
+{
+    profiler::scope prof(m_profiler.get(), stage::fft);
+
+    size_t const nr_ffts = nr_intervals * m_nr_channels;
+
+    if (NULL != m_batch_plan && nr_intervals == m_batch_len) {
+        fftw_execute(m_batch_plan);
+    } else if (1 == nr_ffts) {
+        fftw_execute(m_plan);
+    } else {
+        for (size_t i = 0; i < nr_ffts; i++) {
+            fftw_execute_dft(m_plan, reinterpret_cast<fftw_complex*>(m_in_vec + i * m_fft_len),
+                    reinterpret_cast<fftw_complex*>(m_freq_vec + i * m_fft_len));
+        }
+    }
+}
+
+/// Write every live pass to a checkpoint, so a decoder started later can pick up
+/// where this one leaves off. Decoded passes are kept too, so the same tag isn't
+/// read again after a restart, but without their accumulated signal.
+/// \param os Where to write this decoder's section of the checkpoint
+/// \param at The wallclock of the last interval processed
+/// \throw std::runtime_error if the checkpoint couldn't be written
+void decoder::save_checkpoint(std::ostream& os, wallclock_t const at) const
+{
+    checkpoint_header hdr;
+
+    hdr.magic = checkpoint_magic;
+    hdr.version = checkpoint_version;
+    hdr.centre_freq = m_centre_freq;
+    hdr.sampling_rate = m_sampling_rate;
+    hdr.samples_per_interval = m_samp_t_len;
+    hdr.fft_len = m_fft_len;
+    hdr.nr_channels = m_nr_channels;
+    hdr.saved_at = at;
+    hdr.nr_passes = std::count_if(m_passes.begin(), m_passes.end(),
+            [](pass_pool::slot const* const slot) { return nullptr != slot; });
+
+    os.write(reinterpret_cast<char const*>(&hdr), sizeof(hdr));
+
+    for (pass_pool::slot const* const slot : m_passes) {
+        if (nullptr == slot) {
+            continue;
+        }
+
+        pass_checkpoint cp;
+        slot->p.save(cp);
+        cp.bin = slot->bin;
+
+        os.write(reinterpret_cast<char const*>(&cp), sizeof(cp));
+        os.write(reinterpret_cast<char const*>(slot->p.get_accumulated()), cp.nr_samples * sizeof(sample_t));
+    }
+
+    if (!os) {
+        throw std::runtime_error("failed to write checkpoint");
+    }
+}
+
+/// Pick up the passes a decoder saved with save_checkpoint(), before the first
+/// interval is processed. Only the section written by a decoder with the same center
+/// frequency, sampling rate, interval, FFT length and number of receive channels is
+/// used, and only if it was taken within the maximum pass age of now. Passes that would have expired by now are dropped.
+/// \param is The checkpoint, positioned at the start of its first section
+/// \param now The current wallclock, in microseconds
+/// \return The number of passes restored
+/// \throw std::runtime_error if the checkpoint is damaged, or isn't one
+size_t decoder::restore_checkpoint(std::istream& is, wallclock_t const now)
+{
+    std::vector<sample_t> accumulated(m_samp_t_len);
+    checkpoint_header hdr;
+    size_t nr_restored = 0;
+
+    while (is.read(reinterpret_cast<char*>(&hdr), sizeof(hdr))) {
+        if (checkpoint_magic != hdr.magic || checkpoint_version != hdr.version) {
+            throw std::runtime_error("not a pass checkpoint, or from another version");
+        }
+
+        bool const same_radio = hdr.centre_freq == m_centre_freq && hdr.sampling_rate == m_sampling_rate &&
+            hdr.samples_per_interval == m_samp_t_len && hdr.fft_len == m_fft_len &&
+            hdr.nr_channels == m_nr_channels;
+        // The radio clock can run a little ahead of the host's
+        bool const recent = (hdr.saved_at <= now ? now - hdr.saved_at : hdr.saved_at - now) <= m_max_age;
+
+        if (hdr.centre_freq == m_centre_freq && !same_radio) {
+            log() << "Checkpoint for " << m_centre_freq << "Hz was taken at another sampling rate, interval, " <<
+                "FFT length or number of receive channels, ignoring it" << std::endl;
+        } else if (same_radio && !recent) {
+            log() << "Checkpoint for " << m_centre_freq << "Hz is out of date, ignoring it" << std::endl;
+        }
+
+        for (std::uint64_t i = 0; i < hdr.nr_passes; i++) {
+            pass_checkpoint cp;
+
+            if (!is.read(reinterpret_cast<char*>(&cp), sizeof(cp))) {
+                throw std::runtime_error("checkpoint is truncated");
+            }
+
+            if (0 != cp.nr_samples && cp.nr_samples != hdr.samples_per_interval) {
+                throw std::runtime_error("checkpoint is damaged");
+            }
+
+            bool const wanted = same_radio && recent && 0 <= cp.bin && cp.bin < freq_t(m_fft_len) &&
+                nullptr == m_passes[cp.bin] && cp.last_at + m_max_age > now;
+
+            if (wanted && 0 != cp.nr_samples) {
+                is.read(reinterpret_cast<char*>(accumulated.data()), cp.nr_samples * sizeof(sample_t));
+            } else {
+                is.ignore(cp.nr_samples * sizeof(sample_t));
+            }
+
+            if (is.gcount() != std::streamsize(cp.nr_samples * sizeof(sample_t))) {
+                throw std::runtime_error("checkpoint is truncated");
+            }
+
+            pass_pool::slot* slot;
+            if (!wanted || nullptr == (slot = m_pool->acquire(cp.center_freq_delta, cp.bin))) {
+                continue;
+            }
+
+            slot->p.set_combining(m_combining);
+            slot->p.set_error_correction(m_chase_bits, m_chase_max_flips);
+            m_pool->restore(slot, cp, 0 != cp.nr_samples ? accumulated.data() : nullptr);
+            m_passes[cp.bin] = slot;
+            m_expiry.schedule(slot, cp.last_at + m_max_age);
+            nr_restored++;
+        }
+    }
+
+    if (0 != is.gcount()) {
+        throw std::runtime_error("checkpoint is truncated");
+    }
+
+    m_stats.nr_restored += nr_restored;
+
+    return nr_restored;
+}
+
+/// Return a snapshot of the decoder's counters.
+decoder_stats decoder::get_stats() const
+{
+    decoder_stats stats = m_stats;
+
+    stats.nr_pool_exhausted = m_pool->get_exhausted_count();
+    stats.nr_aligned = m_aligner->get_nr_shifted();
+
+    return stats;
+}
+
+std::ostream& operator<<(std::ostream& os, zepass::decoder_stats const& s)
+{
+    os << "Intervals processed: " << s.nr_intervals << std::endl;
+    os << "Passes created: " << s.nr_passes << std::endl;
+    os << "Passes decoded: " << s.nr_decoded << std::endl;
+    os << "Passes decoded after error correction: " << s.nr_corrected << std::endl;
+    os << "Passes expired: " << s.nr_expired << std::endl;
+    os << "Intervals skipped by the energy gate: " << s.nr_skipped << std::endl;
+    os << "Tags found on a watchlist: " << s.nr_watchlisted << std::endl;
+    os << "Intervals moved into line with their pass: " << s.nr_aligned << std::endl;
+    os << "Peaks dropped, pass pool exhausted: " << s.nr_pool_exhausted << std::endl;
+    os << "Passes restored from a checkpoint: " << s.nr_restored << std::endl;
+    os << "Intervals that ran out of time: " << s.nr_overruns << std::endl;
+    os << "Peaks shed for lack of time: " << s.nr_shed << std::endl;
+    os << "Decodes deferred for lack of time: " << s.nr_deferred << std::endl;
+
+    return os;
+}
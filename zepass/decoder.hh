@@ -20,12 +20,23 @@
 #pragma once
 
 #include <zepass/types.hh>
+#include <zepass/aligner.hh>
+#include <zepass/arena.hh>
+#include <zepass/candidate_pool.hh>
+#include <zepass/kernels.hh>
 #include <zepass/pass.hh>
+#include <zepass/pass_pool.hh>
+#include <zepass/profiler.hh>
+#include <zepass/spectrum.hh>
+#include <zepass/timing_wheel.hh>
+#include <zepass/watchlist.hh>
 
+#include <chrono>
 #include <complex>
-#include <fstream>
+#include <functional>
+#include <istream>
 #include <memory>
-#include <map>
+#include <ostream>
 #include <vector>
 
 #include <fftw3.h>
@@ -34,34 +45,173 @@ namespace zepass {
 
 class pass;
 
+///
+/// \brief Counters describing what a decoder has been up to.
+///
+struct decoder_stats {
+    size_t nr_intervals = 0; //< Intervals processed
+    size_t nr_passes = 0; //< Passes created
+    size_t nr_decoded = 0; //< Passes successfully decoded
+    size_t nr_corrected = 0; //< Passes decoded only after error correction
+    size_t nr_expired = 0; //< Passes reaped for being out of date
+    size_t nr_pool_exhausted = 0; //< Peaks dropped because every pass slot was in use
+    size_t nr_skipped = 0; //< Intervals skipped by the energy gate
+    size_t nr_watchlisted = 0; //< Decoded tags found on a watchlist
+    size_t nr_aligned = 0; //< Intervals moved into line with their pass before accumulating
+    size_t nr_restored = 0; //< Passes picked up from a checkpoint
+    size_t nr_overruns = 0; //< Intervals that ran out of time before all their work was done
+    size_t nr_shed = 0; //< Peaks dropped because the interval ran out of time
+    size_t nr_deferred = 0; //< Decode attempts put off to a later interval for lack of time
+};
+
 class decoder {
 public:
+    /// Called with each pass as soon as it is decoded
+    typedef std::function<void(pass const&)> read_handler_t;
+
     decoder(freq_t const centre_freq, freq_t const sampling_rate, size_t const interval_len,
-            wallclock_t const max_age, std::shared_ptr<std::ofstream> out_file);
+            wallclock_t const max_age, size_t const batch_len = 1, arena::ptr_t mem = nullptr, size_t const max_passes = 64,
+            size_t const fft_len = 0, size_t const nr_channels = 1);
     ~decoder();
 
     void process_data(wallclock_t const at);
+    void process_batch(wallclock_t const* const at, size_t const nr_intervals);
     size_t get_required_input_samples() const;
-    sample_t* get_sample_buffer() { return m_in_vec; }
+    sample_t* get_sample_buffer(size_t const interval = 0, size_t const channel = 0)
+    {
+        return m_in_vec + (interval * m_nr_channels + channel) * m_fft_len;
+    }
     size_t get_fft_len() const { return m_fft_len; }
+    size_t get_nr_channels() const { return m_nr_channels; }
+    size_t get_batch_len() const { return m_batch_len; }
+    void set_drift_tolerance(double const tolerance_hz);
+    void set_max_age(wallclock_t const max_age);
+    void set_detection_threshold(double const threshold);
+    void set_cfar(double const false_alarm_rate, size_t const window);
+    void set_candidate_validation(size_t const nr_intervals, double const threshold);
+    void set_combining(combining const mode, double const decode_snr_db);
+    void set_error_correction(size_t const max_bits, size_t const max_flips);
+    void set_alignment(double const max_shift_us);
+    void set_energy_gate(double const gate_db, size_t const refresh);
+    void set_budget(double const budget_us);
+    void set_profiler(profiler::ptr_t const& prof);
+    void add_read_handler(read_handler_t const& handler);
+    void set_spectrum_report(size_t const nr_bins, wallclock_t const report_every,
+                             spectrum_monitor::report_handler_t const& handler);
+    void set_watchlist(watchlist::ptr_t const& list);
+    watchlist::ptr_t get_watchlist() const;
+    decoder_stats get_stats() const;
+    void save_checkpoint(std::ostream& os, wallclock_t const at) const;
+    size_t restore_checkpoint(std::istream& is, wallclock_t const now);
+
+    /// Return whether any pass first seen before started_before, and fed since updated_since,
+    /// is still waiting to be decoded
+    bool has_undecoded(wallclock_t const started_before, wallclock_t const updated_since) const
+    {
+        return m_pool->has_undecoded(started_before, updated_since);
+    }
+
+    /// Return the number of passes still waiting to be decoded
+    size_t get_nr_undecoded() const { return m_pool->get_nr_undecoded(); }
 
 private:
-    void find_passes(wallclock_t const at);
+    typedef std::chrono::steady_clock budget_clock;
+
+    ///
+    /// \brief A peak found in an interval, waiting its turn to be processed.
+    ///
+    struct peak {
+        size_t index; //< Index of the peak in the FFT output
+        freq_t bin; //< FFT bin, rotated so bin 0 is the lowest frequency
+        double freq; //< Offset from the center frequency, in Hz
+        unsigned rank; //< 0 for an undecoded pass, 1 for a known transponder, 2 for a new peak
+        double score; //< Order within the rank, highest first
+    };
+
+    void process_interval(sample_t const* const sig, sample_t const* const freq, wallclock_t const at);
+    void find_passes(sample_t const* const sig, sample_t const* const freq, wallclock_t const at);
     void reap_passes(wallclock_t const at);
-    void process_peak(double peak_freq, freq_t peak_bin, sample_t const peak, wallclock_t const at);
+    void update_noise_floor();
+    bool is_idle(sample_t const* const sig, size_t const nr_intervals);
+    double estimate_interval_noise(double const* const power);
+    double get_threshold(size_t const bin) const;
+    void transform(size_t const nr_intervals);
+    void process_peak(sample_t const* const sig, sample_t const* const freq, peak const& pk, wallclock_t const at);
+    bool vet_candidate(sample_t const* const sig, double peak_freq, freq_t peak_bin, sample_t const peak,
+                       wallclock_t const at);
+    void rank_peak(peak& pk, wallclock_t const at);
 
-    std::map<freq_t, zepass::pass::ptr_t> m_passes; //< std::map of passes, by bin index
-    sample_t* m_freq_vec; //< Memory to contain FFT of input signal
-    sample_t* m_in_vec; //< Input sample vector, populated by the application
+    /// Return whether the time budget for the current interval has run out
+    bool is_overdue() const { return budget_clock::duration::zero() != m_budget && budget_clock::now() >= m_deadline; }
+    pass_pool::slot* find_nearest_pass(freq_t const peak_bin, wallclock_t const at);
+    candidate_pool::slot* find_nearest_candidate(freq_t const peak_bin, wallclock_t const at);
+    void release_candidate(candidate_pool::slot* const slot);
+    void merge_neighbours(pass_pool::slot* const slot, wallclock_t const at);
+    void release_pass(pass_pool::slot* const slot);
+    void follow_pass(pass_pool::slot* const slot, peak const& pk);
+
+    std::vector<pass_pool::slot*> m_passes; //< Live passes, indexed by bin, or null
+    std::vector<candidate_pool::slot*> m_candidates; //< Peaks not yet promoted to passes, indexed by bin, or null
+    sample_t* m_freq_vec; //< Memory to contain FFT of input signal, for each channel of each interval in a batch
+    sample_t* m_in_vec; //< Input sample vectors, populated by the application, m_fft_len apart
+    std::vector<double> m_power; //< Power in each FFT bin for the current interval, the mean of every channel
+    std::vector<double> m_channel_power; //< Power in each FFT bin of each channel, if there is more than one
+    std::vector<double> m_channel_noise; //< Noise power per FFT bin of each channel in the current interval
+    std::vector<sample_t const*> m_channel_sig; //< Samples of each channel of the peak being accumulated
+    std::vector<sample_t> m_channel_peak; //< FFT peak in each channel of the peak being accumulated
+    std::vector<double> m_noise_floor; //< Running average of the power in each FFT bin
+    std::vector<double> m_scratch; //< Working space for estimating the noise in an interval
+    size_t m_nr_noise_updates = 0; //< Number of FFTs folded into the noise floor estimate
+    double m_threshold = 500.0; //< Fixed peak magnitude threshold, when CFAR is not in use
+    double m_cfar_pfa = 0.0; //< CFAR false alarm rate target per bin, or 0 if disabled
+    size_t m_cfar_window = 32; //< Number of FFTs the noise floor is averaged over
+    double m_cfar_alpha = 0.0; //< Multiplier of the noise floor giving the CFAR threshold
+    size_t m_candidate_len = 0; //< Intervals to vet a new peak for before promoting it, or 0 to not vet
+    size_t m_vetting_left = 0; //< Intervals to keep the energy gate open for, since a candidate was last vetted
+    double m_candidate_threshold = 0.33; //< Minimum envelope modulation index of a candidate to promote it
+    wallclock_t m_candidate_holdoff = 1000000; //< How long a rejected candidate is ignored, in microseconds
+    combining m_combining = combining::maximal_ratio; //< How passes weight the intervals they accumulate
+    size_t m_chase_bits = 0; //< Least reliable bits error correction may flip, or 0 to disable it
+    size_t m_chase_max_flips = 3; //< Most bits error correction may flip at once
+    double m_decode_snr = 0.0; //< SNR (power ratio) at which to start trying to decode a pass, or 0 to wait
+    double m_gate_ratio = 0.0; //< Power over the idle floor that opens the energy gate, or 0 if it is disabled
+    double m_gate_floor = 0.0; //< Running average of the power of idle intervals
+    size_t m_gate_window = 32; //< Number of intervals the idle floor is averaged over
+    size_t m_nr_gate_updates = 0; //< Number of intervals folded into the idle floor
+    size_t m_gate_refresh = 40; //< Idle intervals skipped in a row before one is processed anyway
+    size_t m_nr_gate_skipped = 0; //< Idle intervals skipped since the last one processed
+    std::vector<peak> m_peaks; //< Peaks found in the current interval, in the order to process them
+    budget_clock::duration m_budget = budget_clock::duration::zero(); //< Time allowed per interval, or zero for no limit
+    budget_clock::time_point m_deadline; //< When the current interval's time runs out
+    bool m_overran = false; //< Whether the current interval has run out of time
     freq_t m_centre_freq; //< The centre frequency of all sampling
     freq_t m_sampling_rate; //< The sampling rate, in Hz, of the signal
     size_t m_fft_len; //< The length of the FFT output, in bins
     size_t m_samp_t_len; //< The length, in samples, of the chirp.
-    fftw_plan m_plan;
+    freq_t m_bin_tolerance = 1; //< How many bins a pass may drift between intervals and still be tracked
+    size_t m_batch_len; //< The number of intervals that can be transformed at once
+    size_t m_nr_channels; //< Phase-coherent receive channels in each interval, each m_fft_len apart
+    fftw_plan m_plan; //< Plan to transform a single interval
+    fftw_plan m_batch_plan = NULL; //< Plan to transform every channel of a whole batch of intervals at once
     wallclock_t m_interval_len; //< Length of the capture interval, in microseconds
     wallclock_t m_max_age; //< Maximum age of a pass, if decoded or failed to decode
-    std::shared_ptr<std::ofstream> m_out_file; //< File to write records to, one per line
+    std::vector<read_handler_t> m_read_handlers; //< Where decoded passes are sent
+    arena::ptr_t m_arena; //< Arena the sample and FFT buffers live in, or null if they're from fftw_malloc
+    std::unique_ptr<pass_pool> m_pool; //< Storage for every pass
+    std::unique_ptr<candidate_pool> m_candidate_pool; //< Storage for every candidate
+    std::unique_ptr<aligner> m_aligner; //< Lines intervals up with their pass, shared by every pass
+    timing_wheel m_expiry; //< When each live pass goes out of date
+    kernel_set const* m_kernels = nullptr; //< Inner loops, specialized for this configuration
+    std::unique_ptr<spectrum_monitor> m_spectrum; //< Survey of the spectrum, or null if not wanted
+    wallclock_t m_spectrum_every = 0; //< How often the spectrum survey is reported, in microseconds
+    spectrum_monitor::report_handler_t m_spectrum_handler; //< Where spectrum reports are sent
+    watchlist::ptr_t m_watchlist; //< Index decoded tags are checked against, or null. Only touched atomically.
+    profiler::ptr_t m_profiler; //< Where the time spent in each stage is charged, or null
+    decoder_stats m_stats; //< Running counters
 };
 
 } // end namespace zepass
 
+/// ostream operator to render the decoder counters, one per line
+std::ostream& operator<<(std::ostream& os, zepass::decoder_stats const& s);
+
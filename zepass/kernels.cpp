@@ -0,0 +1,74 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <zepass/kernels.hh>
+#include <zepass/priv.hh>
+
+using namespace zepass;
+
+namespace {
+
+template<std::size_t Samples>
+kernel_set make_kernel_set()
+{
+    constexpr std::size_t fft_len = 0 != Samples ? priv::round_nearest_power_2(Samples) : 0;
+
+    return kernel_set {
+        Samples,
+        fft_len,
+        &kernels::accumulate<Samples>,
+        &kernels::slice<Samples>,
+        &kernels::power<fft_len>,
+        &kernels::energy<Samples>
+    };
+}
+
+#if !defined(_GENERIC_KERNELS)
+/// The configurations worth specializing: 2, 3 (the default) and 4 Msps, and the
+/// wideband 10, 20 and 25 Msps, with the 580uS capture interval.
+kernel_set const specialized[] = {
+    make_kernel_set<1740>(),
+    make_kernel_set<1160>(),
+    make_kernel_set<2320>(),
+    make_kernel_set<5800>(),
+    make_kernel_set<11600>(),
+    make_kernel_set<14500>(),
+};
+#endif // !defined(_GENERIC_KERNELS)
+
+kernel_set const generic = make_kernel_set<0>();
+
+}
+
+/// Find the kernels specialized for the given interval and FFT lengths, falling
+/// back to the generic kernels if there are none.
+/// \param samples_per_interval The number of samples in a capture interval
+/// \param fft_len The length of the FFT the power kernel is used on, or 0 if it isn't
+kernel_set const& zepass::select_kernels(std::size_t const samples_per_interval, std::size_t const fft_len)
+{
+#if !defined(_GENERIC_KERNELS)
+    for (auto const& k: specialized) {
+        if (k.samples_per_interval == samples_per_interval && (0 == fft_len || k.fft_len == fft_len)) {
+            return k;
+        }
+    }
+#endif // !defined(_GENERIC_KERNELS)
+
+    return generic;
+}
@@ -0,0 +1,134 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <zepass/types.hh>
+
+#include <cstddef>
+
+#include <cmath>
+
+namespace zepass {
+
+///
+/// \brief Inner loops of the signal chain, specialized by length.
+/// Each kernel takes its length as a template parameter; an extent of 0 means
+/// the length is only known at runtime and is taken from the argument instead.
+/// With a fixed extent the compiler can fully unroll and vectorize the loop.
+/// The complex arithmetic is written out by hand, since std::complex
+/// multiplication is not vectorized without -ffast-math.
+///
+namespace kernels {
+
+/// Rotate the signal by the given phase, shift it by the baseband vector, and add
+/// it to the accumulator.
+template<std::size_t Extent>
+void accumulate(sample_t* const acc, sample_t const* const sig, sample_t const* const shift,
+                sample_t const rotate, std::size_t const n)
+{
+    std::size_t const len = 0 != Extent ? Extent : n;
+    double const rr = rotate.real(),
+                 ri = rotate.imag();
+
+    double* const a = reinterpret_cast<double*>(acc);
+    double const* const s = reinterpret_cast<double const*>(sig);
+    double const* const h = reinterpret_cast<double const*>(shift);
+
+    for (std::size_t i = 0; i < len; i++) {
+        double const xr = s[2 * i] * rr - s[2 * i + 1] * ri,
+                     xi = s[2 * i] * ri + s[2 * i + 1] * rr;
+        a[2 * i] += xr * h[2 * i] - xi * h[2 * i + 1];
+        a[2 * i + 1] += xr * h[2 * i + 1] + xi * h[2 * i];
+    }
+}
+
+/// Hard slice the envelope of the signal: 1 where the magnitude is above the
+/// average magnitude, -1 otherwise.
+template<std::size_t Extent>
+void slice(sample_t const* const sig, int* const out, std::size_t const n)
+{
+    std::size_t const len = 0 != Extent ? Extent : n;
+    double const* const s = reinterpret_cast<double const*>(sig);
+
+    double sum = 0.0;
+    for (std::size_t i = 0; i < len; i++) {
+        sum += std::sqrt(s[2 * i] * s[2 * i] + s[2 * i + 1] * s[2 * i + 1]);
+    }
+
+    // Compare squared magnitudes, to avoid taking the square root twice
+    double const average = sum/double(len),
+                 limit = average * average;
+
+    for (std::size_t i = 0; i < len; i++) {
+        out[i] = s[2 * i] * s[2 * i] + s[2 * i + 1] * s[2 * i + 1] > limit ? 1 : -1;
+    }
+}
+
+/// Calculate the power in each bin of a spectrum.
+template<std::size_t Extent>
+void power(sample_t const* const freq, double* const out, std::size_t const n)
+{
+    std::size_t const len = 0 != Extent ? Extent : n;
+    double const* const f = reinterpret_cast<double const*>(freq);
+
+    for (std::size_t i = 0; i < len; i++) {
+        out[i] = f[2 * i] * f[2 * i] + f[2 * i + 1] * f[2 * i + 1];
+    }
+}
+
+/// Calculate the total power of a signal. The real and imaginary parts are summed
+/// separately, so the sum can be vectorized without reassociating it.
+template<std::size_t Extent>
+double energy(sample_t const* const sig, std::size_t const n)
+{
+    std::size_t const len = 0 != Extent ? Extent : n;
+    double const* const s = reinterpret_cast<double const*>(sig);
+
+    double sum_r = 0.0,
+           sum_i = 0.0;
+
+    for (std::size_t i = 0; i < len; i++) {
+        sum_r += s[2 * i] * s[2 * i];
+        sum_i += s[2 * i + 1] * s[2 * i + 1];
+    }
+
+    return sum_r + sum_i;
+}
+
+} // end namespace kernels
+
+///
+/// \brief A set of kernels instantiated for one radio configuration.
+///
+struct kernel_set {
+    std::size_t samples_per_interval; //< Interval length this set is specialized for, 0 if generic
+    std::size_t fft_len; //< FFT length this set is specialized for, 0 if generic
+
+    void (*accumulate)(sample_t* const, sample_t const* const, sample_t const* const, sample_t const, std::size_t const);
+    void (*slice)(sample_t const* const, int* const, std::size_t const);
+    void (*power)(sample_t const* const, double* const, std::size_t const);
+    double (*energy)(sample_t const* const, std::size_t const);
+
+    bool is_generic() const { return 0 == samples_per_interval; }
+};
+
+kernel_set const& select_kernels(std::size_t const samples_per_interval, std::size_t const fft_len = 0);
+
+} // end namespace zepass
@@ -0,0 +1,112 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+#include <zepass/log.hh>
+
+#include <atomic>
+#include <ios>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+using namespace zepass;
+
+namespace {
+
+/// Where logged lines go, or null to throw them away. Only touched atomically.
+std::shared_ptr<log_handler_t const> log_handler;
+
+///
+/// \brief Stream buffer that collects what is written to it into lines, and
+/// hands each complete line to the log handler.
+///
+class line_buffer : public std::streambuf {
+protected:
+    int_type overflow(int_type const c) override
+    {
+        if (traits_type::eq_int_type(c, traits_type::eof())) {
+            return traits_type::not_eof(c);
+        }
+
+        if ('\n' == traits_type::to_char_type(c)) {
+            auto const handler = std::atomic_load(&log_handler);
+            if (nullptr != handler) {
+                (*handler)(m_line.c_str());
+            }
+            m_line.clear();
+        } else {
+            m_line.push_back(traits_type::to_char_type(c));
+        }
+
+        return c;
+    }
+
+    std::streamsize xsputn(char const* const s, std::streamsize const n) override
+    {
+        for (std::streamsize i = 0; i < n; i++) {
+            overflow(traits_type::to_int_type(s[i]));
+        }
+
+        return n;
+    }
+
+public:
+    /// Return whether nothing has been written since the last complete line
+    bool at_line_start() const { return m_line.empty(); }
+
+private:
+    std::string m_line; //< The line being built up
+};
+
+} // end anonymous namespace
+
+/// Send each line the decoder logs to a handler. Lines are logged from whichever
+/// thread the decoder runs on, so the handler must be safe to call from all of
+/// them. By default, nothing is logged anywhere.
+/// \param handler The handler, or an empty function to stop logging
+void zepass::set_log_handler(log_handler_t const& handler)
+{
+    std::atomic_store(&log_handler, handler ? std::make_shared<log_handler_t const>(handler) :
+            std::shared_ptr<log_handler_t const>());
+}
+
+/// Return the stream the calling thread logs to. Each thread has its own, so lines
+/// from different threads don't interleave. While there is no log handler, the
+/// stream is kept in a failed state, so nothing is even formatted.
+std::ostream& zepass::log()
+{
+    static thread_local line_buffer buf;
+    static thread_local std::ostream os(&buf);
+
+    if (nullptr != std::atomic_load(&log_handler)) {
+        os.clear();
+
+        // Don't let std::fixed, a precision and the like carry over from the last line
+        if (buf.at_line_start()) {
+            os.flags(std::ios_base::dec | std::ios_base::skipws);
+            os.precision(6);
+            os.width(0);
+            os.fill(' ');
+        }
+    } else {
+        os.setstate(std::ios::badbit);
+    }
+
+    return os;
+}
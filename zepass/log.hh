@@ -0,0 +1,32 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+#pragma once
+
+#include <functional>
+#include <ostream>
+
+namespace zepass {
+
+/// Called with each line the decoder logs, without its newline
+typedef std::function<void(char const* line)> log_handler_t;
+
+void set_log_handler(log_handler_t const& handler);
+std::ostream& log();
+
+} // end namespace zepass
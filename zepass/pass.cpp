@@ -18,15 +18,19 @@
 //
 
 #include <zepass/pass.hh>
+#include <zepass/log.hh>
 #include <zepass/types.hh>
 #include <zepass/priv.hh>
+#include <zepass/serializer.hh>
 
 #include <boost/crc.hpp>
 
 #include <algorithm>
+#include <array>
+#include <bitset>
 #include <complex>
-#include <iomanip>
 #include <iostream>
+#include <limits>
 #include <numeric>
 
 #include <cmath>
@@ -36,26 +40,12 @@ using namespace zepass;
 std::ostream& operator<<(std::ostream& os, zepass::pass const& p)
 {
     if (p.is_decoded()) {
-        std::time_t now = std::time(nullptr);
-        std::tm utc;
-        gmtime_r(&now, &utc);
-
-        os << std::dec << "{\"passHeader\":" << p.get_header() <<
-            ", \"tagType\":" << p.get_tag_type() <<
-            ", \"appId\":" << p.get_app_id() <<
-            ", \"groupId\":" << p.get_group_id() <<
-            ", \"agencyId\":" << p.get_agency_id() <<
-            ", \"serialNum\":" << p.get_serial_number() <<
-            ", \"lastSeenAt\":" << p.last_updated_at() <<
-            ", \"nrSamples\":" << p.get_measure_count() <<
-            ", \"centerFreqDelta\":"<< p.get_center_freq_delta() <<
-            ", \"seenAt\": \"" << std::setfill('0') <<
-                std::setw(4) << utc.tm_year + 1900 << "-" <<
-                std::setw(2) << utc.tm_mon + 1 << "-" <<
-                std::setw(2) << utc.tm_mday << " " <<
-                std::setw(2) << utc.tm_hour << ":" <<
-                std::setw(2) << utc.tm_min << ":" <<
-                std::setw(2) << utc.tm_sec << "\"" << "}";
+        record_serializer serializer;
+        read_record rec;
+        char buf[record_serializer::max_json_len];
+
+        p.fill_record(rec);
+        os.write(buf, serializer.write_json(rec, buf, sizeof(buf)));
     } else {
         os << "{\"decoded\":false, \"lastSeenAt\":" << p.last_updated_at() <<
             ", \"nrSamples\":" << p.get_measure_count() <<
@@ -65,47 +55,198 @@ std::ostream& operator<<(std::ostream& os, zepass::pass const& p)
     return os;
 }
 
-pass::ptr_t pass::make_pass(double const center_freq_hz_delta,
-                            freq_t const samples_per_interval,
-                            freq_t const sampling_rate,
-                            size_t const interval_len)
-{
-    return std::make_unique<pass>(center_freq_hz_delta,
-                                  samples_per_interval,
-                                  sampling_rate,
-                                  interval_len);
-}
-
-
 /// Create a new state tracking object for a pass.
 /// \param center_freq_hz_delta The center frequency, in hertz, to baseband
 /// \param samples_per_interval The number of samples in a 550 uS interval
-/// \param
+/// \param sampling_rate The sampling rate of the input signal
+/// \param interval_len The length of the capture interval, in microseconds
+/// \param mem Arena to allocate the pass's buffers from, or null to use the heap
 pass::pass(double const center_freq_hz_delta,
            freq_t const samples_per_interval,
            freq_t const sampling_rate,
-           size_t const interval_len) : m_center_freq_hz(center_freq_hz_delta),
-                                        m_raw_data(),
-                                        m_baseband_shift(sample_vector_t(samples_per_interval, 0.0)),
-                                        m_accumulated(sample_vector_t(samples_per_interval, 0.0)),
-                                        m_samples_per_interval(samples_per_interval),
-                                        m_sampling_rate(sampling_rate),
-                                        m_nr_acc(0),
-                                        m_last_at(0),
-                                        m_interval_len(interval_len),
-                                        m_slice_win(m_window_size),
-                                        m_norm(std::vector<int>(samples_per_interval, 0))
+           size_t const interval_len,
+           arena* mem) : m_center_freq_hz(center_freq_hz_delta),
+                         m_raw_data(),
+                         m_baseband_shift(samples_per_interval, 0.0, arena_allocator<sample_t>(mem)),
+                         m_accumulated(samples_per_interval, 0.0, arena_allocator<sample_t>(mem)),
+                         m_samples_per_interval(samples_per_interval),
+                         m_sampling_rate(sampling_rate),
+                         m_nr_acc(0),
+                         m_last_at(0),
+                         m_interval_len(interval_len),
+                         m_decimation(slice_decimation(sampling_rate)),
+                         m_samples_per_bit(sampling_rate/500000/m_decimation),
+                         m_slice_win(m_window_size),
+                         m_decimated(1 < m_decimation ? samples_per_interval/m_decimation : 0, 0.0,
+                                 arena_allocator<sample_t>(mem)),
+                         m_norm(samples_per_interval/m_decimation, 0, arena_allocator<int>(mem)),
+                         m_envelope(samples_per_interval/m_decimation, 0.0, arena_allocator<double>(mem)),
+                         m_kernels(select_kernels(samples_per_interval)),
+                         m_slice_kernels(select_kernels(samples_per_interval/m_decimation))
 {
-    m_samples_per_bit = m_sampling_rate/500000;
-    // Pre-calculate the vector to shift to baseband
-    static double const time_delta = priv::us_to_sec(interval_len)/(m_samples_per_interval - 1);
+    calc_baseband_shift();
+}
+
+pass::~pass()
+{
+}
+
+/// Return the factor to decimate the accumulated signal by before slicing it. At
+/// high sample rates there are far more samples per bit than the slicer needs,
+/// and each one is noisier, so average them down to at least 6 samples per bit.
+size_t pass::slice_decimation(freq_t const sampling_rate)
+{
+    size_t const samples_per_bit = sampling_rate/500000;
+    size_t decimation = 1;
+
+    // The decimated signal must still have a whole number of samples per bit
+    for (size_t d = 2; samples_per_bit/d >= 6; d++) {
+        if (0 == samples_per_bit % d) {
+            decimation = d;
+        }
+    }
+
+    return decimation;
+}
+
+/// Pre-calculate the vector to shift this pass to baseband
+void pass::calc_baseband_shift()
+{
+    double const time_delta = 1.0/double(m_sampling_rate);
     for (size_t i = 0; i < m_samples_per_interval; i++) {
        m_baseband_shift[i] = std::exp(sample_t(0.0, -2.0 * M_PI * m_center_freq_hz * double(i) * time_delta));
     }
 }
 
-pass::~pass()
+/// Return the pass to its freshly constructed state, at a new center frequency,
+/// reusing its buffers.
+/// \param center_freq_hz_delta The center frequency, in hertz, to baseband
+void pass::reset(double const center_freq_hz_delta)
+{
+    std::fill(m_accumulated.begin(), m_accumulated.end(), 0.0);
+    m_raw_data.reset();
+    m_nr_corrected = 0;
+    m_watchlists = 0;
+    m_signal_sum = 0.0;
+    m_noise_sum = 0.0;
+    m_nr_acc = 0;
+    m_last_at = 0;
+    m_first_at = 0;
+    m_decoded_at = 0;
+    m_decoded = false;
+
+    m_header = 0;
+    m_tag_type = 0;
+    m_app_id = 0;
+    m_group_id = 0;
+    m_agency_id = 0;
+    m_serial_num = 0;
+
+    m_center_freq_hz = center_freq_hz_delta;
+    calc_baseband_shift();
+}
+
+/// Follow the transponder to a new center frequency. The accumulated signal is
+/// already at baseband, so only the shift applied to new intervals changes. A
+/// decoded pass accumulates nothing more, so its shift is left as it is.
+/// \param center_freq_hz_delta The new center frequency, in hertz, to baseband
+void pass::retune(double const center_freq_hz_delta)
 {
+    if (center_freq_hz_delta == m_center_freq_hz) {
+        return;
+    }
+
+    m_center_freq_hz = center_freq_hz_delta;
+
+    if (!m_decoded) {
+        calc_baseband_shift();
+    }
+}
+
+/// Fold the accumulated state of another pass tracking the same transponder
+/// into this one. Both accumulations are phase-normalized to their FFT peak, so
+/// they can be summed directly.
+/// \param other The pass to absorb. It should be discarded afterwards.
+/// \param align Aligner to line the other accumulation up with this one, or null
+void pass::merge(pass const& other, aligner* const align)
+{
+    if (m_decoded || other.m_decoded) {
+        return;
+    }
+
+    sample_t const* theirs = other.m_accumulated.data();
+
+    if (nullptr != align && 0 != m_nr_acc && 0 != other.m_nr_acc) {
+        // Both accumulations are at baseband already, so moving one doesn't turn its phase
+        theirs = align->apply_shift(theirs, align->find_shift(m_accumulated.data(), theirs, nullptr));
+    }
+
+    for (size_t i = 0; i < m_accumulated.size(); i++) {
+        m_accumulated[i] += theirs[i];
+    }
+
+    if (0 != other.m_nr_acc) {
+        m_first_at = 0 != m_nr_acc ? std::min(m_first_at, other.m_first_at) : other.m_first_at;
+    }
+
+    m_signal_sum += other.m_signal_sum;
+    m_noise_sum += other.m_noise_sum;
+    m_nr_acc += other.m_nr_acc;
+    m_last_at = std::max(m_last_at, other.m_last_at);
+}
+
+/// Describe the state of the pass for a checkpoint. The bin is left to the caller.
+/// Once the pass is decoded, its accumulated signal isn't needed any more, so it
+/// isn't counted in nr_samples.
+void pass::save(pass_checkpoint& cp) const
+{
+    cp.center_freq_delta = m_center_freq_hz;
+    cp.signal_sum = m_signal_sum;
+    cp.noise_sum = m_noise_sum;
+    cp.nr_acc = m_nr_acc;
+    cp.first_at = m_first_at;
+    cp.last_at = m_last_at;
+    cp.nr_samples = m_decoded ? 0 : m_accumulated.size();
+    cp.serial_num = m_serial_num;
+    cp.agency_id = m_agency_id;
+    cp.header = std::uint8_t(m_header);
+    cp.tag_type = std::uint8_t(m_tag_type);
+    cp.app_id = std::uint8_t(m_app_id);
+    cp.group_id = std::uint8_t(m_group_id);
+    cp.decoded = m_decoded ? 1 : 0;
+    cp.nr_corrected = std::uint8_t(m_nr_corrected);
+    cp.watchlists = m_watchlists;
+    cp.reserved = 0;
+}
+
+/// Pick up where a pass described by a checkpoint left off.
+/// \param cp The pass, as saved by save()
+/// \param accumulated Its accumulated signal, one interval long, or null if it has none
+void pass::restore(pass_checkpoint const& cp, sample_t const* const accumulated)
+{
+    reset(cp.center_freq_delta);
+
+    if (nullptr != accumulated) {
+        std::copy(accumulated, accumulated + m_accumulated.size(), m_accumulated.begin());
+    }
+
+    m_signal_sum = cp.signal_sum;
+    m_noise_sum = cp.noise_sum;
+    m_nr_acc = cp.nr_acc;
+    m_first_at = cp.first_at;
+    m_last_at = cp.last_at;
+    m_serial_num = cp.serial_num;
+    m_agency_id = cp.agency_id;
+    m_header = cp.header;
+    m_tag_type = cp.tag_type;
+    m_app_id = cp.app_id;
+    m_group_id = cp.group_id;
+    m_decoded = 0 != cp.decoded;
+    // The checkpoint doesn't keep when the pass was decoded, and its read has been
+    // reported already, so the last interval it was seen in will do
+    m_decoded_at = m_decoded ? m_last_at : 0;
+    m_nr_corrected = cp.nr_corrected;
+    m_watchlists = cp.watchlists;
 }
 
 size_t pass::find_transition(int& bit) const
@@ -125,9 +266,10 @@ size_t pass::find_transition(int& bit) const
     return 0;
 }
 
-void pass::set_bit(size_t const bit_num, int const bit_value)
+void pass::set_bit(size_t const bit_num, int const bit_value, size_t const position)
 {
     m_raw_data[bit_num] = !!bit_value;
+    m_bit_pos[bit_num] = position;
 }
 
 uint64_t pass::get_field(size_t const start, size_t const length) const
@@ -142,14 +284,15 @@ uint64_t pass::get_field(size_t const start, size_t const length) const
     return v;
 }
 
-std::uint16_t pass::calc_crc() const
+static
+std::uint16_t crc_of(std::bitset<256> const& bits)
 {
     boost::crc_optimal<16, 0x1021, 0, 0, false, false> crc;
 
     for (size_t i = 0; i < 256/8; i++) {
         uint8_t v = 0;
         for (size_t j = 0; j < 8; j++) {
-            v = (v << 1) | m_raw_data[i * 8 + j];
+            v = (v << 1) | bits[i * 8 + j];
         }
         crc(v);
     }
@@ -157,20 +300,152 @@ std::uint16_t pass::calc_crc() const
     return crc();
 }
 
+std::uint16_t pass::calc_crc() const
+{
+    return crc_of(m_raw_data);
+}
+
+/// Return the CRC of a frame with only the given bit set. The CRC has no initial
+/// value or final XOR, so it is linear: flipping a set of bits in a frame changes
+/// its CRC by the XOR of these.
+static
+std::uint16_t bit_syndrome(size_t const bit_num)
+{
+    static std::array<std::uint16_t, 256> const syndromes = []() {
+        std::array<std::uint16_t, 256> table;
+        for (size_t i = 0; i < table.size(); i++) {
+            std::bitset<256> bits;
+            bits[i] = 1;
+            table[i] = crc_of(bits);
+        }
+        return table;
+    }();
+
+    return syndromes[bit_num];
+}
+
+/// Make soft decisions on each bit, by correlating the envelope around each bit's
+/// transition against the Manchester symbol: high then low for a 1, low then high
+/// for a 0. If the frame still fails its CRC, try flipping combinations of up to
+/// m_chase_max_flips of the least reliable bits, and keep the most likely
+/// combination that fixes the CRC.
+/// \return true if the frame now passes its CRC
+bool pass::soft_decode()
+{
+    sample_t const* const sliced = 1 < m_decimation ? m_decimated.data() : m_accumulated.data();
+
+    double average = 0.0;
+    for (size_t i = 0; i < m_envelope.size(); i++) {
+        m_envelope[i] = std::abs(sliced[i]);
+        average += m_envelope[i];
+    }
+    average /= double(m_envelope.size());
+
+    size_t const half = m_samples_per_bit/2;
+
+    for (size_t b = 0; b < m_soft.size(); b++) {
+        size_t const pos = m_bit_pos[b];
+        double soft = 0.0;
+
+        for (size_t i = 0; i < half; i++) {
+            if (pos >= i + 1) {
+                soft += m_envelope[pos - i - 1] - average;
+            }
+            if (pos + i < m_envelope.size()) {
+                soft -= m_envelope[pos + i] - average;
+            }
+        }
+
+        m_soft[b] = soft;
+        m_raw_data[b] = 0.0 < soft;
+    }
+
+    std::uint16_t const syndrome = calc_crc();
+
+    if (0 == syndrome) {
+        return true;
+    }
+
+    // Rank the bits by reliability. A real transponder leaves only a few bits in
+    // doubt; if too many are, this is noise, and any CRC match would be a fluke.
+    std::array<std::uint8_t, 256> order;
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+            [this](std::uint8_t a, std::uint8_t b) { return std::fabs(m_soft[a]) < std::fabs(m_soft[b]); });
+
+    double const median = std::fabs(m_soft[order[order.size()/2]]);
+    size_t nr_weak = 0;
+
+    while (nr_weak < order.size() && std::fabs(m_soft[order[nr_weak]]) < median/2.0) {
+        nr_weak++;
+    }
+
+    if (nr_weak > m_chase_bits) {
+        return false;
+    }
+
+    size_t const nr_candidates = std::min<size_t>(std::max<size_t>(nr_weak, 1), m_chase_bits);
+
+    // Try every combination of up to m_chase_max_flips candidate bits, keeping the one
+    // that fixes the CRC with the least total reliability flipped.
+    std::uint32_t best_mask = 0;
+    double best_cost = std::numeric_limits<double>::infinity();
+
+    for (std::uint32_t mask = 1; mask < (std::uint32_t(1) << nr_candidates); mask++) {
+        if (size_t(__builtin_popcount(mask)) > m_chase_max_flips) {
+            continue;
+        }
+
+        std::uint16_t flipped = 0;
+        double cost = 0.0;
+
+        for (size_t i = 0; i < nr_candidates; i++) {
+            if (mask & (std::uint32_t(1) << i)) {
+                flipped ^= bit_syndrome(order[i]);
+                cost += std::fabs(m_soft[order[i]]);
+            }
+        }
+
+        if (flipped == syndrome && cost < best_cost) {
+            best_mask = mask;
+            best_cost = cost;
+        }
+    }
+
+    if (0 == best_mask) {
+        return false;
+    }
+
+    for (size_t i = 0; i < nr_candidates; i++) {
+        if (best_mask & (std::uint32_t(1) << i)) {
+            m_raw_data.flip(order[i]);
+            m_nr_corrected++;
+        }
+    }
+
+    return true;
+}
+
 /// Attempt to decode this pass. If successful, returns true.
 bool pass::decode()
 {
-    double average = std::accumulate(m_accumulated.begin(), m_accumulated.end(), 0.0,
-            [](double a, sample_t b) { return a + std::abs(b); })/double(m_accumulated.size());
-    std::transform(m_accumulated.begin(), m_accumulated.end(), m_norm.begin(),
-            [average](sample_t v) { double val = std::abs(v) - average; return val > 0.0 ? 1 : -1; });
+    if (1 < m_decimation) {
+        for (size_t i = 0; i < m_decimated.size(); i++) {
+            auto block = m_accumulated.begin() + i * m_decimation;
+            m_decimated[i] = std::accumulate(block, block + m_decimation, sample_t(0.0));
+        }
+
+        m_slice_kernels.slice(m_decimated.data(), m_norm.data(), m_norm.size());
+    } else {
+        m_slice_kernels.slice(m_accumulated.data(), m_norm.data(), m_norm.size());
+    }
 
 #ifdef _DUMP_RUNS
     int cur_run = 0,
         cur_sym = 0,
         nr_runs = 0;
 
-    std::cout << "Writing out " << m_norm.size() << " symbols worth of runs: ";
+    log() << "Writing out " << m_norm.size() << " symbols worth of runs: ";
 
     for (auto i: m_norm) {
         if (0 == cur_sym) {
@@ -179,7 +454,7 @@ bool pass::decode()
             continue;
         }
         if (cur_sym != i) {
-            std::cout << " " << cur_sym * cur_run;
+            log() << " " << cur_sym * cur_run;
             cur_sym = i;
             cur_run = 1;
             nr_runs++;
@@ -187,8 +462,8 @@ bool pass::decode()
             cur_run++;
         }
     }
-    std::cout << " " << cur_sym * cur_run << std::endl;
-    std::cout << "There were " << nr_runs << " runs." << std::endl;
+    log() << " " << cur_sym * cur_run << std::endl;
+    log() << "There were " << nr_runs << " runs." << std::endl;
 #endif
     m_slice_win.clear();
 
@@ -199,10 +474,10 @@ bool pass::decode()
     bool found_start = false;
 
 #if defined(_DEBUG_MFM_DECODE)
-    std::cout << "Processing " << m_norm.size() << " samples." << std::endl;
+    log() << "Processing " << m_norm.size() << " samples." << std::endl;
 #endif // defined(_DEBUG_MFM_DECODE)
 
-    while ((sample_id++) < m_norm.size() && bit_id < 256) {
+    while (++sample_id < m_norm.size() && bit_id < 256) {
         int bit = -1;
         size_t offset = 0;
 
@@ -218,7 +493,7 @@ bool pass::decode()
             if (not found_start) {
                 if (offset == m_window_size/2 and bit == 1) {
                     found_start = true;
-                    set_bit(bit_id++, bit);
+                    set_bit(bit_id++, bit, sample_id + 1 + offset - m_window_size);
                     skip = m_samples_per_bit - 1;
 
 #if defined(_DEBUG_MFM_DECODE)
@@ -248,12 +523,16 @@ bool pass::decode()
                     break;
                 }
 #endif // defined(_DEBUG_MFM_DECODE)
-                set_bit(bit_id++, bit);
+                set_bit(bit_id++, bit, sample_id + 1 + offset - m_window_size);
             }
         }
     }
 
     if (256 == bit_id) {
+        // With error correction on, fall back on soft decisions, using the bit timing
+        // the slicer recovered
+        m_decoded = calc_crc() == 0 || (0 != m_chase_bits && soft_decode());
+
         m_header = get_field(0, 3);
         m_tag_type = get_field(3, 3);
         m_app_id = get_field(6, 3);
@@ -264,46 +543,112 @@ bool pass::decode()
 #if defined(_DUMP_RAW_TAG)
         unsigned tx_crc = get_field(256-16-1, 16);
         uint16_t crc_calc = calc_crc();
-        std::cout << "Tag: " << m_header << " type=" << m_tag_type << " app=" << m_app_id
+        log() << "Tag: " << m_header << " type=" << m_tag_type << " app=" << m_app_id
             << " group=" << m_group_id << " agency=" << m_agency_id << " serial=" << std::hex
             << m_serial_num << " crc_tx=" << tx_crc << " crc_calc=" << crc_calc
-            << std::dec << std::endl;
+            << " corrected=" << std::dec << m_nr_corrected << std::endl;
 #endif // defined(_DUMP_RAW_TAG)
-        m_decoded = calc_crc() == 0;
         if (m_decoded) {
-            std::cout << *this << std::endl;
+            m_decoded_at = m_last_at;
+            log() << *this << std::endl;
         }
     }
 
     return m_decoded;
 }
 
-/// Accumulate the given sample vector of length m_samples_per_interval. This
-/// shifts the sample vector down to baseband, then simply adds it to the sample
-/// vector, after normalizing for estimated transmit phase.
+/// Accumulate the given sample vectors of length m_samples_per_interval, one for
+/// each receive channel of the same interval. This shifts each vector down to
+/// baseband, removes its phase, then adds it to the accumulated signal.
+///
+/// With maximal ratio combining, each channel of each interval is weighted by its
+/// amplitude over its noise power, so the SNR of the sum is the sum of the SNRs of
+/// everything added. Receive channels that are phase-coherent within an interval
+/// add coherently this way: a channel in a fade adds little, rather than noise.
+/// Otherwise each vector is divided by its FFT peak, which amplifies weak, noisy
+/// intervals as much as it attenuates strong ones.
 ///
-/// \param sig The signal - this is checked to be the right length
-/// \param est_phase The estimated phase (the peak from the FFT)
+/// If an aligner is given, each vector is first moved into line with what has
+/// been accumulated so far.
+///
+/// \param sigs The signal of each channel - each is checked to be the right length
+/// \param est_phases The estimated phase of each channel (its peak from the FFT)
+/// \param noise_powers The noise power in the FFT bin of the peak, in each channel
+/// \param nr_channels The number of receive channels; the interval counts once however many
 /// \param at The time, in nanoseconds since the epoch, that this occurred.
-/// 
-void pass::accumulate(sample_t const* const sig, sample_t const est_phase, wallclock_t const at)
+/// \param align Aligner to line the interval up with, or null to add it as it is
+void pass::accumulate(sample_t const* const* const sigs, sample_t const* const est_phases,
+                      double const* const noise_powers, size_t const nr_channels, wallclock_t const at,
+                      aligner* const align)
 {
     // No need to accumulate if we've already successfully decoded
     if (m_decoded) {
         return;
     }
 
-    // Normalize by phase, then shift the signal to baseband, and accumulate
-    // the measured signals, such that the signal at baseband accumulates
-    // coherently.
-    for (size_t i = 0; i < m_accumulated.size(); i++) {
-        m_accumulated[i] += (sig[i]/est_phase) * m_baseband_shift[i];
+    for (size_t c = 0; c < nr_channels; c++) {
+        sample_t const est_phase = est_phases[c];
+        double const magnitude = std::abs(est_phase);
+
+        // Until there is a noise estimate, assume the peak is at 0dB SNR
+        double const noise = 0.0 < noise_powers[c] ? noise_powers[c] : magnitude * magnitude;
+
+        sample_t rotate;
+        double weight;
+
+        switch (m_combining) {
+        case combining::maximal_ratio:
+            rotate = std::conj(est_phase)/noise;
+            weight = magnitude/noise;
+            break;
+        case combining::peak_normalized:
+        default:
+            rotate = 1.0/est_phase;
+            weight = 1.0/magnitude;
+            break;
+        }
+
+        sample_t const* aligned = sigs[c];
+
+        if (nullptr != align && (0 != m_nr_acc || 0 != c)) {
+            std::ptrdiff_t const offset = align->find_shift(m_accumulated.data(), sigs[c], m_baseband_shift.data());
+
+            if (0 != offset) {
+                // The baseband shift is a pure tone, so starting it offset samples later
+                // only turns it by a constant phase
+                rotate *= std::polar(1.0, -2.0 * M_PI * m_center_freq_hz * double(offset)/double(m_sampling_rate));
+                aligned = align->apply_shift(sigs[c], offset);
+            }
+        }
+
+        m_kernels.accumulate(m_accumulated.data(), aligned, m_baseband_shift.data(),
+                rotate, m_accumulated.size());
+
+        m_signal_sum += weight * magnitude;
+        m_noise_sum += weight * weight * noise;
+    }
+
+    if (0 == m_nr_acc) {
+        m_first_at = at;
     }
 
     m_nr_acc++;
     m_last_at = at;
 }
 
+/// Return the estimated signal to noise ratio of the accumulated signal, per
+/// sample, as a power ratio.
+double pass::get_snr() const
+{
+    if (0.0 >= m_noise_sum) {
+        return 0.0;
+    }
+
+    // The FFT peak sums the interval coherently, so is m_samples_per_interval
+    // times the SNR of a single sample.
+    return m_signal_sum * m_signal_sum/(m_noise_sum * double(m_samples_per_interval));
+}
+
 void pass::dump_to_file(std::shared_ptr<std::ofstream> ofs) const
 {
     std::vector<std::complex<float>> cfv(m_accumulated.size());
@@ -311,3 +656,21 @@ void pass::dump_to_file(std::shared_ptr<std::ofstream> ofs) const
     ofs->write(reinterpret_cast<char const*>(&cfv.at(0)), sizeof(std::complex<float>) * m_accumulated.size());
 }
 
+
+/// Fill in the fixed-layout record of a decoded pass. Both of its times are interval
+/// wallclocks, so replaying a capture gives the same records whenever it is run.
+void pass::fill_record(read_record& rec) const
+{
+    rec.last_seen_at = m_last_at;
+    rec.decoded_at = m_decoded_at;
+    rec.center_freq_delta = m_center_freq_hz;
+    rec.serial_num = m_serial_num;
+    rec.nr_samples = std::uint32_t(m_nr_acc);
+    rec.agency_id = std::uint16_t(m_agency_id);
+    rec.header = std::uint8_t(m_header);
+    rec.tag_type = std::uint8_t(m_tag_type);
+    rec.app_id = std::uint8_t(m_app_id);
+    rec.group_id = std::uint8_t(m_group_id);
+    rec.flags = std::uint16_t((0 != m_nr_corrected ? read_flag_corrected : 0) |
+        m_watchlists << read_flag_watchlist_shift);
+}
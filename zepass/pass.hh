@@ -20,9 +20,16 @@
 #pragma once
 
 #include <zepass/types.hh>
+#include <zepass/aligner.hh>
+#include <zepass/arena.hh>
+#include <zepass/checkpoint.hh>
+#include <zepass/kernels.hh>
+#include <zepass/record.hh>
 
 #include <boost/circular_buffer.hpp>
 
+#include <algorithm>
+#include <array>
 #include <bitset>
 #include <complex>
 #include <cstdint>
@@ -32,29 +39,66 @@
 
 namespace zepass {
 
+///
+/// \brief How the intervals of a pass are weighted when they are combined.
+///
+enum class combining {
+    peak_normalized, //< Divide each interval by its FFT peak, so all contribute at unit amplitude
+    maximal_ratio, //< Remove the phase of the FFT peak, and weight by amplitude over noise power
+};
+
 ///
 /// \brief Object to describe an EZ-Pass.
 /// Provides decoding, signal interpretation and similar.
 ///
 class pass {
 public:
-    ///
-    /// Create a new E-Z Pass state object.
-    ///
-    static std::shared_ptr<pass> make_pass(double const center_freq_hz_delta,
-                                           freq_t const samples_per_interval,
-                                           freq_t const sampling_rate,
-                                           size_t const interval_len);
     ~pass();
 
-    typedef std::shared_ptr<pass> ptr_t; //< Pointer type for a pass
-
     /// Return the difference between the radio center frequency and the center
     /// frequency of this pass.
     double get_center_freq_delta() const { return m_center_freq_hz; }
 
-    void accumulate(sample_t const* const sig, sample_t const est_phase, wallclock_t const at);
+    void accumulate(sample_t const* const* const sigs, sample_t const* const est_phases,
+                    double const* const noise_powers, size_t const nr_channels, wallclock_t const at,
+                    aligner* const align = nullptr);
+
+    /// Accumulate a single receive channel; see the multi-channel accumulate()
+    void accumulate(sample_t const* const sig, sample_t const est_phase, double const noise_power,
+                    wallclock_t const at, aligner* const align = nullptr)
+    {
+        accumulate(&sig, &est_phase, &noise_power, 1, at, align);
+    }
+    void set_combining(combining const mode) { m_combining = mode; }
+
+    /// Set how many of the least reliable bits may be considered for flipping when a
+    /// frame fails its CRC (at most 24), and how many of them may be flipped at once.
+    void set_error_correction(size_t const max_bits, size_t const max_flips)
+    {
+        m_chase_bits = std::min<size_t>(max_bits, 24);
+        m_chase_max_flips = max_flips;
+    }
+
+    /// Return the number of bits flipped by error correction to decode this pass
+    size_t get_corrected_bits() const { return m_nr_corrected; }
+    double get_snr() const;
+
+    /// Set the watchlists the decoded tag is on, bit n for list n
+    void set_watchlists(std::uint8_t const lists) { m_watchlists = lists; }
+
+    /// Return the watchlists the decoded tag is on, bit n for list n
+    std::uint8_t get_watchlists() const { return m_watchlists; }
+
+    void retune(double const center_freq_hz_delta);
+    void merge(pass const& other, aligner* const align = nullptr);
+    void save(pass_checkpoint& cp) const;
+    void restore(pass_checkpoint const& cp, sample_t const* const accumulated);
+
+    /// Return the accumulated signal, one interval long
+    sample_t const* get_accumulated() const { return m_accumulated.data(); }
+
     void dump_to_file(std::shared_ptr<std::ofstream> ofs) const;
+    void fill_record(read_record& rec) const;
     bool decode();
 
     bool is_ready() const;
@@ -68,11 +112,17 @@ public:
     /// Return the last time (relatively) that we updated the pass
     wallclock_t last_updated_at() const { return m_last_at; }
 
+    /// Return the time of the first interval accumulated into the pass
+    wallclock_t first_seen_at() const { return m_first_at; }
+
     /// Constructor for an E-Z Pass object.
     pass(double const center_freq_hz_delta,
          freq_t const samples_per_interval,
          freq_t const sampling_rate,
-         size_t const interval_len);
+         size_t const interval_len,
+         arena* mem = nullptr);
+
+    void reset(double const center_freq_hz_delta);
 
     unsigned get_header() const { return m_header; }
     unsigned get_tag_type() const { return m_tag_type; }
@@ -83,21 +133,32 @@ public:
 
 private:
 
+    static size_t slice_decimation(freq_t const sampling_rate);
+    void calc_baseband_shift();
     size_t find_transition(int& bit) const;
-    void set_bit(std::size_t const bit_num, int const bit_value);
+    void set_bit(std::size_t const bit_num, int const bit_value, std::size_t const position);
+    bool soft_decode();
     uint64_t get_field(size_t const start, size_t const length) const;
     std::uint16_t calc_crc() const;
 
     double m_center_freq_hz;
     std::bitset<256> m_raw_data; //< Bit vector of sliced/converted values
-    sample_vector_t m_baseband_shift; //< Vector of values to shift this pass to baseband
-    sample_vector_t m_accumulated; //< the accumulated sample vector
+    typedef std::vector<sample_t, arena_allocator<sample_t>> buffer_t;
+
+    buffer_t m_baseband_shift; //< Vector of values to shift this pass to baseband
+    buffer_t m_accumulated; //< the accumulated sample vector
+    double m_signal_sum = 0.0; //< Amplitude of the transponder in the accumulated FFT peak
+    double m_noise_sum = 0.0; //< Power of the noise in the accumulated FFT peak
+    combining m_combining = combining::maximal_ratio; //< How intervals are weighted as they are accumulated
     size_t m_samples_per_interval; //< The number of samples in the 512us interval
     size_t m_sampling_rate; //< The sampling rate of the input signal
     size_t m_nr_acc; //< The number of accumulated transponder responses
     wallclock_t m_last_at; //< Last time interval this was seen at
+    wallclock_t m_first_at = 0; //< First time interval this was seen at
+    wallclock_t m_decoded_at = 0; //< Time interval the pass was decoded in
     size_t m_interval_len; //< The length of the capture interval, in microseconds
-    size_t m_samples_per_bit; //< The number of samples, per bit
+    size_t m_decimation; //< Factor the accumulated signal is decimated by before it is sliced
+    size_t m_samples_per_bit; //< The number of samples, per bit, after decimation
     size_t m_window_size = 4; //< Size of the window. TODO: not hardcoded
     boost::circular_buffer<int> m_slice_win; //< The slice window, used in attempting to decode
     bool m_decoded = false; //< Whether or not this pass has been decoded successfully
@@ -109,7 +170,18 @@ private:
     unsigned m_agency_id = 0;
     unsigned m_serial_num = 0;
 
-    std::vector<int> m_norm;
+    buffer_t m_decimated; //< The accumulated signal, decimated for slicing, if m_decimation > 1
+    std::vector<int, arena_allocator<int>> m_norm;
+    std::vector<double, arena_allocator<double>> m_envelope; //< Magnitude of the accumulated signal
+    std::array<std::size_t, 256> m_bit_pos; //< Sample index of the mid-bit transition of each bit
+    std::array<double, 256> m_soft; //< Soft decision for each bit, positive for a 1
+    size_t m_chase_bits = 0; //< Number of least reliable bits error correction may flip, or 0
+    size_t m_chase_max_flips = 3; //< Most bits error correction flips at once
+    size_t m_nr_corrected = 0; //< Bits flipped by error correction
+    std::uint8_t m_watchlists = 0; //< Watchlists the decoded tag is on
+
+    kernel_set const& m_kernels; //< Inner loops, specialized for this interval length
+    kernel_set const& m_slice_kernels; //< Inner loops, specialized for the decimated interval length
 };
 
 } // end namespace zepass
@@ -0,0 +1,128 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <zepass/pass_pool.hh>
+
+#include <stdexcept>
+
+using namespace zepass;
+
+/// Create a pool of passes, allocating all of their buffers up front.
+/// \param capacity The number of passes that can be live at once
+/// \param samples_per_interval The number of samples in a capture interval
+/// \param sampling_rate The sampling rate of the input signal
+/// \param interval_len The length of the capture interval, in microseconds
+/// \param mem Arena to allocate the pass buffers from, or null to use the heap
+pass_pool::pass_pool(size_t const capacity,
+                     freq_t const samples_per_interval,
+                     freq_t const sampling_rate,
+                     size_t const interval_len,
+                     arena* mem)
+{
+    if (0 == capacity) {
+        throw std::invalid_argument("capacity");
+    }
+
+    m_slots.reserve(capacity);
+    m_free.reserve(capacity);
+
+    for (size_t i = 0; i < capacity; i++) {
+        m_slots.push_back(std::make_unique<slot>(samples_per_interval, sampling_rate, interval_len, mem));
+        m_free.push_back(m_slots.back().get());
+    }
+}
+
+pass_pool::~pass_pool()
+{
+}
+
+/// Take a slot from the pool, with its pass reset to track the given frequency.
+/// \return The slot, or null if the pool is exhausted
+pass_pool::slot* pass_pool::acquire(double const center_freq_hz_delta, freq_t const bin)
+{
+    if (m_free.empty()) {
+        m_nr_exhausted++;
+        return nullptr;
+    }
+
+    slot* s = m_free.back();
+    m_free.pop_back();
+
+    s->p.reset(center_freq_hz_delta);
+    s->bin = bin;
+    s->in_use = true;
+    m_nr_undecoded++;
+
+    return s;
+}
+
+/// Return a slot to the pool. It must already be off any timing wheel.
+void pass_pool::release(slot* const s)
+{
+    if (!s->p.is_decoded()) {
+        m_nr_undecoded--;
+    }
+
+    s->in_use = false;
+    m_free.push_back(s);
+}
+
+/// Try to decode the pass in a slot in use, keeping count of the undecoded passes.
+/// \return true if the pass is decoded
+bool pass_pool::decode(slot* const s)
+{
+    bool const was_decoded = s->p.is_decoded();
+    bool const decoded = s->p.decode();
+
+    if (decoded && !was_decoded) {
+        m_nr_undecoded--;
+    }
+
+    return decoded;
+}
+
+/// Restore the pass in a freshly acquired slot from a checkpoint.
+void pass_pool::restore(slot* const s, pass_checkpoint const& cp, sample_t const* const accumulated)
+{
+    s->p.restore(cp, accumulated);
+
+    if (s->p.is_decoded()) {
+        m_nr_undecoded--;
+    }
+}
+
+/// Return whether any slot in use holds a pass that has not been decoded yet.
+/// \param started_before Only count passes first seen before this time
+/// \param updated_since Only count passes last fed at or after this time
+bool pass_pool::has_undecoded(wallclock_t const started_before, wallclock_t const updated_since) const
+{
+    if (0 == m_nr_undecoded) {
+        return false;
+    }
+
+    for (auto const& s : m_slots) {
+        if (s->in_use && !s->p.is_decoded() && s->p.first_seen_at() < started_before &&
+                s->p.last_updated_at() >= updated_since)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,87 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <zepass/types.hh>
+#include <zepass/arena.hh>
+#include <zepass/checkpoint.hh>
+#include <zepass/pass.hh>
+#include <zepass/timing_wheel.hh>
+
+#include <memory>
+#include <vector>
+
+namespace zepass {
+
+///
+/// \brief Fixed set of pass slots, allocated once and recycled.
+/// Taking and returning a slot never touches the allocator. When every slot is
+/// in use, acquire() fails and the shortfall is counted.
+///
+class pass_pool {
+public:
+    ///
+    /// \brief A pass, along with the decoder's bookkeeping for it.
+    /// The wheel_entry hook schedules the slot's expiry on a timing_wheel.
+    ///
+    struct slot : public wheel_entry {
+        slot(freq_t const samples_per_interval, freq_t const sampling_rate,
+             size_t const interval_len, arena* mem)
+            : p(0.0, samples_per_interval, sampling_rate, interval_len, mem) {}
+
+        zepass::pass p; //< The pass itself
+        freq_t bin = 0; //< FFT bin the pass is currently tracked at
+        bool in_use = false; //< Whether or not the slot is handed out
+    };
+
+    pass_pool(size_t const capacity,
+              freq_t const samples_per_interval,
+              freq_t const sampling_rate,
+              size_t const interval_len,
+              arena* mem = nullptr);
+    ~pass_pool();
+
+    slot* acquire(double const center_freq_hz_delta, freq_t const bin);
+    void release(slot* const s);
+    bool decode(slot* const s);
+    void restore(slot* const s, pass_checkpoint const& cp, sample_t const* const accumulated);
+    bool has_undecoded(wallclock_t const started_before, wallclock_t const updated_since) const;
+
+    /// Return the number of slots in use holding a pass that has not been decoded yet
+    size_t get_nr_undecoded() const { return m_nr_undecoded; }
+
+    /// Return the number of slots in the pool
+    size_t get_capacity() const { return m_slots.size(); }
+
+    /// Return the number of slots currently handed out
+    size_t get_in_use() const { return m_slots.size() - m_free.size(); }
+
+    /// Return the number of times a slot was wanted, but the pool was empty
+    size_t get_exhausted_count() const { return m_nr_exhausted; }
+
+private:
+    std::vector<std::unique_ptr<slot>> m_slots; //< Every slot in the pool
+    std::vector<slot*> m_free; //< Stack of free slots
+    size_t m_nr_exhausted = 0; //< Number of failed acquisitions
+    size_t m_nr_undecoded = 0; //< Number of slots in use whose pass is not decoded yet
+};
+
+} // end namespace zepass
+
@@ -29,7 +29,7 @@ double us_to_sec(double const us)
     return us / 1000000.0;
 }
 
-static inline
+static constexpr inline
 std::uint64_t round_nearest_power_2(std::uint64_t value)
 {
     std::uint64_t v = value;
@@ -0,0 +1,343 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <zepass/profiler.hh>
+
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <cerrno>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace zepass;
+
+/// Open a counter of the calling thread, in user space only.
+/// \return The counter's file descriptor, or -1 with errno set
+static
+int open_counter(std::uint32_t const type, std::uint64_t const config, int const group_fd)
+{
+    struct perf_event_attr attr;
+
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return int(syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC));
+}
+
+char const* zepass::get_stage_name(stage const s)
+{
+    switch (s) {
+    case stage::fft:
+        return "fft";
+    case stage::find_passes:
+        return "find_passes";
+    case stage::accumulate:
+        return "accumulate";
+    case stage::decode:
+        return "decode";
+    }
+
+    return "unknown";
+}
+
+char const* zepass::get_counter_name(counter const c)
+{
+    switch (c) {
+    case counter::task_clock:
+        return "task_clock_ns";
+    case counter::cycles:
+        return "cycles";
+    case counter::instructions:
+        return "instructions";
+    case counter::cache_misses:
+        return "cache_misses";
+    case counter::branch_misses:
+        return "branch_misses";
+    }
+
+    return "unknown";
+}
+
+/// Open the counters for the calling thread, and start counting.
+/// \param window_len The number of intervals to total in each window
+/// \throw std::runtime_error if the kernel won't count anything for this thread,
+///        usually because of kernel.perf_event_paranoid
+profiler::profiler(size_t const window_len)
+    : m_window_len(window_len)
+{
+    if (0 == window_len) {
+        throw std::invalid_argument("window_len");
+    }
+
+    m_fds.fill(-1);
+    m_slots.fill(0);
+
+    // The CPU time comes from the kernel and is always there, so it leads the group;
+    // each hardware counter joins it if the CPU has one to give
+    static std::array<std::pair<std::uint32_t, std::uint64_t>, nr_counters> const events = {{
+        { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    }};
+
+    for (size_t i = 0; i < nr_counters; i++) {
+        int const fd = open_counter(events[i].first, events[i].second, m_group_fd);
+
+        if (0 > fd) {
+            if (-1 == m_group_fd) {
+                int const err = errno;
+                throw std::runtime_error(std::string("perf_event_open: ") + std::strerror(err));
+            }
+            continue;
+        }
+
+        if (-1 == m_group_fd) {
+            m_group_fd = fd;
+        }
+
+        m_fds[i] = fd;
+        m_slots[i] = m_nr_open++;
+        m_current.available |= 1u << i;
+    }
+
+    if (!sample(m_last)) {
+        throw std::runtime_error("failed to read the performance counters");
+    }
+}
+
+profiler::~profiler()
+{
+    for (int fd : m_fds) {
+        if (-1 != fd) {
+            close(fd);
+        }
+    }
+}
+
+/// Read every counter in the group at once.
+/// \return false if the counters couldn't be read
+bool profiler::sample(std::array<std::uint64_t, nr_counters>& values) noexcept
+{
+    // A group read gives the number of counters, then each count in the order
+    // the counters were opened
+    std::uint64_t buf[1 + nr_counters];
+
+    if (read(m_group_fd, buf, sizeof(buf)) < ssize_t(sizeof(std::uint64_t) * (1 + m_nr_open))) {
+        return false;
+    }
+
+    for (size_t i = 0; i < nr_counters; i++) {
+        values[i] = -1 != m_fds[i] ? buf[1 + m_slots[i]] : 0;
+    }
+
+    return true;
+}
+
+/// Stop profiling for the rest of the run. The counts so far are kept.
+void profiler::fail(char const* const why) noexcept
+{
+    m_failure = why;
+    m_depth = 0;
+}
+
+/// Charge a stage with everything counted since the last stage boundary.
+void profiler::charge(stage const s) noexcept
+{
+    std::array<std::uint64_t, nr_counters> now;
+
+    if (!sample(now)) {
+        fail("failed to read the performance counters");
+        return;
+    }
+
+    stage_counters& counters = m_current.stages[size_t(s)];
+    for (size_t i = 0; i < nr_counters; i++) {
+        counters.values[i] += now[i] - m_last[i];
+    }
+
+    m_last = now;
+}
+
+/// Start charging a stage. Whatever stage it was called from stops being charged
+/// until it is left.
+void profiler::enter(stage const s) noexcept
+{
+    if (nullptr != m_failure) {
+        return;
+    }
+
+    if (max_depth == m_depth) {
+        fail("profiler stages are nested too deeply");
+        return;
+    }
+
+    if (0 != m_depth) {
+        charge(m_stack[m_depth - 1]);
+    } else if (!sample(m_last)) {
+        fail("failed to read the performance counters");
+    }
+
+    if (nullptr != m_failure) {
+        return;
+    }
+
+    m_current.stages[size_t(s)].nr_calls++;
+    m_stack[m_depth++] = s;
+}
+
+/// Stop charging the innermost stage, and go back to charging the one it was called from.
+void profiler::leave() noexcept
+{
+    if (nullptr != m_failure || 0 == m_depth) {
+        return;
+    }
+
+    charge(m_stack[--m_depth]);
+}
+
+/// Mark the end of an interval, closing the window if it is full.
+void profiler::end_interval()
+{
+    if (++m_current.nr_intervals < m_window_len) {
+        return;
+    }
+
+    m_windows.push_back(m_current);
+
+    unsigned const available = m_current.available;
+    m_current = profile_window();
+    m_current.available = available;
+}
+
+/// Return the totals of every window so far, including the one being filled.
+profile_window profiler::get_total() const
+{
+    profile_window total = m_current;
+
+    for (auto const& w : m_windows) {
+        total.nr_intervals += w.nr_intervals;
+
+        for (size_t s = 0; s < nr_stages; s++) {
+            total.stages[s].nr_calls += w.stages[s].nr_calls;
+            for (size_t i = 0; i < nr_counters; i++) {
+                total.stages[s].values[i] += w.stages[s].values[i];
+            }
+        }
+    }
+
+    return total;
+}
+
+/// Write every window as CSV, a line per stage, after a header naming the columns.
+/// Counters that aren't available are left empty. The window being filled is
+/// written last, if it has any intervals.
+void profiler::write_report(std::ostream& os) const
+{
+    os << "window,intervals,stage,calls";
+    for (size_t i = 0; i < nr_counters; i++) {
+        os << "," << get_counter_name(counter(i));
+    }
+    os << std::endl;
+
+    auto window = [&os](size_t const index, profile_window const& w) {
+        for (size_t s = 0; s < nr_stages; s++) {
+            os << index << "," << w.nr_intervals << "," << get_stage_name(stage(s)) << "," << w.stages[s].nr_calls;
+
+            for (size_t i = 0; i < nr_counters; i++) {
+                os << ",";
+                if (w.has(counter(i))) {
+                    os << w.stages[s].values[i];
+                }
+            }
+
+            os << std::endl;
+        }
+    };
+
+    for (size_t i = 0; i < m_windows.size(); i++) {
+        window(i, m_windows[i]);
+    }
+
+    if (0 != m_current.nr_intervals) {
+        window(m_windows.size(), m_current);
+    }
+}
+
+std::ostream& operator<<(std::ostream& os, zepass::profile_window const& w)
+{
+    using zepass::counter;
+
+    double const nr_intervals = double(std::max<size_t>(w.nr_intervals, 1));
+
+    os << "Profile of " << w.nr_intervals << " intervals, per interval:" << std::endl;
+
+    for (size_t s = 0; s < zepass::nr_stages; s++) {
+        zepass::stage_counters const& c = w.stages[s];
+
+        os << "  " << std::left << std::setw(12) << zepass::get_stage_name(zepass::stage(s)) << std::right <<
+            std::fixed << std::setprecision(2) << double(c.nr_calls)/nr_intervals << " calls, " <<
+            std::setprecision(1) << double(c.get(counter::task_clock))/nr_intervals/1000.0 << "us";
+
+        if (w.has(counter::cycles)) {
+            os << ", " << std::setprecision(0) << double(c.get(counter::cycles))/nr_intervals << " cycles";
+        }
+
+        if (w.has(counter::instructions)) {
+            double const nr_instructions = double(std::max<std::uint64_t>(c.get(counter::instructions), 1));
+
+            if (w.has(counter::cycles)) {
+                os << ", " << std::setprecision(2) << nr_instructions/double(std::max<std::uint64_t>(
+                            c.get(counter::cycles), 1)) << " IPC";
+            }
+
+            // Misses are given per thousand instructions, which doesn't depend on how often the stage runs
+            if (w.has(counter::cache_misses)) {
+                os << ", " << std::setprecision(2) << 1000.0 * double(c.get(counter::cache_misses))/nr_instructions <<
+                    " cache MPKI";
+            }
+
+            if (w.has(counter::branch_misses)) {
+                os << ", " << std::setprecision(2) << 1000.0 * double(c.get(counter::branch_misses))/nr_instructions <<
+                    " branch MPKI";
+            }
+        }
+
+        os << std::endl;
+    }
+
+    if (!w.has(counter::cycles)) {
+        os << "  (no hardware counters, only CPU time)" << std::endl;
+    }
+
+    return os;
+}
@@ -0,0 +1,167 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include <cstdint>
+
+namespace zepass {
+
+/// The parts of the decoder the profiler tells apart
+enum class stage : unsigned {
+    fft, //< Transforming intervals
+    find_passes, //< Searching the spectrum for peaks and handing them out (read handlers included), less the two below
+    accumulate, //< Adding an interval to its pass
+    decode, //< Demodulating a pass and checking its CRC
+};
+
+static constexpr size_t nr_stages = 4;
+
+/// What is counted for each stage
+enum class counter : unsigned {
+    task_clock, //< CPU time, in nanoseconds
+    cycles, //< CPU cycles
+    instructions, //< Instructions retired
+    cache_misses, //< Last level cache misses
+    branch_misses, //< Mispredicted branches
+};
+
+static constexpr size_t nr_counters = 5;
+
+char const* get_stage_name(stage const s);
+char const* get_counter_name(counter const c);
+
+///
+/// \brief Counters charged to one stage.
+///
+struct stage_counters {
+    std::uint64_t nr_calls = 0; //< Times the stage was entered
+    std::array<std::uint64_t, nr_counters> values{}; //< Counts, by counter
+
+    std::uint64_t get(counter const c) const { return values[size_t(c)]; }
+};
+
+///
+/// \brief Counters for every stage over a run of intervals.
+///
+struct profile_window {
+    size_t nr_intervals = 0; //< Intervals processed in the window
+    unsigned available = 0; //< Counters that could be opened, a bit for each by its index
+    std::array<stage_counters, nr_stages> stages; //< Counts, by stage
+
+    bool has(counter const c) const { return 0 != (available & (1u << size_t(c))); }
+    stage_counters const& get(stage const s) const { return stages[size_t(s)]; }
+};
+
+///
+/// \brief Hardware performance counters around the stages of the decoder, from
+/// perf_event_open(2).
+/// The counters count the calling thread in user space only, so the profiler must be
+/// made on the thread doing the decoding, and every decoder sharing it must run there
+/// too. Each stage is charged only for the time spent in it and not in a stage it
+/// called, so the stages add up. Counts are totalled every so many intervals into a
+/// window, and the windows kept until the end of the run. Reading the counters is a
+/// system call at each stage boundary, which costs a microsecond or so; the short
+/// stages carry some of that.
+/// Counters the CPU (or a virtual machine) doesn't have are left out, which may leave
+/// only the CPU time. Nothing here throws once counting has started, since stages are
+/// left from destructors: if the counters can't be read, or stages nest too deeply,
+/// profiling stops, the reason is kept, and the decoder carries on uncounted.
+///
+class profiler {
+public:
+    typedef std::shared_ptr<profiler> ptr_t; //< Pointer type for a profiler
+
+    ///
+    /// \brief Charges a stage for as long as it is in scope. Does nothing without a profiler.
+    ///
+    class scope {
+    public:
+        scope(profiler* const prof, stage const s) : m_prof(prof)
+        {
+            if (nullptr != m_prof) {
+                m_prof->enter(s);
+            }
+        }
+
+        ~scope()
+        {
+            if (nullptr != m_prof) {
+                m_prof->leave();
+            }
+        }
+
+        scope(scope const&) = delete;
+        scope& operator=(scope const&) = delete;
+
+    private:
+        profiler* m_prof;
+    };
+
+    explicit profiler(size_t const window_len);
+    ~profiler();
+
+    void enter(stage const s) noexcept;
+    void leave() noexcept;
+    void end_interval();
+    profile_window get_total() const;
+
+    /// Return whether any hardware counter could be opened, rather than just the CPU time
+    bool has_hardware_counters() const { return 0 != (m_current.available & ~(1u << size_t(counter::task_clock))); }
+
+    /// Return why profiling stopped part way through the run, or null if it didn't
+    char const* get_failure() const { return m_failure; }
+
+    /// Return the number of intervals totalled in each window
+    size_t get_window_len() const { return m_window_len; }
+
+    /// Return every window completed so far, oldest first
+    std::vector<profile_window> const& get_windows() const { return m_windows; }
+
+    void write_report(std::ostream& os) const;
+
+private:
+    bool sample(std::array<std::uint64_t, nr_counters>& values) noexcept;
+    void charge(stage const s) noexcept;
+    void fail(char const* const why) noexcept;
+
+    static constexpr size_t max_depth = 8; //< Deepest stages may be nested
+
+    std::array<int, nr_counters> m_fds; //< Counter file descriptors, by counter, or -1 if not available
+    int m_group_fd = -1; //< Leader of the counter group, read to read them all
+    std::array<size_t, nr_counters> m_slots; //< Position of each counter in a group read, by counter
+    size_t m_nr_open = 0; //< Counters in the group
+    std::array<std::uint64_t, nr_counters> m_last{}; //< Counts at the last stage boundary, by counter
+    std::array<stage, max_depth> m_stack; //< Stages entered and not yet left, innermost last
+    size_t m_depth = 0; //< Number of stages entered and not yet left
+    char const* m_failure = nullptr; //< Why profiling stopped, or null while it's still counting
+    size_t m_window_len; //< Intervals totalled in each window
+    profile_window m_current; //< Window being totalled
+    std::vector<profile_window> m_windows; //< Completed windows
+};
+
+} // end namespace zepass
+
+/// ostream operator to render a summary of a window, one stage per line
+std::ostream& operator<<(std::ostream& os, zepass::profile_window const& w);
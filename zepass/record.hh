@@ -0,0 +1,57 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+namespace zepass {
+
+///
+/// \brief Fixed-layout binary record of a decoded transponder read.
+/// This is shared with other processes, so the layout must not change. New
+/// fields may only be carved out of the reserved space, with a flag bit saying
+/// they are valid.
+///
+struct read_record {
+    std::uint64_t last_seen_at; //< Radio wallclock of the last interval the tag was seen in, in microseconds
+    std::uint64_t decoded_at; //< Time of the interval the pass was decoded in, in microseconds
+    double center_freq_delta; //< Offset of the transponder from the radio center frequency, in Hz
+    std::uint32_t serial_num; //< Tag serial number
+    std::uint32_t nr_samples; //< Number of intervals integrated to decode the tag
+    std::uint16_t agency_id; //< Issuing agency
+    std::uint8_t header; //< Tag header field
+    std::uint8_t tag_type; //< Tag type field
+    std::uint8_t app_id; //< Application ID field
+    std::uint8_t group_id; //< Group ID field
+    std::uint16_t flags; //< read_flag_* bits, the rest are reserved and 0
+};
+
+/// read_record::flags: some bits of the frame were recovered by error correction
+static constexpr std::uint16_t read_flag_corrected = 1 << 0;
+
+/// read_record::flags: bits 8 to 15 are the watchlists the tag is on, bit 8 for list 0
+static constexpr unsigned read_flag_watchlist_shift = 8;
+static constexpr std::uint16_t read_flag_watchlist_mask = 0xff00;
+
+static_assert(sizeof(read_record) == 40, "read_record is part of the shared memory ABI");
+static_assert(std::is_trivially_copyable<read_record>::value, "read_record must be trivially copyable");
+
+} // end namespace zepass
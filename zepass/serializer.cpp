@@ -0,0 +1,221 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <zepass/serializer.hh>
+
+#include <algorithm>
+
+#include <cmath>
+#include <cstring>
+#include <ctime>
+
+using namespace zepass;
+
+namespace {
+
+/// Every pair of decimal digits, so integers can be written two digits at a time
+char const digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+std::uint64_t const us_per_day = 86400ull * 1000000ull;
+
+/// Write an unsigned integer in decimal, returning the end of what was written.
+char* write_uint(char* out, std::uint64_t value)
+{
+    char digits[20];
+    char* p = digits + sizeof(digits);
+
+    while (value >= 100) {
+        unsigned const pair = unsigned(value % 100) * 2;
+        value /= 100;
+        *--p = digit_pairs[pair + 1];
+        *--p = digit_pairs[pair];
+    }
+
+    if (value >= 10) {
+        *--p = digit_pairs[value * 2 + 1];
+        *--p = digit_pairs[value * 2];
+    } else {
+        *--p = char('0' + value);
+    }
+
+    size_t const len = digits + sizeof(digits) - p;
+    std::memcpy(out, p, len);
+    return out + len;
+}
+
+/// Write a value from 0 to 99 as exactly two digits.
+char* write_2digit(char* out, unsigned const value)
+{
+    *out++ = digit_pairs[value * 2];
+    *out++ = digit_pairs[value * 2 + 1];
+    return out;
+}
+
+/// Append a string literal, without its terminator.
+template <size_t N>
+char* write_lit(char* out, char const (&lit)[N])
+{
+    std::memcpy(out, lit, N - 1);
+    return out + N - 1;
+}
+
+} // end anonymous namespace
+
+record_serializer::record_serializer()
+{
+    std::memset(m_date, 0, sizeof(m_date));
+}
+
+record_serializer::~record_serializer()
+{
+}
+
+/// Write the time of day, with the date in front of it, for a wallclock time in
+/// microseconds since the epoch.
+char* record_serializer::write_date(char* out, std::uint64_t const at_us)
+{
+    std::int64_t const day = std::int64_t(at_us/us_per_day);
+    unsigned const secs = unsigned(at_us % us_per_day/1000000);
+
+    if (day != m_day) {
+        std::time_t const midnight = std::time_t(day) * 86400;
+        std::tm utc;
+        gmtime_r(&midnight, &utc);
+
+        // A garbage wallclock can land well past what four digits hold
+        unsigned const year = std::min(unsigned(utc.tm_year + 1900), 9999u);
+
+        char* p = write_2digit(m_date, year/100);
+        p = write_2digit(p, year % 100);
+        *p++ = '-';
+        p = write_2digit(p, unsigned(utc.tm_mon + 1));
+        *p++ = '-';
+        write_2digit(p, unsigned(utc.tm_mday));
+
+        m_day = day;
+    }
+
+    std::memcpy(out, m_date, sizeof(m_date));
+    out += sizeof(m_date);
+    *out++ = ' ';
+    out = write_2digit(out, secs/3600);
+    *out++ = ':';
+    out = write_2digit(out, secs/60 % 60);
+    *out++ = ':';
+    return write_2digit(out, secs % 60);
+}
+
+/// Write a record as a single JSON object, with no trailing newline.
+/// \param rec The record to write
+/// \param buf Where to write it
+/// \param len Space available at buf, which must be at least max_json_len
+/// \return The number of bytes written, or 0 if buf is too small
+size_t record_serializer::write_json(read_record const& rec, char* const buf, size_t const len)
+{
+    if (len < max_json_len) {
+        return 0;
+    }
+
+    char* p = write_lit(buf, "{\"passHeader\":");
+    p = write_uint(p, rec.header);
+    p = write_lit(p, ", \"tagType\":");
+    p = write_uint(p, rec.tag_type);
+    p = write_lit(p, ", \"appId\":");
+    p = write_uint(p, rec.app_id);
+    p = write_lit(p, ", \"groupId\":");
+    p = write_uint(p, rec.group_id);
+    p = write_lit(p, ", \"agencyId\":");
+    p = write_uint(p, rec.agency_id);
+    p = write_lit(p, ", \"serialNum\":");
+    p = write_uint(p, rec.serial_num);
+    p = write_lit(p, ", \"lastSeenAt\":");
+    p = write_uint(p, rec.last_seen_at);
+    p = write_lit(p, ", \"nrSamples\":");
+    p = write_uint(p, rec.nr_samples);
+
+    // The estimate is no better than a fraction of an FFT bin, so whole Hz is plenty
+    p = write_lit(p, ", \"centerFreqDelta\":");
+    double const delta = std::isfinite(rec.center_freq_delta) ? std::round(rec.center_freq_delta) : 0.0;
+    if (delta < 0.0) {
+        *p++ = '-';
+    }
+    p = write_uint(p, std::uint64_t(std::min(std::fabs(delta), 1e18)));
+
+    p = write_lit(p, ", \"decodedAt\":");
+    p = write_uint(p, rec.decoded_at);
+
+    // Only tags on a watchlist carry the field, bit n for list n
+    if (0 != (rec.flags & read_flag_watchlist_mask)) {
+        p = write_lit(p, ", \"watchlists\":");
+        p = write_uint(p, (rec.flags & read_flag_watchlist_mask) >> read_flag_watchlist_shift);
+    }
+
+    p = write_lit(p, ", \"seenAt\": \"");
+    p = write_date(p, rec.last_seen_at);
+    p = write_lit(p, "\"}");
+
+    return p - buf;
+}
+
+/// Write a record in the binary format.
+/// \return The number of bytes written, or 0 if buf is smaller than binary_len
+size_t record_serializer::write_binary(read_record const& rec, char* const buf, size_t const len)
+{
+    if (len < binary_len) {
+        return 0;
+    }
+
+    buf[0] = char(sizeof(read_record) & 0xff);
+    buf[1] = char(sizeof(read_record) >> 8);
+    std::memcpy(buf + 2, &rec, sizeof(read_record));
+
+    return binary_len;
+}
+
+/// Read a record in the binary format.
+/// \param buf The start of the record, at its length prefix
+/// \param len The number of bytes available at buf
+/// \param rec Where to put the record. Fields the writer didn't know about are zeroed.
+/// \return The number of bytes the record took up, or 0 if buf doesn't hold all of it
+size_t record_serializer::read_binary(char const* const buf, size_t const len, read_record& rec)
+{
+    if (len < sizeof(std::uint16_t)) {
+        return 0;
+    }
+
+    size_t const rec_len = size_t(std::uint8_t(buf[0])) | size_t(std::uint8_t(buf[1])) << 8;
+    if (len - sizeof(std::uint16_t) < rec_len) {
+        return 0;
+    }
+
+    std::memset(&rec, 0, sizeof(rec));
+    std::memcpy(&rec, buf + 2, std::min(rec_len, sizeof(read_record)));
+
+    return sizeof(std::uint16_t) + rec_len;
+}
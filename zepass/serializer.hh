@@ -0,0 +1,60 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <zepass/record.hh>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace zepass {
+
+///
+/// \brief Renders read_records into a buffer provided by the caller, as a line of
+/// JSON or as a length-prefixed binary record, without allocating.
+/// A binary record is a 16-bit little-endian length, followed by that many bytes of
+/// read_record in host byte order. Readers skip any bytes past the fields they
+/// know, so the record can grow.
+/// The time a tag was seen is taken from the wallclock of the interval it was last
+/// seen in, and the date is only worked out when it changes.
+///
+class record_serializer {
+public:
+    /// Buffer space that always fits one JSON record
+    static constexpr std::size_t max_json_len = 320;
+
+    /// The length of a binary record, including its length prefix
+    static constexpr std::size_t binary_len = sizeof(std::uint16_t) + sizeof(read_record);
+
+    record_serializer();
+    ~record_serializer();
+
+    std::size_t write_json(read_record const& rec, char* const buf, std::size_t const len);
+    static std::size_t write_binary(read_record const& rec, char* const buf, std::size_t const len);
+    static std::size_t read_binary(char const* const buf, std::size_t const len, read_record& rec);
+
+private:
+    char* write_date(char* out, std::uint64_t const at_us);
+
+    std::int64_t m_day = -1; //< Day since the epoch that m_date holds
+    char m_date[10]; //< That day, as YYYY-MM-DD
+};
+
+} // end namespace zepass
@@ -0,0 +1,156 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <zepass/spectrum.hh>
+#include <zepass/types.hh>
+
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+
+#include <cmath>
+
+using namespace zepass;
+
+/// Create a spectrum monitor.
+/// \param centre_freq The centre frequency of the capture
+/// \param sampling_rate The sampling rate of the capture
+/// \param samples_per_interval The number of samples transformed per interval, to
+///                             scale power relative to a full scale tone
+/// \param fft_len The length of the FFT
+/// \param nr_bins The number of report bins, a power of 2 between 2 and fft_len
+spectrum_monitor::spectrum_monitor(freq_t const centre_freq,
+                                   freq_t const sampling_rate,
+                                   size_t const samples_per_interval,
+                                   size_t const fft_len,
+                                   size_t const nr_bins) : m_sum(nr_bins, 0.0),
+                                                           m_max(nr_bins, 0.0),
+                                                           m_nr_peaks(nr_bins, 0),
+                                                           m_marked(nr_bins, 0),
+                                                           m_centre_freq(centre_freq),
+                                                           m_sampling_rate(sampling_rate),
+                                                           m_fft_len(fft_len)
+{
+    if (nr_bins < 2 || nr_bins > fft_len || 0 != (nr_bins & (nr_bins - 1))) {
+        throw std::invalid_argument("nr_bins");
+    }
+
+    m_group_len = m_fft_len/nr_bins;
+    m_scale = 1.0/(double(samples_per_interval) * double(samples_per_interval));
+}
+
+spectrum_monitor::~spectrum_monitor()
+{
+}
+
+/// Fold the power of each FFT bin of an interval into the report bins.
+/// \param power The power in each FFT bin, in FFTW's order (DC first)
+/// \param at The time of the interval
+void spectrum_monitor::update(double const* const power, wallclock_t const at)
+{
+    // Report bins run from the bottom of the band up, so start half way through
+    // the FFT. No report bin straddles the wrap, since there are at least 2.
+    for (size_t bin = 0; bin < m_sum.size(); bin++) {
+        double const* const group = power + (bin * m_group_len + m_fft_len/2) % m_fft_len;
+        double sum = 0.0,
+               max = m_max[bin];
+
+        for (size_t i = 0; i < m_group_len; i++) {
+            sum += group[i];
+            max = std::max(max, group[i]);
+        }
+
+        m_sum[bin] += sum;
+        m_max[bin] = max;
+    }
+
+    if (0 == m_nr_intervals) {
+        m_first_at = at;
+    }
+
+    m_last_at = at;
+    m_nr_intervals++;
+}
+
+/// Note that a peak was detected in the given FFT bin during the interval about to
+/// be folded in. Only the first peak in a report bin counts towards its occupancy.
+void spectrum_monitor::mark_peak(size_t const fft_bin)
+{
+    size_t const bin = ((fft_bin + m_fft_len/2) % m_fft_len)/m_group_len;
+
+    if (m_marked[bin] != m_nr_intervals + 1) {
+        m_marked[bin] = m_nr_intervals + 1;
+        m_nr_peaks[bin]++;
+    }
+}
+
+/// Throw away everything folded in so far, to start a new report.
+void spectrum_monitor::reset()
+{
+    std::fill(m_sum.begin(), m_sum.end(), 0.0);
+    std::fill(m_max.begin(), m_max.end(), 0.0);
+    std::fill(m_nr_peaks.begin(), m_nr_peaks.end(), 0);
+    std::fill(m_marked.begin(), m_marked.end(), 0);
+    m_nr_intervals = 0;
+}
+
+/// Return the mean power of the FFT bins in a report bin, in dB relative to a full
+/// scale tone.
+double spectrum_monitor::get_mean_power(size_t const bin) const
+{
+    return 10.0 * std::log10(m_sum[bin] * m_scale/double(m_group_len * std::max<size_t>(1, m_nr_intervals)));
+}
+
+/// Return the highest power seen in any FFT bin of a report bin, in dB relative to
+/// a full scale tone.
+double spectrum_monitor::get_max_power(size_t const bin) const
+{
+    return 10.0 * std::log10(m_max[bin] * m_scale);
+}
+
+/// Return the fraction of intervals a peak was detected in a report bin in.
+double spectrum_monitor::get_occupancy(size_t const bin) const
+{
+    return double(m_nr_peaks[bin])/double(std::max<size_t>(1, m_nr_intervals));
+}
+
+std::ostream& operator<<(std::ostream& os, zepass::spectrum_monitor const& s)
+{
+    // Each statistic is a line of its own: when the report covers, how many intervals
+    // went into it, which statistic it is, the frequency at the bottom of the lowest
+    // bin and the width of each bin (both in Hz), then one value per bin.
+    auto line = [&os, &s](char const* const kind, double (zepass::spectrum_monitor::*value)(size_t) const,
+                          int const precision) {
+        os << std::dec << s.first_updated_at() << "," << s.last_updated_at() << "," << s.get_interval_count() <<
+            "," << kind << "," << std::fixed << std::setprecision(0) << s.get_low_freq() << "," << s.get_bin_width() <<
+            std::setprecision(precision);
+
+        for (size_t bin = 0; bin < s.get_nr_bins(); bin++) {
+            os << "," << (s.*value)(bin);
+        }
+
+        os << std::endl;
+    };
+
+    line("mean_db", &zepass::spectrum_monitor::get_mean_power, 1);
+    line("max_db", &zepass::spectrum_monitor::get_max_power, 1);
+    line("occupancy", &zepass::spectrum_monitor::get_occupancy, 4);
+
+    return os;
+}
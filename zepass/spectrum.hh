@@ -0,0 +1,96 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <zepass/types.hh>
+
+#include <functional>
+#include <ostream>
+#include <vector>
+
+#include <cstdint>
+
+namespace zepass {
+
+///
+/// \brief A coarse survey of the spectrum, built from the FFT the decoder already
+/// computes for every interval.
+/// FFT bins are folded, in order of frequency, into a smaller number of report
+/// bins. Each report bin keeps the mean and peak (max-hold) power of the FFT bins
+/// in it, and how many intervals a peak was detected in it (its occupancy), until
+/// it is reset.
+///
+class spectrum_monitor {
+public:
+    /// Called with the monitor each time a report is due, just before it is reset
+    typedef std::function<void(spectrum_monitor const&)> report_handler_t;
+
+    spectrum_monitor(freq_t const centre_freq,
+                     freq_t const sampling_rate,
+                     size_t const samples_per_interval,
+                     size_t const fft_len,
+                     size_t const nr_bins);
+    ~spectrum_monitor();
+
+    void update(double const* const power, wallclock_t const at);
+    void mark_peak(size_t const fft_bin);
+    void reset();
+
+    double get_mean_power(size_t const bin) const;
+    double get_max_power(size_t const bin) const;
+    double get_occupancy(size_t const bin) const;
+
+    /// Return the number of report bins
+    size_t get_nr_bins() const { return m_sum.size(); }
+
+    /// Return the frequency, in Hz, at the bottom of the lowest report bin
+    double get_low_freq() const { return double(m_centre_freq) - double(m_sampling_rate)/2.0; }
+
+    /// Return the width, in Hz, of a report bin
+    double get_bin_width() const { return double(m_sampling_rate)/double(get_nr_bins()); }
+
+    /// Return the number of intervals folded in since the last reset
+    size_t get_interval_count() const { return m_nr_intervals; }
+
+    /// Return the time of the first interval folded in since the last reset
+    wallclock_t first_updated_at() const { return m_first_at; }
+
+    /// Return the time of the last interval folded in
+    wallclock_t last_updated_at() const { return m_last_at; }
+
+private:
+    std::vector<double> m_sum; //< Sum of the power of every FFT bin in each report bin
+    std::vector<double> m_max; //< Highest power of any FFT bin in each report bin
+    std::vector<std::uint32_t> m_nr_peaks; //< Number of intervals with a peak in each report bin
+    std::vector<std::uint32_t> m_marked; //< The interval each report bin last had a peak marked in, plus 1
+    freq_t m_centre_freq; //< The centre frequency of the capture
+    freq_t m_sampling_rate; //< The sampling rate, in Hz, of the capture
+    size_t m_fft_len; //< The length of the FFT, in bins
+    size_t m_group_len; //< The number of FFT bins folded into each report bin
+    double m_scale; //< Scales FFT bin power to be relative to a full scale tone
+    std::uint32_t m_nr_intervals = 0; //< Intervals folded in since the last reset
+    wallclock_t m_first_at = 0; //< Time of the first interval since the last reset
+    wallclock_t m_last_at = 0; //< Time of the last interval folded in
+};
+
+} // end namespace zepass
+
+/// ostream operator to render a spectrum report as CSV lines
+std::ostream& operator<<(std::ostream& os, zepass::spectrum_monitor const& s);
@@ -0,0 +1,237 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <zepass/types.hh>
+
+#include <algorithm>
+#include <array>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace zepass {
+
+///
+/// \brief Intrusive hook for something scheduled on a timing_wheel.
+///
+struct wheel_entry {
+    wheel_entry* prev = nullptr; //< Previous entry in the slot, or null if not scheduled
+    wheel_entry* next = nullptr; //< Next entry in the slot
+    wallclock_t expires_at = 0; //< Wallclock, in microseconds, the entry expires at
+
+    /// Return whether or not the entry is on a wheel
+    bool is_scheduled() const { return nullptr != prev; }
+};
+
+///
+/// \brief Hierarchical timing wheel, keyed on wallclock.
+/// Four levels of 64 slots each; level 0 advances one slot per tick, and each
+/// higher level is cascaded down one slot at a time as the level below wraps.
+/// Scheduling and cancelling are O(1), and advancing costs a slot check per
+/// tick plus the entries that actually expire (or cascade). Entries further out
+/// than the wheel spans sit in the last slot and are re-filed as it comes round.
+/// Advancing further than the wheel spans (such as the first advance of a fresh
+/// wheel to an epoch wallclock) jumps there at once, at the cost of re-filing
+/// every entry.
+///
+class timing_wheel {
+public:
+    static size_t const slot_bits = 6;
+    static size_t const nr_slots = size_t(1) << slot_bits;
+    static size_t const nr_levels = 4;
+
+    /// Create a new timing wheel.
+    /// \param tick_shift The log2 of the wheel resolution, in microseconds
+    explicit timing_wheel(unsigned const tick_shift) : m_tick_shift(tick_shift)
+    {
+        for (auto& level: m_slots) {
+            for (auto& head: level) {
+                head.prev = head.next = &head;
+            }
+        }
+    }
+
+    /// Schedule the entry to expire at the given wallclock, rescheduling it if it
+    /// is already on the wheel.
+    void schedule(wheel_entry* const entry, wallclock_t const expires_at)
+    {
+        if (entry->is_scheduled()) {
+            cancel(entry);
+        }
+
+        entry->expires_at = expires_at;
+        file(entry);
+        m_count++;
+    }
+
+    /// Take the entry off the wheel, if it is on it.
+    void cancel(wheel_entry* const entry)
+    {
+        if (!entry->is_scheduled()) {
+            return;
+        }
+
+        unlink(entry);
+        m_count--;
+    }
+
+    /// Advance the wheel to the given wallclock, calling expire(entry) for every
+    /// entry that expires on the way. The entry is off the wheel by then, and may
+    /// be rescheduled.
+    template <typename F>
+    void advance(wallclock_t const now, F expire)
+    {
+        std::uint64_t const target = now >> m_tick_shift;
+
+        if (0 == m_count || target < m_tick) {
+            // Nothing to walk past, jump straight there
+            m_tick = std::max(m_tick, target);
+            return;
+        }
+
+        if (target - m_tick >= span) {
+            jump(target, expire);
+            return;
+        }
+
+        while (m_tick < target) {
+            m_tick++;
+
+            // Cascade each higher level down a slot as the level below wraps
+            for (size_t level = 1; level < nr_levels; level++) {
+                std::uint64_t const below = m_tick >> (slot_bits * (level - 1));
+                if (0 != (below & (nr_slots - 1))) {
+                    break;
+                }
+
+                wheel_entry& head = m_slots[level][(m_tick >> (slot_bits * level)) & (nr_slots - 1)];
+                while (head.next != &head) {
+                    wheel_entry* entry = head.next;
+                    unlink(entry);
+                    file(entry);
+                }
+            }
+
+            wheel_entry& head = m_slots[0][m_tick & (nr_slots - 1)];
+            while (head.next != &head) {
+                wheel_entry* entry = head.next;
+                unlink(entry);
+
+                if ((entry->expires_at >> m_tick_shift) > m_tick) {
+                    // Parked in the last slot beyond the span of the wheel
+                    file(entry);
+                    continue;
+                }
+
+                m_count--;
+                expire(entry);
+            }
+
+            if (0 == m_count) {
+                m_tick = target;
+            }
+        }
+    }
+
+    /// Return the number of entries on the wheel
+    size_t size() const { return m_count; }
+
+private:
+    static constexpr std::uint64_t span = std::uint64_t(1) << (slot_bits * nr_levels); //< Ticks the wheel covers
+
+    /// Move straight to the given tick, rather than stepping a tick at a time: every
+    /// entry is taken off the wheel, then expired or filed again from the new tick.
+    template <typename F>
+    void jump(std::uint64_t const target, F& expire)
+    {
+        wheel_entry pending;
+        pending.prev = pending.next = &pending;
+
+        for (auto& level: m_slots) {
+            for (auto& head: level) {
+                while (head.next != &head) {
+                    wheel_entry* entry = head.next;
+                    unlink(entry);
+                    link(pending, entry);
+                }
+            }
+        }
+
+        m_tick = target;
+
+        // An expiry handler may cancel or reschedule other entries; cancelling one
+        // still pending takes it off this list, rescheduling files it on the wheel
+        while (pending.next != &pending) {
+            wheel_entry* entry = pending.next;
+            unlink(entry);
+
+            if ((entry->expires_at >> m_tick_shift) > m_tick) {
+                file(entry);
+                continue;
+            }
+
+            m_count--;
+            expire(entry);
+        }
+    }
+
+    static void link(wheel_entry& head, wheel_entry* const entry)
+    {
+        entry->prev = head.prev;
+        entry->next = &head;
+        head.prev->next = entry;
+        head.prev = entry;
+    }
+
+    void file(wheel_entry* const entry)
+    {
+        std::uint64_t const when = std::max(entry->expires_at >> m_tick_shift, m_tick + 1);
+        std::uint64_t const delta = when - m_tick;
+        size_t level = 0;
+
+        while (level < nr_levels - 1 && delta >= (std::uint64_t(1) << (slot_bits * (level + 1)))) {
+            level++;
+        }
+
+        std::uint64_t slot_tick = when;
+        if (delta >= span) {
+            // Too far out; park it in the furthest slot and re-file it from there
+            slot_tick = m_tick + span - 1;
+        }
+
+        link(m_slots[level][(slot_tick >> (slot_bits * level)) & (nr_slots - 1)], entry);
+    }
+
+    static void unlink(wheel_entry* const entry)
+    {
+        entry->prev->next = entry->next;
+        entry->next->prev = entry->prev;
+        entry->prev = entry->next = nullptr;
+    }
+
+    unsigned m_tick_shift; //< log2 of the wheel resolution, in microseconds
+    std::uint64_t m_tick = 0; //< The current tick
+    size_t m_count = 0; //< The number of entries on the wheel
+    std::array<std::array<wheel_entry, nr_slots>, nr_levels> m_slots; //< List heads of each slot
+};
+
+} // end namespace zepass
+
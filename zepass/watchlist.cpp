@@ -0,0 +1,350 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <zepass/watchlist.hh>
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace zepass;
+
+namespace {
+
+char const index_magic[8] = { 'Z', 'P', 'W', 'L', 'I', 'S', 'T', '\0' };
+std::uint32_t const index_version = 1;
+
+/// Seed for the key hash. Stored in the index, so it can change without breaking old ones.
+std::uint64_t const default_seed = 0x9e3779b97f4a7c15ull;
+
+/// Number of Bloom filter probes per key, each taking 9 bits of a 64-bit hash
+unsigned const nr_probes = 7;
+
+///
+/// \brief Header at the start of an index file. Everything after it is aligned to 64 bytes.
+///
+struct index_header {
+    char magic[8]; //< index_magic
+    std::uint32_t version; //< index_version
+    std::uint32_t nr_lists; //< Number of lists named below
+    std::uint64_t nr_keys; //< Number of entries
+    std::uint64_t seed; //< Seed for the key hash
+    std::uint32_t bloom_blocks_log2; //< log2 of the number of 512-bit Bloom filter blocks
+    std::uint32_t bucket_bits; //< log2 of the number of buckets
+    char list_names[watchlist::max_lists][32]; //< NUL-terminated name of each list
+};
+
+///
+/// \brief A key in an index file.
+///
+struct index_entry {
+    std::uint32_t serial_num; //< Tag serial number
+    std::uint16_t agency_id; //< Issuing agency
+    std::uint8_t lists; //< Bit n is set if the key is on list n
+    std::uint8_t reserved; //< Always 0
+};
+
+static_assert(sizeof(index_entry) == 8, "index_entry is part of the file format");
+
+size_t align64(size_t const offs)
+{
+    return (offs + 63) & ~size_t(63);
+}
+
+/// Offsets of the parts of an index, and its total size
+struct index_layout {
+    size_t bloom;
+    size_t buckets;
+    size_t entries;
+    size_t size;
+};
+
+index_layout layout_of(std::uint32_t const bloom_blocks_log2, std::uint32_t const bucket_bits,
+                       std::uint64_t const nr_keys)
+{
+    index_layout l;
+    l.bloom = align64(sizeof(index_header));
+    l.buckets = l.bloom + (size_t(64) << bloom_blocks_log2);
+    l.entries = align64(l.buckets + ((size_t(1) << bucket_bits) + 1) * sizeof(std::uint32_t));
+    l.size = l.entries + nr_keys * sizeof(index_entry);
+    return l;
+}
+
+std::uint64_t make_key(std::uint16_t const agency_id, std::uint32_t const serial_num)
+{
+    return std::uint64_t(agency_id) << 32 | serial_num;
+}
+
+/// Mix a 64-bit value (the splitmix64 finalizer).
+std::uint64_t mix(std::uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+/// Return the smallest n such that 2^n is at least value.
+std::uint32_t log2_ceil(std::uint64_t const value)
+{
+    std::uint32_t n = 0;
+    while ((std::uint64_t(1) << n) < value) {
+        n++;
+    }
+    return n;
+}
+
+} // end anonymous namespace
+
+/// Map an index made by watchlist::build(). The whole index is faulted in up front,
+/// so lookups don't wait on the disk.
+/// \param filename The index file
+watchlist::watchlist(std::string const& filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (0 > fd) {
+        throw std::system_error(errno, std::system_category(), "open " + filename);
+    }
+
+    struct stat st;
+    if (0 != fstat(fd, &st)) {
+        int err = errno;
+        close(fd);
+        throw std::system_error(err, std::system_category(), "fstat " + filename);
+    }
+
+    m_size = size_t(st.st_size);
+
+    if (m_size < sizeof(index_header)) {
+        close(fd);
+        throw std::runtime_error(filename + " is not a watchlist index");
+    }
+
+    void* region = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    int err = errno;
+    close(fd);
+
+    if (MAP_FAILED == region) {
+        throw std::system_error(err, std::system_category(), "mmap " + filename);
+    }
+
+    m_base = region;
+
+    auto hdr = static_cast<index_header const*>(m_base);
+
+    if (0 != std::memcmp(hdr->magic, index_magic, sizeof(index_magic)) || index_version != hdr->version ||
+            max_lists < hdr->nr_lists || 30 < hdr->bloom_blocks_log2 || 0 == hdr->bucket_bits ||
+            30 < hdr->bucket_bits || std::uint32_t(-1) < hdr->nr_keys ||
+            layout_of(hdr->bloom_blocks_log2, hdr->bucket_bits, hdr->nr_keys).size > m_size)
+    {
+        munmap(region, m_size);
+        throw std::runtime_error(filename + " is not a compatible watchlist index");
+    }
+
+    index_layout const l = layout_of(hdr->bloom_blocks_log2, hdr->bucket_bits, hdr->nr_keys);
+    char const* base = static_cast<char const*>(m_base);
+
+    m_bloom = reinterpret_cast<std::uint64_t const*>(base + l.bloom);
+    m_buckets = reinterpret_cast<std::uint32_t const*>(base + l.buckets);
+    m_entries = base + l.entries;
+    m_seed = hdr->seed;
+    m_bloom_mask = (std::uint64_t(1) << hdr->bloom_blocks_log2) - 1;
+    m_bucket_shift = 64 - hdr->bucket_bits;
+    m_nr_keys = size_t(hdr->nr_keys);
+    m_nr_lists = hdr->nr_lists;
+
+    // A lookup trusts the bucket table to stay inside the entries
+    size_t const nr_buckets = size_t(1) << hdr->bucket_bits;
+    bool intact = 0 == m_buckets[0] && m_nr_keys == m_buckets[nr_buckets];
+    for (size_t i = 0; intact && i < nr_buckets; i++) {
+        intact = m_buckets[i] <= m_buckets[i + 1];
+    }
+
+    if (!intact) {
+        munmap(region, m_size);
+        throw std::runtime_error(filename + " is a damaged watchlist index");
+    }
+
+    for (size_t i = 0; i < m_nr_lists; i++) {
+        m_list_names[i].assign(hdr->list_names[i], strnlen(hdr->list_names[i], sizeof(hdr->list_names[i])));
+    }
+}
+
+watchlist::~watchlist()
+{
+    munmap(const_cast<void*>(m_base), m_size);
+}
+
+/// Look a tag up.
+/// \return The lists the tag is on, bit n for list n, or 0 if it isn't on any
+std::uint8_t watchlist::lookup(std::uint16_t const agency_id, std::uint32_t const serial_num) const
+{
+    std::uint64_t const key = make_key(agency_id, serial_num);
+    std::uint64_t const hash = mix(key ^ m_seed);
+
+    std::uint64_t const* block = m_bloom + 8 * (hash & m_bloom_mask);
+    std::uint64_t probes = mix(hash);
+    for (unsigned i = 0; i < nr_probes; i++, probes >>= 9) {
+        unsigned const bit = unsigned(probes & 511);
+        if (0 == (block[bit >> 6] & (std::uint64_t(1) << (bit & 63)))) {
+            return 0;
+        }
+    }
+
+    size_t const bucket = size_t(hash >> m_bucket_shift);
+    index_entry const* entries = static_cast<index_entry const*>(m_entries);
+    index_entry const* first = entries + m_buckets[bucket];
+    index_entry const* last = entries + m_buckets[bucket + 1];
+
+    auto it = std::lower_bound(first, last, key, [](index_entry const& e, std::uint64_t const k) {
+            return make_key(e.agency_id, e.serial_num) < k;
+        });
+
+    if (it == last || make_key(it->agency_id, it->serial_num) != key) {
+        return 0;
+    }
+
+    return it->lists;
+}
+
+/// Write an index. It is written alongside the destination and renamed over it, so
+/// a daemon reloading the index never sees it half-written.
+/// \param filename Where to write the index
+/// \param entries The keys to index. A key given more than once is on every list it was given with.
+/// \param list_names The name of each list, at most max_lists of them, each less than 32 characters
+void watchlist::build(std::string const& filename, std::vector<entry> entries,
+                      std::vector<std::string> const& list_names)
+{
+    if (max_lists < list_names.size()) {
+        throw std::invalid_argument("too many lists");
+    }
+
+    index_header hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    std::memcpy(hdr.magic, index_magic, sizeof(index_magic));
+    hdr.version = index_version;
+    hdr.nr_lists = std::uint32_t(list_names.size());
+    hdr.seed = default_seed;
+
+    for (size_t i = 0; i < list_names.size(); i++) {
+        if (list_names[i].size() >= sizeof(hdr.list_names[i])) {
+            throw std::invalid_argument("list name " + list_names[i] + " is too long");
+        }
+        std::memcpy(hdr.list_names[i], list_names[i].c_str(), list_names[i].size());
+    }
+
+    std::uint8_t const valid_lists = std::uint8_t((1u << list_names.size()) - 1);
+
+    // Fold duplicate keys together
+    std::sort(entries.begin(), entries.end(), [](entry const& a, entry const& b) {
+            return make_key(a.agency_id, a.serial_num) < make_key(b.agency_id, b.serial_num);
+        });
+
+    std::vector<index_entry> keys;
+    keys.reserve(entries.size());
+
+    for (auto const& e: entries) {
+        if (0 != (e.lists & ~valid_lists)) {
+            throw std::invalid_argument("entry on a list that has no name");
+        }
+
+        if (!keys.empty() && keys.back().agency_id == e.agency_id && keys.back().serial_num == e.serial_num) {
+            keys.back().lists |= e.lists;
+        } else {
+            keys.push_back(index_entry{ e.serial_num, e.agency_id, e.lists, 0 });
+        }
+    }
+
+    if (std::uint32_t(-1) < keys.size()) {
+        throw std::invalid_argument("too many keys");
+    }
+
+    // About 16 bits of Bloom filter, and a quarter of a bucket, per key
+    hdr.nr_keys = keys.size();
+    hdr.bloom_blocks_log2 = std::min<std::uint32_t>(30, log2_ceil((keys.size() + 31)/32));
+    hdr.bucket_bits = std::min<std::uint32_t>(30, std::max<std::uint32_t>(1, log2_ceil((keys.size() + 3)/4)));
+
+    index_layout const l = layout_of(hdr.bloom_blocks_log2, hdr.bucket_bits, hdr.nr_keys);
+    unsigned const bucket_shift = 64 - hdr.bucket_bits;
+    std::vector<char> image(l.size, 0);
+
+    std::uint64_t* bloom = reinterpret_cast<std::uint64_t*>(&image[l.bloom]);
+    std::uint64_t const bloom_mask = (std::uint64_t(1) << hdr.bloom_blocks_log2) - 1;
+    std::vector<std::uint32_t> counts((size_t(1) << hdr.bucket_bits) + 1, 0);
+
+    for (auto const& k: keys) {
+        std::uint64_t const hash = mix(make_key(k.agency_id, k.serial_num) ^ hdr.seed);
+
+        std::uint64_t* block = bloom + 8 * (hash & bloom_mask);
+        std::uint64_t probes = mix(hash);
+        for (unsigned i = 0; i < nr_probes; i++, probes >>= 9) {
+            unsigned const bit = unsigned(probes & 511);
+            block[bit >> 6] |= std::uint64_t(1) << (bit & 63);
+        }
+
+        counts[(hash >> bucket_shift) + 1]++;
+    }
+
+    // Turn the bucket sizes into the index of each bucket's first entry
+    for (size_t i = 1; i < counts.size(); i++) {
+        counts[i] += counts[i - 1];
+    }
+    std::memcpy(&image[l.buckets], counts.data(), counts.size() * sizeof(std::uint32_t));
+
+    // Keys are already in order, so placing them in bucket order keeps them sorted within each bucket
+    index_entry* placed = reinterpret_cast<index_entry*>(&image[l.entries]);
+    for (auto const& k: keys) {
+        std::uint64_t const hash = mix(make_key(k.agency_id, k.serial_num) ^ hdr.seed);
+        placed[counts[hash >> bucket_shift]++] = k;
+    }
+
+    std::memcpy(&image[0], &hdr, sizeof(hdr));
+
+    std::string const tmp_name = filename + ".tmp";
+    {
+        std::ofstream out(tmp_name, std::ofstream::binary | std::ofstream::trunc);
+        out.write(image.data(), std::streamsize(image.size()));
+        out.close();
+
+        if (!out) {
+            std::remove(tmp_name.c_str());
+            throw std::runtime_error("failed to write " + tmp_name);
+        }
+    }
+
+    if (0 != std::rename(tmp_name.c_str(), filename.c_str())) {
+        int err = errno;
+        std::remove(tmp_name.c_str());
+        throw std::system_error(err, std::system_category(), "rename " + tmp_name);
+    }
+}
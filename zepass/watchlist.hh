@@ -0,0 +1,91 @@
+// This file is part of ZEPASSD.
+//
+// ZEPASSD is Copyright (C) 2018 Phil Vachon
+// <phil@security-embedded.com>
+//
+// ZEPASSD is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ZEPASSD is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ZEPASSD.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace zepass {
+
+///
+/// \brief Immutable index of (agency, serial) keys on up to 8 watchlists, mapped
+/// straight from a file made with watchlist::build().
+/// Keys are spread over buckets by a hash, and sorted by key within each bucket, so
+/// a lookup is one binary search over a handful of entries. A blocked Bloom filter
+/// in front turns most tags that aren't listed away after touching one cache line.
+/// A watchlist is never modified once loaded, so any number of threads can look
+/// keys up in it; replace it as a whole to change it.
+///
+class watchlist {
+public:
+    typedef std::shared_ptr<watchlist const> ptr_t; //< Pointer type for a watchlist
+
+    /// The most lists an index can hold, one bit each in a lookup result
+    static constexpr size_t max_lists = 8;
+
+    ///
+    /// \brief A key to put in an index, and the lists it is on.
+    ///
+    struct entry {
+        std::uint16_t agency_id; //< Issuing agency
+        std::uint32_t serial_num; //< Tag serial number
+        std::uint8_t lists; //< Bit n is set if the key is on list n
+    };
+
+    explicit watchlist(std::string const& filename);
+    ~watchlist();
+
+    watchlist(watchlist const&) = delete;
+    watchlist& operator=(watchlist const&) = delete;
+
+    std::uint8_t lookup(std::uint16_t const agency_id, std::uint32_t const serial_num) const;
+
+    /// Return the number of distinct keys in the index
+    size_t get_nr_keys() const { return m_nr_keys; }
+
+    /// Return the number of lists in the index
+    size_t get_nr_lists() const { return m_nr_lists; }
+
+    /// Return the name of list n
+    std::string const& get_list_name(size_t const n) const { return m_list_names[n]; }
+
+    static void build(std::string const& filename, std::vector<entry> entries,
+                      std::vector<std::string> const& list_names);
+
+private:
+    void const* m_base = nullptr; //< The mapped index
+    size_t m_size = 0; //< Size of the mapping, in bytes
+    std::uint64_t const* m_bloom = nullptr; //< Bloom filter, in 512-bit blocks
+    std::uint32_t const* m_buckets = nullptr; //< Index of the first entry in each bucket, and one past the last
+    void const* m_entries = nullptr; //< Entries, by bucket and then by key
+    std::uint64_t m_seed = 0; //< Hash seed the index was built with
+    std::uint64_t m_bloom_mask = 0; //< Number of Bloom filter blocks, less 1
+    unsigned m_bucket_shift = 0; //< Shift from a hash to its bucket
+    size_t m_nr_keys = 0; //< Number of keys in the index
+    size_t m_nr_lists = 0; //< Number of lists in the index
+    std::array<std::string, max_lists> m_list_names; //< Name of each list
+};
+
+} // end namespace zepass